@@ -208,6 +208,7 @@ int apic_is_enabled(void);
 int apic_enable_timer(void);
 int apic_disable_timer(void);
 int apic_timer_deadline(uint32_t);
+int apic_timer_deadline_tsc(uint64_t);
 int apic_timer_is_running(void);
 int apic_send_ipi(uint64_t dest, uint8_t irq);
 int ioapic_inton(uint8_t irq, uint8_t apicid);
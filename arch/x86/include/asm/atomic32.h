@@ -67,6 +67,23 @@ inline static int32_t atomic_int32_test_and_set(atomic_int32_t* d, int32_t ret)
 	return ret;
 }
 
+/** @brief Atomic compare and exchange operation for int32 vars
+ *
+ * The new value is only stored, if the atomic variable holds the
+ * expected value.
+ *
+ * @param d Pointer to the atomic_int32_t var
+ * @param old The expected value
+ * @param new The value you want to store
+ *
+ * @return The value of the atomic_int32_t var before the operation
+ */
+inline static int32_t atomic_int32_cmpxchg(atomic_int32_t *d, int32_t old, int32_t new)
+{
+	asm volatile(LOCK "cmpxchgl %2, %1" : "+a"(old), "+m"(d->counter) : "r"(new) : "memory", "cc");
+	return old;
+}
+
 /** @brief Atomic addition of values to atomic_int32_t vars
  *
  * This function lets you add values in an atomic operation
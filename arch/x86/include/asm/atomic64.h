@@ -67,6 +67,23 @@ inline static int64_t atomic_int64_test_and_set(atomic_int64_t* d, int64_t ret)
 	return ret;
 }
 
+/** @brief Atomic compare and exchange operation for int64 vars
+ *
+ * The new value is only stored, if the atomic variable holds the
+ * expected value.
+ *
+ * @param d Pointer to the atomic_int64_t var
+ * @param old The expected value
+ * @param new The value you want to store
+ *
+ * @return The value of the atomic_int64_t var before the operation
+ */
+inline static int64_t atomic_int64_cmpxchg(atomic_int64_t *d, int64_t old, int64_t new)
+{
+	asm volatile(LOCK "cmpxchgq %2, %1" : "+a"(old), "+m"(d->counter) : "r"(new) : "memory", "cc");
+	return old;
+}
+
 /** @brief Atomic addition of values to atomic_int64_t vars
  *
  * This function lets you add values in an atomic operation
@@ -46,6 +46,8 @@
 #define PAGE_2M_BITS		21
 /// The size of a single page in bytes
 #define PAGE_SIZE		( 1L << PAGE_BITS)
+/// The size of a huge page in bytes
+#define PAGE_2M_SIZE		( 1L << PAGE_2M_BITS)
 /// Mask the page address without page map flags and XD flag
 #if 0
 #define PAGE_MASK		((~0UL) << PAGE_BITS)
@@ -156,6 +158,21 @@ static inline size_t sign_extend(ssize_t addr, int bits)
  */
 size_t virt_to_phys(size_t vir);
 
+/** @brief Statistics of the on demand heap mapping
+ *
+ * @param faults Number of handled heap faults
+ * @param huge_faults Number of heap faults, which are backed by a 2 MiB page
+ * @param stack_faults Number of faults, which populate a lazy thread stack
+ */
+void page_fault_stats(size_t* faults, size_t* huge_faults, size_t* stack_faults);
+
+/** @brief Unmap a partly mapped range and release its page frames
+ *
+ * Used for stacks, which are populated on demand and therefore
+ * not backed by contiguous frames.
+ */
+int page_unmap_free(size_t viraddr, size_t npages);
+
 /** @brief Initialize paging subsystem
  *
  * This function uses the existing bootstrap page tables (boot_{pgd, pgt})
@@ -189,6 +206,21 @@ static inline int page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t
 	return __page_map(viraddr, phyaddr, npages, bits, 1);
 }
 
+/** @brief Map new page frames to the unmapped pages of a region
+ *
+ * Pages, which are already mapped, remain untouched. The remaining pages
+ * are backed by contiguous frames and mapped in batches.
+ *
+ * @param viraddr The virtual start address
+ * @param npages The region's size in number of pages
+ * @param bits Page flags of the new mappings
+ * @param zero if set, the new pages are zeroed by non-temporal stores
+ * @return
+ * - 0 on success
+ * - -ENOMEM (-12) if not enough memory is available
+ */
+int page_populate(size_t viraddr, size_t npages, size_t bits, uint8_t zero);
+
 /** @brief Unmap a continuous region of pages
  *
  * @param viraddr The virtual start address
@@ -75,6 +75,7 @@ extern "C" {
 #define CPU_FEATURE_SSE4_2			(1 << 20)
 #define CPU_FEATURE_X2APIC			(1 << 21)
 #define CPU_FEATURE_MOVBE			(1 << 22)
+#define CPU_FEATURE_TSC_DEADLINE		(1 << 24)
 #define CPU_FEATURE_XSAVE			(1 << 26)
 #define CPU_FEATURE_OSXSAVE			(1 << 27)
 #define CPU_FEATURE_AVX				(1 << 28)
@@ -245,6 +246,7 @@ extern "C" {
 #define MSR_IA32_PERF_STATUS			0x00000198
 #define MSR_IA32_PERF_CTL			0x00000199
 #define MSR_IA32_CR_PAT				0x00000277
+#define MSR_IA32_TSC_DEADLINE			0x000006e0
 #define MSR_MTRRdefType				0x000002ff
 
 #define MSR_PPERF				0x0000064e
@@ -388,6 +390,10 @@ inline static uint32_t has_x2apic(void) {
 	return (cpu_info.feature2 & CPU_FEATURE_X2APIC);
 }
 
+inline static uint32_t has_tsc_deadline(void) {
+	return (cpu_info.feature2 & CPU_FEATURE_TSC_DEADLINE);
+}
+
 inline static uint32_t has_xsave(void) {
 	return (cpu_info.feature2 & CPU_FEATURE_XSAVE);
 }
@@ -698,6 +704,25 @@ inline static void invalidate_cache(void) {
 /// Send IPIs to the other core, which flush the TLB on the other cores.
 int ipi_tlb_flush(void);
 
+/** @brief Send IPIs to the other cores, which flush a range of their TLBs
+ *
+ * Cores, which have already a pending shootdown, extend their range and
+ * don't receive an additional IPI.
+ *
+ * @param start Start address of the range
+ * @param end End address of the range
+ */
+int ipi_tlb_flush_range(size_t start, size_t end);
+
+/** @brief Flush a range of the local TLB
+ *
+ * Small ranges are invalidated page by page, otherwise the whole TLB is flushed.
+ */
+void tlb_flush_range(size_t start, size_t end);
+
+/// Print the statistics of the TLB shootdowns
+void print_tlb_stats(void);
+
 /** @brief Flush Translation Lookaside Buffer
  *
  * Just reads cr3 and writes the same value back into it.
@@ -775,6 +800,8 @@ static inline void rmb(void) { asm volatile("lfence":::"memory"); }
 /// Force strict CPU ordering, serializes store operations.
 static inline void wmb(void) { asm volatile("sfence" ::: "memory"); }
 #endif
+/// Prevent the compiler from reordering memory accesses. x86 keeps the order of loads and of stores.
+static inline void cmb(void) { asm volatile("" ::: "memory"); }
 
 /** @brief Get Extended Control Register
  *
@@ -84,6 +84,41 @@ inline static void *memset(void* dest, int val, size_t count)
 }
 #endif
 
+/** @brief Zero a range by non-temporal stores
+ *
+ * The stores bypass the caches. Consequently, zeroing of large regions
+ * doesn't evict the working set. Only general purpose registers are used
+ * and the FPU state remains untouched.
+ *
+ * @param dest Destination address, aligned to 64 bytes
+ * @param count Size of target range in bytes, a multiple of 64
+ */
+inline static void memzero_nt(void* dest, size_t count)
+{
+	size_t i, j;
+
+	count &= ~63ULL;
+	if (BUILTIN_EXPECT(!dest || !count, 0))
+		return;
+
+	asm volatile (
+		"1:\n\t"
+		"movnti %4, 0(%0)\n\t"
+		"movnti %4, 8(%0)\n\t"
+		"movnti %4, 16(%0)\n\t"
+		"movnti %4, 24(%0)\n\t"
+		"movnti %4, 32(%0)\n\t"
+		"movnti %4, 40(%0)\n\t"
+		"movnti %4, 48(%0)\n\t"
+		"movnti %4, 56(%0)\n\t"
+		"addq $64, %0\n\t"
+		"subq $64, %1\n\t"
+		"jnz 1b\n\t"
+		"sfence\n\t"
+		: "=&r"(i), "=&r"(j)
+		: "0"(dest), "1"(count), "r"(0ULL) : "memory", "cc");
+}
+
 #if HAVE_ARCH_STRLEN
 /** @brief Standard string length
  *
@@ -42,6 +42,8 @@ extern "C" {
 
 static inline int timer_deadline(uint32_t t) { return apic_timer_deadline(t); }
 
+static inline int timer_deadline_tsc(uint64_t tsc) { return apic_timer_deadline_tsc(tsc); }
+
 static inline void timer_disable(void) { apic_disable_timer(); }
 
 static inline int timer_is_running(void) { return apic_timer_is_running(); }
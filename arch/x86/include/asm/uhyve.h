@@ -46,6 +46,97 @@ inline static void uhyve_send(unsigned short _port, unsigned int _data)
 	outportl(_port, _data);
 }
 
+/// IRQ, which signals new completions of the request ring
+#define UHYVE_RING_IRQ		10
+/// Number of entries of the submission and the completion queue (power of two)
+#define UHYVE_RING_SIZE		256
+#define UHYVE_RING_MASK		(UHYVE_RING_SIZE - 1)
+
+/** @brief Request in the submission queue
+ *
+ * A request describes the same operation as the port I/O of the
+ * synchronous interface: the port number and the physical address
+ * of the argument structure.
+ */
+typedef struct uhyve_sqe {
+	/// UHYVE_PORT_* of the operation
+	uint32_t port;
+	/// physical address of the arguments
+	uint32_t args;
+	/// returned unmodified in the completion
+	uint64_t user_data;
+} uhyve_sqe_t;
+
+/** @brief Entry of the completion queue */
+typedef struct uhyve_cqe {
+	/// user_data of the completed request
+	uint64_t user_data;
+} uhyve_cqe_t;
+
+/** @brief Request ring, which is shared with uhyve
+ *
+ * The guest produces requests and consumes completions, the worker
+ * threads of uhyve do it the other way round. The indices are
+ * increased freely and are masked on access. The guest has to ring
+ * the doorbell only, if a worker sleeps.
+ */
+typedef struct uhyve_ring {
+	/// next free submission entry (written by the guest)
+	volatile uint32_t sq_tail __attribute__ ((aligned (CACHE_LINE)));
+	/// next completion, which the guest consumes
+	volatile uint32_t cq_head;
+	/// next request, which the host consumes
+	volatile uint32_t sq_head __attribute__ ((aligned (CACHE_LINE)));
+	/// next free completion entry (written by the host)
+	volatile uint32_t cq_tail;
+	/// non-zero, if a worker of the host waits for requests
+	volatile uint32_t host_idle;
+	/// submission queue
+	uhyve_sqe_t sq[UHYVE_RING_SIZE] __attribute__ ((aligned (CACHE_LINE)));
+	/// completion queue
+	uhyve_cqe_t cq[UHYVE_RING_SIZE];
+} uhyve_ring_t;
+
+/// Maximal number of segments of a vectored request
+#define UHYVE_IOV_MAX		64
+
+/** @brief Physically contiguous part of an I/O buffer */
+typedef struct uhyve_seg {
+	/// guest physical address
+	size_t addr;
+	/// length in bytes
+	size_t len;
+} uhyve_seg_t;
+
+/** @brief Append the physical segments of a buffer to a segment list
+ *
+ * Physically contiguous pages are merged. The pages are touched before
+ * the translation, so that pages of the heap, which are populated on
+ * demand, are mapped.
+ *
+ * @param segs Segment list
+ * @param cnt Number of used entries, which is updated
+ * @param buf Virtual address of the buffer
+ * @param len Length of the buffer
+ * @return Number of bytes, which fit into the list (at most UHYVE_IOV_MAX entries)
+ */
+size_t uhyve_add_segments(uhyve_seg_t* segs, uint32_t* cnt, const void* buf, size_t len);
+
+/** @brief Register the request ring at uhyve */
+int uhyve_ring_init(void);
+
+/** @brief Execute an I/O operation of uhyve
+ *
+ * The request is queued in the shared ring and the calling task blocks
+ * until a worker of uhyve completes it. Without a ring, during the
+ * initialization and with disabled interrupts, the operation is
+ * executed synchronously by port I/O.
+ *
+ * @param port UHYVE_PORT_* of the operation
+ * @param args Argument structure, which receives the results
+ */
+void uhyve_submit(unsigned short port, void* args);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,7 @@
 #include <hermit/time.h>
 #include <hermit/spinlock.h>
 #include <hermit/vma.h>
+#include <hermit/malloc.h>
 #include <hermit/tasks.h>
 #include <hermit/logging.h>
 #include <asm/irq.h>
@@ -189,6 +190,18 @@ static inline void lapic_timer_periodic(void)
 	lapic_write(APIC_LVT_T, 0x2007B);
 }
 
+static inline void lapic_timer_tsc_deadline(void)
+{
+	lapic_write(APIC_LVT_T, 0x4007B);
+	// the write to the LVT has to be visible before the deadline is armed
+	mb();
+}
+
+static inline int lapic_timer_is_tsc_deadline(void)
+{
+	return (lapic_read(APIC_LVT_T) & 0x60000) == 0x40000;
+}
+
 extern uint32_t disable_x2apic;
 
 static inline void x2apic_disable(void)
@@ -319,6 +332,10 @@ static inline void set_ipi_dest(uint32_t cpu_id) {
 int apic_timer_is_running(void)
 {
 	if (BUILTIN_EXPECT(apic_is_enabled(), 1)) {
+		// in TSC-deadline mode, the counter register is always zero
+		if (lapic_timer_is_tsc_deadline())
+			return rdmsr(MSR_IA32_TSC_DEADLINE) != 0;
+
 		return lapic_read(APIC_CCR) != 0;
 	}
 
@@ -329,6 +346,13 @@ int apic_timer_deadline(uint32_t ticks)
 {
 	if (BUILTIN_EXPECT(apic_is_enabled() && icr, 1)) {
 		LOG_DEBUG("timer oneshot %ld at core %d\n", ticks, CORE_ID);
+
+		if (has_tsc_deadline()) {
+			const uint64_t cycles_per_tick = (uint64_t) get_cpu_frequency() * 1000000ULL / (uint64_t) TIMER_FREQ;
+
+			return apic_timer_deadline_tsc(get_rdtsc() + (uint64_t) ticks * cycles_per_tick);
+		}
+
 		lapic_timer_oneshot();
 		lapic_timer_set_counter(ticks * icr);
 
@@ -338,12 +362,49 @@ int apic_timer_deadline(uint32_t ticks)
 	return -EINVAL;
 }
 
+/*
+ * Programs the timer to fire, when the TSC reaches the given value.
+ * If the CPU supports the TSC-deadline mode, the deadline is directly
+ * written to the MSR. Otherwise, the distance is converted into a one-shot
+ * counter, which is rounded up to avoid an early interrupt.
+ */
+int apic_timer_deadline_tsc(uint64_t tsc)
+{
+	if (BUILTIN_EXPECT(apic_is_enabled() && icr, 1)) {
+		if (has_tsc_deadline()) {
+			if (!lapic_timer_is_tsc_deadline())
+				lapic_timer_tsc_deadline();
+			// a deadline in the past triggers the interrupt immediately
+			wrmsr(MSR_IA32_TSC_DEADLINE, tsc);
+		} else {
+			const uint64_t cycles_per_tick = (uint64_t) get_cpu_frequency() * 1000000ULL / (uint64_t) TIMER_FREQ;
+			const uint64_t now = get_rdtsc();
+			uint64_t cycles = tsc > now ? tsc - now : 1;
+			uint32_t counter;
+
+			if (cycles >= cycles_per_tick * (0xFFFFFFFFULL / icr))
+				counter = 0xFFFFFFFF;
+			else
+				counter = (uint32_t) ((cycles * icr + cycles_per_tick - 1) / cycles_per_tick);
+
+			lapic_timer_oneshot();
+			lapic_timer_set_counter(counter ? counter : 1);
+		}
+
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
 int apic_disable_timer(void)
 {
 	if (BUILTIN_EXPECT(!apic_is_enabled(), 0))
 		return -EINVAL;
 
 	//kprintf("Disable local APIC timer at core %d\n", CORE_ID);
+	if (has_tsc_deadline() && lapic_timer_is_tsc_deadline())
+		wrmsr(MSR_IA32_TSC_DEADLINE, 0);
 	lapic_timer_disable();
 
 	return 0;
@@ -898,6 +959,75 @@ no_mp:
 	goto check_lapic;
 }
 
+/// Larger ranges aren't invalidated page by page, the whole TLB is flushed
+#define TLB_FLUSH_THRESHOLD	32
+
+/** @brief TLB shootdown state of a core
+ *
+ * Beside the range, which has still to be flushed by this core, the
+ * structure holds the shootdown statistics of the core.
+ */
+typedef struct tlb_shootdown {
+	/// Start address of the pending range
+	size_t start;
+	/// End address of the pending range (0 => nothing pending)
+	size_t end;
+	/// Protects the pending range
+	spinlock_irqsave_t lock;
+	/// Number of IPIs, which are sent by this core
+	uint64_t ipis;
+	/// Number of pages, which are invalidated by invlpg
+	uint64_t pages;
+	/// Number of full TLB flushes
+	uint64_t flushes;
+} __attribute__ ((aligned (CACHE_LINE))) tlb_shootdown_t;
+
+static tlb_shootdown_t tlb_shootdowns[MAX_CORES] = {
+	[0 ... MAX_CORES-1] = {0, 0, SPINLOCK_IRQSAVE_INIT, 0, 0, 0}};
+
+void tlb_flush_range(size_t start, size_t end)
+{
+	tlb_shootdown_t* sd;
+	uint8_t flags = irq_nested_disable();
+
+	sd = tlb_shootdowns + CORE_ID;
+
+	if (end - start > TLB_FLUSH_THRESHOLD * PAGE_SIZE) {
+		size_t cr4 = read_cr4();
+
+		// a reload of cr3 keeps the global pages => toggle CR4.PGE
+		if (cr4 & CR4_PGE) {
+			write_cr4(cr4 & ~CR4_PGE);
+			write_cr4(cr4);
+		} else write_cr3(read_cr3());
+		sd->flushes++;
+	} else {
+		size_t addr;
+
+		for(addr=PAGE_FLOOR(start); addr<end; addr+=PAGE_SIZE) {
+			asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+			sd->pages++;
+		}
+	}
+
+	irq_nested_enable(flags);
+}
+
+void print_tlb_stats(void)
+{
+	uint64_t ipis = 0, pages = 0, flushes = 0;
+	uint32_t i;
+
+	for(i=0; i<MAX_CORES; i++) {
+		ipis += tlb_shootdowns[i].ipis;
+		pages += tlb_shootdowns[i].pages;
+		flushes += tlb_shootdowns[i].flushes;
+	}
+
+	LOG_INFO("TLB shootdown: %llu IPIs, %llu pages invalidated, %llu full flushes\n",
+		ipis, pages, flushes);
+}
+
 extern int smp_main(void);
 extern void gdt_flush(void);
 extern int set_idle_task(void);
@@ -946,63 +1076,133 @@ int smp_start(void)
 	return smp_main();
 }
 
-int ipi_tlb_flush(void)
+/** @brief Send a TLB shootdown IPI to a single core */
+static void ipi_tlb_send(uint32_t dest)
+{
+	LOG_DEBUG("Send IPI to %d\n", dest);
+
+	if (has_x2apic()) {
+		/*
+		 * Make previous memory operations globally visible before
+		 * sending the IPI through x2apic wrmsr. => serializing
+		 */
+		mb();
+		wrmsr(0x830, ((uint64_t) dest << 32)|APIC_INT_ASSERT|APIC_DM_FIXED|112);
+	} else {
+		uint32_t j = 0;
+
+		set_ipi_dest(dest);
+		lapic_write(APIC_ICR1, APIC_INT_ASSERT|APIC_DM_FIXED|112);
+
+		while((lapic_read(APIC_ICR1) & APIC_ICR_BUSY) && (j < 1000))
+			j++; // wait for it to finish, give up eventualy tho
+	}
+}
+
+int ipi_tlb_flush_range(size_t start, size_t end)
 {
 	uint32_t id = CORE_ID;
+	uint32_t i, ntargets = 0;
+	uint64_t targets[MAX_APIC_CORES / 64 + 1] = {[0 ... MAX_APIC_CORES / 64] = 0};
+	uint8_t flags;
 
 	if (atomic_int32_read(&cpu_online) <= 1)
 		return 0;
 
-	if (has_x2apic()) {
-		uint8_t flags = irq_nested_disable();
-		for(uint64_t i=0; i<MAX_APIC_CORES; i++)
-		{
-			if (i == id)
-				continue;
-			if (!online[i])
-				continue;
+	if (!has_x2apic() && (lapic_read(APIC_ICR1) & APIC_ICR_BUSY)) {
+		LOG_ERROR("Previous send not complete");
+		return -EIO;
+	}
 
-			LOG_DEBUG("Send IPI to %zd\n", i);
-			/*
-			 * Make previous memory operations globally visible before
-			 * sending the IPI through x2apic wrmsr. => serializing
-			 */
-			mb();
-			wrmsr(0x830, (i << 32)|APIC_INT_ASSERT|APIC_DM_FIXED|112);
-		}
-		irq_nested_enable(flags);
-	} else {
-		if (lapic_read(APIC_ICR1) & APIC_ICR_BUSY) {
-			LOG_ERROR("Previous send not complete");
-			return -EIO;
-		}
+	flags = irq_nested_disable();
 
-		uint8_t flags = irq_nested_disable();
-		for(uint64_t i=0; i<MAX_APIC_CORES; i++)
-		{
-			if (i == id)
-				continue;
-			if (!online[i])
-				continue;
+	/*
+	 * Merge the range into the pending shootdown of each core. If a core
+	 * has already a pending shootdown, its IPI is still on the way and the
+	 * core will flush the merged range.
+	 */
+	for(i=0; i<MAX_APIC_CORES; i++)
+	{
+		tlb_shootdown_t* sd = tlb_shootdowns + i;
+
+		if (i == id)
+			continue;
+		if (!online[i])
+			continue;
+
+		spinlock_irqsave_lock(&sd->lock);
+		if (sd->end) {
+			if (start < sd->start)
+				sd->start = start;
+			if (end > sd->end)
+				sd->end = end;
+		} else {
+			sd->start = start;
+			sd->end = end;
+			targets[i / 64] |= 1ULL << (i % 64);
+			ntargets++;
+		}
+		spinlock_irqsave_unlock(&sd->lock);
+	}
 
-			LOG_DEBUG("Send IPI to %zd\n", i);
-			set_ipi_dest(i);
-			lapic_write(APIC_ICR1, APIC_INT_ASSERT|APIC_DM_FIXED|112);
+	/*
+	 * If all cores of the system are our targets, a single IPI with the
+	 * shorthand "all excluding self" is sufficient. As a multi-kernel shares
+	 * the machine with other operating systems, this is only valid for a
+	 * single kernel.
+	 */
+	if (ntargets && is_single_kernel()
+	    && (ntargets == atomic_int32_read(&cpu_online) - 1)
+	    && (atomic_int32_read(&cpu_online) == possible_cpus)) {
+		LOG_DEBUG("Broadcast TLB shootdown\n");
 
+		if (has_x2apic()) {
+			mb();
+			wrmsr(0x830, APIC_DEST_ALLBUT|APIC_INT_ASSERT|APIC_DM_FIXED|112);
+		} else {
 			uint32_t j = 0;
+
+			lapic_write(APIC_ICR1, APIC_DEST_ALLBUT|APIC_INT_ASSERT|APIC_DM_FIXED|112);
 			while((lapic_read(APIC_ICR1) & APIC_ICR_BUSY) && (j < 1000))
-				j++; // wait for it to finish, give up eventualy tho
+				j++;
+		}
+		tlb_shootdowns[id].ipis++;
+	} else if (ntargets) {
+		for(i=0; i<MAX_APIC_CORES; i++)
+		{
+			if (!(targets[i / 64] & (1ULL << (i % 64))))
+				continue;
+
+			ipi_tlb_send(i);
+			tlb_shootdowns[id].ipis++;
 		}
-		irq_nested_enable(flags);
 	}
 
+	irq_nested_enable(flags);
+
 	return 0;
 }
 
+int ipi_tlb_flush(void)
+{
+	return ipi_tlb_flush_range(0, (size_t) -1);
+}
+
 static void apic_tlb_handler(struct state *s)
 {
-	LOG_DEBUG("Receive IPI at core %d to flush the TLB\n", CORE_ID);
-	write_cr3(read_cr3());
+	tlb_shootdown_t* sd = tlb_shootdowns + CORE_ID;
+	size_t start, end;
+
+	spinlock_irqsave_lock(&sd->lock);
+	start = sd->start;
+	end = sd->end;
+	sd->end = 0;
+	spinlock_irqsave_unlock(&sd->lock);
+
+	LOG_DEBUG("Receive IPI at core %d to flush the TLB (0x%zx - 0x%zx)\n", CORE_ID, start, end);
+
+	if (end)
+		tlb_flush_range(start, end);
 }
 #endif
 
@@ -1088,6 +1288,11 @@ void shutdown_system(void)
 
 	if (if_bootprocessor) {
 		print_irq_stats();
+		print_kmalloc_stats();
+		print_tlb_stats();
+		print_sched_stats();
+		print_idle_stats();
+		print_lock_stats();
 		LOG_INFO("System goes down...\n");
 	}
 
@@ -75,6 +75,13 @@ align 4
     global hcip
     global hcgateway
     global hcmask
+    global hugepages
+    global populate_heap
+    global zeropool
+    global lazystack
+    global idle_mode
+    global timeslice
+    global uhyve_ring_addr
     base dq 0
     limit dq 0
     cpu_freq dd 0
@@ -105,6 +112,13 @@ align 4
     hcip db  10,0,5,2
     hcgateway db 10,0,5,1
     hcmask db 255,255,255,0
+    hugepages dd 0
+    populate_heap dd 0
+    zeropool dd 256
+    lazystack dd 0
+    idle_mode dd 0
+    timeslice dd 0
+    uhyve_ring_addr dq 0
 
 ; Bootstrap page tables are used during the initialization.
 align 4096
@@ -28,8 +28,9 @@
 #include <hermit/stddef.h>
 #include <hermit/spinlock.h>
 #include <hermit/stdio.h>
+#include <hermit/string.h>
 #include <hermit/tasks.h>
-#include <hermit/dequeue.h>
+#include <hermit/ring.h>
 #include <hermit/logging.h>
 #include <asm/apic.h>
 #include <asm/irq.h>
@@ -38,9 +39,11 @@
 #define SIGNAL_IRQ (32 + 82)
 #define SIGNAL_BUFFER_SIZE (16)
 
-// Per-core signal queue and buffer
-static dequeue_t signal_queue[MAX_CORES];
-static sig_t signal_buffer[MAX_CORES][SIGNAL_BUFFER_SIZE];
+// Per-core signal queue, filled by all cores and drained by the owning core
+RING_MPSC_TYPES(signal, sig_t, SIGNAL_BUFFER_SIZE)
+RING_MPSC(signal, sig_t, SIGNAL_BUFFER_SIZE)
+
+static ring_mpsc_signal_t signal_queue[MAX_CORES];
 
 static void _signal_irq_handler(struct state* s)
 {
@@ -50,7 +53,7 @@ static void _signal_irq_handler(struct state* s)
 	task_t* dest_task;
 	task_t* curr_task = per_core(current_task);
 
-	while(dequeue_pop(&signal_queue[CORE_ID], &signal) == 0) {
+	while(ring_mpsc_signal_pop(&signal_queue[CORE_ID], &signal) == 0) {
 		LOG_DEBUG("  Deliver signal %d\n", signal.signum);
 
 		if(get_task(signal.dest, &dest_task) == 0) {
@@ -200,7 +203,7 @@ int hermit_kill(tid_t dest, int signum)
 	}
 
 	sig_t signal = {dest, signum};
-	if(dequeue_push(&signal_queue[dest_core], &signal)) {
+	if(ring_mpsc_signal_push(&signal_queue[dest_core], signal)) {
 		LOG_ERROR("  Cannot push signal to task's signal queue, dropping it\n");
 		return -ENOMEM;
 	}
@@ -216,8 +219,7 @@ void signal_init(void)
 {
 	// initialize per-core signal queue
 	for(int i = 0; i < MAX_CORES; i++) {
-		dequeue_init(&signal_queue[i], signal_buffer[i],
-		             SIGNAL_BUFFER_SIZE, sizeof(sig_t));
+		ring_mpsc_signal_init(&signal_queue[i]);
 	}
 
 	irq_install_handler(SIGNAL_IRQ, _signal_irq_handler);
@@ -192,34 +192,230 @@ int create_default_frame(task_t* task, entry_point_t ep, void* arg, uint32_t cor
 	return 0;
 }
 
-#define USE_MWAIT
+/// Idle strategy (HERMIT_IDLE or "-idle=poll|deep"), see IDLE_MODE_*
+extern uint32_t idle_mode;
+
+#define IDLE_MODE_ADAPTIVE	0
+#define IDLE_MODE_POLL		1
+#define IDLE_MODE_DEEP		2
+
+/// Initial length of the adaptive poll window
+#define IDLE_POLL_START_NS	10000ULL
+/// Upper bound of the poll window
+#define IDLE_POLL_MAX_NS	100000ULL
+/// Expected idle periods beyond this bound use the deep MWAIT hint
+#define IDLE_DEEP_NS		500000ULL
+/// Number of buckets of the wakeup latency histogram (log2 of ns)
+#define IDLE_LAT_BUCKETS	24
+
+#define MWAIT_HINT_SHALLOW	0x0
+#define MWAIT_HINT_DEEP		0x2
+
+enum {
+	IDLE_RUNNING = 0,
+	IDLE_POLL,
+	IDLE_MWAIT,
+	IDLE_MWAIT_DEEP,
+	IDLE_HALT,
+	IDLE_STATES
+};
+
+static const char* idle_state_names[IDLE_STATES] = {
+	"running", "poll", "mwait", "mwait (deep)", "halt"
+};
+
+/** @brief Idle governor state of a core
+ *
+ * The first cache line is written by cores, which wake up this core.
+ */
+typedef struct {
+	/// current idle state, read by wakeup_core()
+	volatile uint32_t state __attribute__ ((aligned (CACHE_LINE)));
+	/// time stamp of the first wakeup request while the core is idle
+	volatile uint64_t wake_tsc;
+	/// current length of the poll window in cycles
+	uint64_t poll_window __attribute__ ((aligned (CACHE_LINE)));
+	/// moving average of the sleep periods in cycles
+	uint64_t predicted;
+	/// cycles spent in each state
+	uint64_t residency[IDLE_STATES];
+	/// number of times each state was entered
+	uint64_t entries[IDLE_STATES];
+	/// number of idle periods, which ended during polling
+	uint64_t poll_hits;
+	/// latency between wakeup request and leaving the idle loop
+	uint64_t latency[IDLE_LAT_BUCKETS];
+} idle_core_t;
+
+static idle_core_t idle_cores[MAX_CORES];
+static uint64_t idle_poll_start = 0;
+static uint64_t idle_poll_max = 0;
+static uint64_t idle_deep = 0;
+
+static inline uint64_t idle_ns_to_cycles(uint64_t ns)
+{
+	return (ns * (uint64_t) get_cpu_frequency()) / 1000ULL;
+}
+
+void idle_init(void)
+{
+	uint32_t i;
+
+	if (cmdline && strstr((char*) (size_t) cmdline, "-idle=poll"))
+		idle_mode = IDLE_MODE_POLL;
+	else if (cmdline && strstr((char*) (size_t) cmdline, "-idle=deep"))
+		idle_mode = IDLE_MODE_DEEP;
+
+	idle_poll_start = idle_ns_to_cycles(IDLE_POLL_START_NS);
+	idle_poll_max = idle_ns_to_cycles(IDLE_POLL_MAX_NS);
+	idle_deep = idle_ns_to_cycles(IDLE_DEEP_NS);
 
+	for(i=0; i<MAX_CORES; i++)
+		idle_cores[i].poll_window = idle_poll_start;
+
+	if (idle_mode == IDLE_MODE_POLL)
+		LOG_INFO("Idle cores poll their ready queues\n");
+	else if (idle_mode == IDLE_MODE_DEEP)
+		LOG_INFO("Idle cores sleep without polling\n");
+	else
+		LOG_INFO("Idle cores poll up to %llu ns before they sleep\n", IDLE_POLL_MAX_NS);
+}
+
+static inline int idle_has_work(readyqueues_t* readyqueue)
+{
+	return (*((volatile uint32_t*) &readyqueue->nr_tasks)
+		|| readyqueue->balance_kick || go_down);
+}
+
+static inline void idle_exit(idle_core_t* idle, uint64_t now)
+{
+	uint64_t wake_tsc;
+
+	idle->state = IDLE_RUNNING;
+	wake_tsc = idle->wake_tsc;
+
+	if (wake_tsc) {
+		const uint64_t ns = (now > wake_tsc) ?
+			((now - wake_tsc) * 1000ULL) / (uint64_t) get_cpu_frequency() : 0;
+		size_t bucket = ns ? msb(ns) : 0;
+
+		if (bucket >= IDLE_LAT_BUCKETS)
+			bucket = IDLE_LAT_BUCKETS - 1;
+		idle->latency[bucket]++;
+		idle->wake_tsc = 0;
+	}
+}
+
+/*
+ * The idle governor polls the ready queue for a learned window before
+ * the core sleeps. Like Linux' haltpoll governor, the window grows if the
+ * core would have found work by polling a little bit longer and shrinks
+ * after long idle periods. The expected length of the sleep period
+ * selects a shallow or deep MWAIT hint.
+ */
 void wait_for_task(void)
 {
-#ifndef USE_MWAIT
-	HALT;
-#else
-	if (!has_mwait()) {
-		HALT;
-	} else {
-		void* queue = get_readyqueue();
+	idle_core_t* idle = idle_cores + CORE_ID;
+	readyqueues_t* readyqueue = (readyqueues_t*) get_readyqueue();
+	uint64_t start, now, end, window;
+	uint32_t state;
+
+	start = get_rdtsc();
+	idle->wake_tsc = 0;
+	idle->state = IDLE_POLL;
+	// pairs with the barrier in wakeup_core
+	mb();
+
+	if (idle_mode == IDLE_MODE_POLL)
+		window = idle_poll_max;
+	else if (idle_mode == IDLE_MODE_DEEP)
+		window = 0;
+	else
+		window = idle->poll_window;
+
+	now = start;
+	while (!idle_has_work(readyqueue) && (now - start < window)) {
+		PAUSE;
+		now = get_rdtsc();
+	}
+
+	now = get_rdtsc();
+	idle->residency[IDLE_POLL] += now - start;
+	idle->entries[IDLE_POLL]++;
+
+	if (idle_has_work(readyqueue)) {
+		idle->poll_hits++;
+		idle_exit(idle, now);
+		return;
+	}
+
+	// with polling only, return to the idle loop to do some housekeeping
+	if (idle_mode == IDLE_MODE_POLL) {
+		idle_exit(idle, now);
+		return;
+	}
+
+	if (has_mwait()) {
+		state = ((idle_mode == IDLE_MODE_DEEP) || (idle->predicted >= idle_deep)) ? IDLE_MWAIT_DEEP : IDLE_MWAIT;
+		idle->state = state;
 
 		if (has_clflush())
-			clflush(queue);
+			clflush(readyqueue);
 
-		monitor(queue, 0, 0);
-		mwait(0x2 /* 0x2 = c3, 0xF = c0 */, 1 /* break on interrupt flag */);
+		// a task, which is pushed to the ready queue, writes the monitored cache line
+		monitor(readyqueue, 0, 0);
+		if (!idle_has_work(readyqueue))
+			mwait(state == IDLE_MWAIT_DEEP ? MWAIT_HINT_DEEP : MWAIT_HINT_SHALLOW, 1 /* break on interrupt flag */);
+	} else {
+		state = IDLE_HALT;
+
+		// the wakeup IPI stays pending until hlt is reached
+		irq_disable();
+		idle->state = state;
+		mb();
+		if (!idle_has_work(readyqueue))
+			asm volatile ("sti; hlt" ::: "memory");
+		else
+			irq_enable();
 	}
-#endif
+
+	end = get_rdtsc();
+	idle->residency[state] += end - now;
+	idle->entries[state]++;
+
+	if (idle_mode == IDLE_MODE_ADAPTIVE) {
+		const uint64_t total = end - start;
+
+		if (total > idle_poll_max) {
+			// long idle period => polling was wasted
+			idle->poll_window /= 2;
+		} else if (window < total) {
+			// a longer window would have caught the wakeup
+			window = window ? 2 * window : idle_poll_start;
+			idle->poll_window = (window < idle_poll_max) ? window : idle_poll_max;
+		}
+
+		idle->predicted = (7 * idle->predicted + (end - now)) / 8;
+	}
+
+	idle_exit(idle, end);
 }
 
 void wakeup_core(uint32_t core_id)
 {
-#ifdef USE_MWAIT
-	// if mwait is available, an IPI isn't required to wakeup the core
-	if (has_mwait())
+	idle_core_t* idle = idle_cores + core_id;
+	uint32_t state;
+
+	// pairs with the barrier in wait_for_task
+	mb();
+	state = idle->state;
+
+	if ((state != IDLE_RUNNING) && !idle->wake_tsc)
+		idle->wake_tsc = get_rdtsc();
+
+	// polling cores see the new task and mwait is broken by writing the ready queue
+	if (state != IDLE_HALT)
 		return;
-#endif
 
 	// no self IPI required
 	if (core_id == CORE_ID)
@@ -228,3 +424,44 @@ void wakeup_core(uint32_t core_id)
 	LOG_DEBUG("wakeup core %d\n", core_id);
 	apic_send_ipi(core_id, 121);
 }
+
+void notify_core(uint32_t core_id)
+{
+	// no self IPI required
+	if (core_id == CORE_ID)
+		return;
+
+	apic_send_ipi(core_id, 121);
+}
+
+void print_idle_stats(void)
+{
+	uint64_t total;
+	uint32_t i, j;
+
+	for(i=0; i<MAX_CORES; i++) {
+		idle_core_t* idle = idle_cores + i;
+
+		if (!idle->entries[IDLE_POLL])
+			continue;
+
+		for(j=IDLE_POLL, total=0; j<IDLE_STATES; j++)
+			total += idle->residency[j];
+
+		LOG_INFO("Core %u: %llu idle periods, %llu ended while polling, poll window %llu cycles\n",
+			i, idle->entries[IDLE_POLL], idle->poll_hits, idle->poll_window);
+		for(j=IDLE_POLL; j<IDLE_STATES; j++) {
+			if (!idle->entries[j])
+				continue;
+			LOG_INFO("Core %u: %s entered %llu times, %llu%% of the idle time\n",
+				i, idle_state_names[j], idle->entries[j],
+				total ? (100ULL * idle->residency[j]) / total : 0);
+		}
+		for(j=0; j<IDLE_LAT_BUCKETS; j++) {
+			if (!idle->latency[j])
+				continue;
+			LOG_INFO("Core %u: wakeup latency < %llu ns: %llu\n",
+				i, 1ULL << (j+1), idle->latency[j]);
+		}
+	}
+}
@@ -45,9 +45,14 @@ DEFINE_PER_CORE(uint64_t, timer_ticks, 0);
 extern uint32_t cpu_freq;
 extern int32_t boot_processor;
 
+/// TSC value at boot time, the reference of the nanosecond clock
+uint64_t boot_tsc = 0;
+
+/// Sleeps below this limit (in ns) are shorter than a context switch => busy waiting
+#define NANOSLEEP_SPIN_NS	2000
+
 #ifdef DYNAMIC_TICKS
 DEFINE_PER_CORE(uint64_t, last_rdtsc, 0);
-uint64_t boot_tsc = 0;
 
 void check_ticks(void)
 {
@@ -130,6 +135,65 @@ int timer_wait(unsigned int ticks)
 	return 0;
 }
 
+uint64_t ns_to_cycles(uint64_t ns)
+{
+	const uint64_t mhz = (uint64_t) get_cpu_frequency();
+
+	// avoid an overflow for sleeps longer than a few weeks
+	if (ns > ~0ULL / mhz)
+		return (ns / 1000ULL) * mhz;
+
+	return (ns * mhz) / 1000ULL;
+}
+
+uint64_t get_clock_ns(void)
+{
+	const uint64_t mhz = (uint64_t) get_cpu_frequency();
+	const uint64_t cycles = get_rdtsc() - boot_tsc;
+
+	return (cycles / mhz) * 1000ULL + ((cycles % mhz) * 1000ULL) / mhz;
+}
+
+int timer_nanosleep_until(uint64_t tsc)
+{
+	task_t* curr_task = per_core(current_task);
+	const uint64_t cycles = ns_to_cycles(NANOSLEEP_SPIN_NS);
+
+	// the idle task isn't allowed to block
+	if ((curr_task->status == TASK_IDLE) || (tsc - get_rdtsc() < cycles)) {
+		while (get_rdtsc() < tsc)
+			PAUSE;
+
+		return 0;
+	}
+
+	while (get_rdtsc() < tsc) {
+		check_workqueues();
+
+		if (get_rdtsc() >= tsc)
+			break;
+
+		if (tsc - get_rdtsc() < cycles) {
+			while (get_rdtsc() < tsc)
+				PAUSE;
+			break;
+		}
+
+		set_hrtimer(tsc);
+		reschedule();
+	}
+
+	return 0;
+}
+
+int timer_nanosleep(uint64_t ns)
+{
+	if (!ns)
+		return 0;
+
+	return timer_nanosleep_until(get_rdtsc() + ns_to_cycles(ns));
+}
+
 #define LATCH(f)	((CLOCK_TICK_RATE + f/2) / f)
 #define WAIT_SOME_TIME() do { uint64_t start = rdtsc(); mb(); \
 			      while(rdtsc() - start < 1000000) ; \
@@ -187,6 +251,9 @@ int timer_init(void)
 #ifdef DYNAMIC_TICKS
 	boot_tsc = has_rdtscp() ? rdtscp(NULL) : rdtsc();
 	set_per_core(last_rdtsc, boot_tsc);
+#else
+	if (!boot_tsc)
+		boot_tsc = get_rdtsc();
 #endif
 
 	if (cpu_freq) // do we need to configure the timer?
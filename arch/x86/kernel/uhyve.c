@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @author Stefan Lankes
+ * @file arch/x86/kernel/uhyve.c
+ * @brief Request ring, which is shared with uhyve
+ *
+ * Instead of one VM exit per operation, the I/O requests of all tasks
+ * are queued in a ring in guest memory. The worker threads of uhyve
+ * execute them in parallel and signal the completions by UHYVE_RING_IRQ.
+ * A VM exit is only required to wake up a sleeping worker.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/vma.h>
+#include <hermit/logging.h>
+#include <asm/page.h>
+#include <asm/irq.h>
+#include <asm/irqflags.h>
+#include <asm/processor.h>
+#include <asm/uhyve.h>
+
+/// The waiting task polls this time for its completion before it blocks
+#define UHYVE_RING_SPIN_NS	5000
+
+/** Physical address of the ring, which uhyve reattaches after a restore */
+extern uint64_t uhyve_ring_addr;
+
+/** @brief Request of a task, which waits for its completion */
+typedef struct uhyve_req {
+	/// waiting task
+	tid_t waiter;
+	/// set by the completion
+	volatile uint32_t done;
+} uhyve_req_t;
+
+static uhyve_ring_t* ring = NULL;
+/// protects the submission queue
+static spinlock_irqsave_t sq_lock = SPINLOCK_IRQSAVE_INIT;
+/// protects the completion queue
+static spinlock_irqsave_t cq_lock = SPINLOCK_IRQSAVE_INIT;
+
+/** @brief Consume all completions and wake up the waiting tasks
+ *
+ * Has to be called with cq_lock.
+ */
+static void uhyve_ring_reap(void)
+{
+	uint32_t head = ring->cq_head;
+
+	while (head != ring->cq_tail) {
+		uhyve_req_t* req = (uhyve_req_t*) (size_t) ring->cq[head & UHYVE_RING_MASK].user_data;
+		// the request lives on the stack of the waiter => read it before the wakeup
+		tid_t waiter = req->waiter;
+
+		head++;
+		req->done = 1;
+		wakeup_task(waiter);
+	}
+
+	ring->cq_head = head;
+}
+
+static void uhyve_ring_handler(struct state* s)
+{
+	spinlock_irqsave_lock(&cq_lock);
+	uhyve_ring_reap();
+	spinlock_irqsave_unlock(&cq_lock);
+}
+
+int uhyve_ring_init(void)
+{
+	if (!is_uhyve())
+		return -EINVAL;
+
+	ring = (uhyve_ring_t*) page_alloc(sizeof(uhyve_ring_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!ring, 0)) {
+		LOG_ERROR("Unable to allocate the request ring of uhyve\n");
+		return -ENOMEM;
+	}
+	memset(ring, 0x00, sizeof(uhyve_ring_t));
+
+	irq_install_handler(32+UHYVE_RING_IRQ, uhyve_ring_handler);
+
+	uhyve_ring_addr = virt_to_phys((size_t) ring);
+	uhyve_send(UHYVE_PORT_RINGINIT, (unsigned) uhyve_ring_addr);
+
+	LOG_INFO("Request ring of uhyve at 0x%zx with %u entries uses irq %d\n",
+		(size_t) uhyve_ring_addr, UHYVE_RING_SIZE, UHYVE_RING_IRQ);
+
+	return 0;
+}
+
+void uhyve_submit(unsigned short port, void* args)
+{
+	task_t* curr_task = per_core(current_task);
+	uhyve_req_t req = {curr_task->id, 0};
+	uhyve_sqe_t* sqe;
+	uint64_t start, spin;
+	uint32_t tail, doorbell;
+
+	// the idle task isn't able to block
+	if (!ring || !is_irq_enabled() || (curr_task->status == TASK_IDLE))
+		goto sync;
+
+	spinlock_irqsave_lock(&sq_lock);
+
+	// each request needs also an entry in the completion queue
+	tail = ring->sq_tail;
+	if (BUILTIN_EXPECT(tail - ring->cq_head >= UHYVE_RING_SIZE, 0)) {
+		spinlock_irqsave_unlock(&sq_lock);
+		goto sync;
+	}
+
+	sqe = &ring->sq[tail & UHYVE_RING_MASK];
+	sqe->port = port;
+	sqe->args = (uint32_t) virt_to_phys((size_t) args);
+	sqe->user_data = (uint64_t) (size_t) &req;
+	cmb();
+	ring->sq_tail = tail + 1;
+
+	// pairs with the barrier of a worker, which is going to sleep
+	mb();
+	doorbell = ring->host_idle;
+
+	spinlock_irqsave_unlock(&sq_lock);
+
+	if (doorbell)
+		uhyve_send(UHYVE_PORT_DOORBELL, 0);
+
+	// a short operation completes faster than a task switch
+	spin = ((uint64_t) UHYVE_RING_SPIN_NS * (uint64_t) get_cpu_frequency()) / 1000ULL;
+	start = get_rdtsc();
+	while (!req.done && (get_rdtsc() - start < spin)) {
+		if (ring->cq_head != ring->cq_tail) {
+			spinlock_irqsave_lock(&cq_lock);
+			uhyve_ring_reap();
+			spinlock_irqsave_unlock(&cq_lock);
+		} else {
+			PAUSE;
+		}
+	}
+
+	// block until the completion wakes up the task
+	spinlock_irqsave_lock(&cq_lock);
+	uhyve_ring_reap();
+	while (!req.done) {
+		block_current_task();
+		spinlock_irqsave_unlock(&cq_lock);
+		reschedule();
+		spinlock_irqsave_lock(&cq_lock);
+	}
+	spinlock_irqsave_unlock(&cq_lock);
+
+	return;
+
+sync:
+	uhyve_send(port, (unsigned) virt_to_phys((size_t) args));
+}
+
+size_t uhyve_add_segments(uhyve_seg_t* segs, uint32_t* cnt, const void* buf, size_t len)
+{
+	size_t addr = (size_t) buf;
+	size_t done = 0;
+	uint32_t n = *cnt;
+
+	while (done < len) {
+		size_t chunk = PAGE_SIZE - (addr & (PAGE_SIZE-1));
+		size_t phys;
+
+		if (chunk > len - done)
+			chunk = len - done;
+
+		// populate the page
+		(void) *((volatile char*) addr);
+		phys = virt_to_phys(addr);
+
+		if (n && (segs[n-1].addr + segs[n-1].len == phys)) {
+			segs[n-1].len += chunk;
+		} else {
+			if (n >= UHYVE_IOV_MAX)
+				break;
+			segs[n].addr = phys;
+			segs[n].len = chunk;
+			n++;
+		}
+
+		addr += chunk;
+		done += chunk;
+	}
+
+	*cnt = n;
+
+	return done;
+}
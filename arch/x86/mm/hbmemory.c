@@ -31,24 +31,17 @@
 #include <hermit/string.h>
 #include <hermit/spinlock.h>
 #include <hermit/memory.h>
+#include <hermit/page_zone.h>
 #include <hermit/logging.h>
 
 #include <asm/atomic.h>
 #include <asm/page.h>
 
-typedef struct free_list {
-	size_t start, end;
-	struct free_list* next;
-	struct free_list* prev;
-} free_list_t;
-
 extern size_t hbmem_base;
 extern size_t hbmem_size;
 
-static spinlock_t list_lock = SPINLOCK_INIT;
-
-static free_list_t init_list = {0, 0, NULL, NULL};
-static free_list_t* free_start = &init_list;
+/// Zone, which manages the high bandwidth memory
+static page_zone_t hbmem_zone;
 
 extern atomic_int64_t total_pages;
 extern atomic_int64_t total_allocated_pages;
@@ -56,39 +49,16 @@ extern atomic_int64_t total_available_pages;
 
 size_t hbmem_get_pages(size_t npages)
 {
-	size_t i, ret = 0;
-	free_list_t* curr = free_start;
+	size_t ret;
 
 	if (BUILTIN_EXPECT(!npages, 0))
 		return 0;
 	if (BUILTIN_EXPECT(npages > atomic_int64_read(&total_available_pages), 0))
 		return 0;
 
-	spinlock_lock(&list_lock);
-
-	while(curr) {
-		i = (curr->end - curr->start) / PAGE_SIZE;
-		if (i > npages) {
-			ret = curr->start;
-			curr->start += npages * PAGE_SIZE;
-			goto out;
-		} else if (i == npages) {
-			ret = curr->start;
-			if (curr->prev)
-				curr->prev = curr->next;
-			else
-				free_start = curr->next;
-			if (curr != &init_list)
-				kfree(curr);
-			goto out;
-		}
-
-		curr = curr->next;
-	}
-out:
-	LOG_DEBUG("get_pages: ret 0%llx, curr->start 0x%llx, curr->end 0x%llx\n", ret, curr->start, curr->end);
+	ret = page_zone_alloc(&hbmem_zone, npages);
 
-	spinlock_unlock(&list_lock);
+	LOG_DEBUG("hbmem_get_pages: ret 0x%zx, npages %zd\n", ret, npages);
 
 	if (ret) {
 		atomic_int64_add(&total_allocated_pages, npages);
@@ -98,53 +68,23 @@ out:
 	return ret;
 }
 
-/* TODO: reunion of elements is still missing */
 int hbmem_put_pages(size_t phyaddr, size_t npages)
 {
-	free_list_t* curr = free_start;
+	int ret;
 
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return -EINVAL;
 	if (BUILTIN_EXPECT(!npages, 0))
 		return -EINVAL;
 
-	spinlock_lock(&list_lock);
-
-	while(curr) {
-		if (phyaddr+npages*PAGE_SIZE == curr->start) {
-			curr->start = phyaddr;
-			goto out;
-		} else if (phyaddr == curr->end) {
-			curr->end += npages*PAGE_SIZE;
-			goto out;
-		} if (phyaddr > curr->end) {
-			free_list_t* n = kmalloc(sizeof(free_list_t));
-
-			if (BUILTIN_EXPECT(!n, 0))
-				goto out_err;
-
-			/* add new element */
-			n->start = phyaddr;
-			n->end = phyaddr + npages * PAGE_SIZE;
-			n->prev = curr;
-			n->next = curr->next;
-			curr->next = n;
-		}
-
-		curr = curr->next;
-	}
-out:
-	spinlock_unlock(&list_lock);
+	ret = page_zone_free(&hbmem_zone, phyaddr, npages);
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
 
 	atomic_int64_sub(&total_allocated_pages, npages);
 	atomic_int64_add(&total_available_pages, npages);
 
 	return 0;
-
-out_err:
-	spinlock_unlock(&list_lock);
-
-	return -ENOMEM;
 }
 
 int is_hbmem_available(void)
@@ -154,18 +94,25 @@ int is_hbmem_available(void)
 
 int hbmemory_init(void)
 {
+	void* meta;
+
 	if (!hbmem_base)
 		return 0;
 
+	meta = palloc(page_zone_meta_size(hbmem_base, hbmem_base + hbmem_size), VMA_HEAP);
+	if (BUILTIN_EXPECT(!meta, 0)) {
+		LOG_ERROR("Unable to allocate the descriptors of the hbmem zone\n");
+		return -ENOMEM;
+	}
+
+	page_zone_init(&hbmem_zone, hbmem_base, hbmem_base + hbmem_size, meta);
+	page_zone_free(&hbmem_zone, hbmem_base, hbmem_size >> PAGE_BITS);
+
 	// determine available memory
 	atomic_int64_add(&total_pages, hbmem_size >> PAGE_BITS);
 	atomic_int64_add(&total_available_pages, hbmem_size >> PAGE_BITS);
 
-	//initialize free list
-	init_list.start = hbmem_base;
-	init_list.end = hbmem_base + hbmem_size;
-
-	LOG_INFO("free list for hbmem starts at 0x%zx, limit 0x%zx\n", init_list.start, init_list.end);
+	LOG_INFO("zone for hbmem starts at 0x%zx, limit 0x%zx\n", hbmem_base, hbmem_base + hbmem_size);
 
 	return 0;
 }
@@ -31,6 +31,7 @@
 #include <hermit/string.h>
 #include <hermit/spinlock.h>
 #include <hermit/memory.h>
+#include <hermit/page_zone.h>
 #include <hermit/logging.h>
 
 #include <asm/atomic.h>
@@ -42,11 +43,23 @@
 extern uint64_t base;
 extern uint64_t limit;
 
-typedef struct free_list {
-	size_t start, end;
-	struct free_list* next;
-	struct free_list* prev;
-} free_list_t;
+/// Maximal number of frames in the per-core cache
+#define PAGE_CACHE_SIZE		64
+/// Number of frames, which are moved between the cache and the zone
+#define PAGE_CACHE_BATCH	32
+
+/** @brief Per-core cache of single page frames
+ *
+ * Most requests (e.g. page faults of the heap) ask for a single frame. To
+ * avoid the zone lock, each core keeps a small stack of free frames and
+ * refills or drains it in batches.
+ */
+typedef struct page_cache {
+	/// Number of cached frames
+	size_t count;
+	/// Physical addresses of the cached frames
+	size_t frames[PAGE_CACHE_SIZE];
+} __attribute__ ((aligned (CACHE_LINE))) page_cache_t;
 
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
@@ -54,50 +67,82 @@ typedef struct free_list {
  */
 extern const void kernel_start;
 
-static spinlock_t list_lock = SPINLOCK_INIT;
+/// Zone, which manages the physical memory
+static page_zone_t zone;
+static page_cache_t page_caches[MAX_CORES];
 
-static free_list_t init_list = {0, 0, NULL, NULL};
-static free_list_t* free_start = &init_list;
+/*
+ * Until the zone is initialized, we hand out pages from the region behind
+ * the kernel by moving its start address.
+ */
+static spinlock_irqsave_t early_lock = SPINLOCK_IRQSAVE_INIT;
+static size_t early_start = 0;
+static size_t early_end = 0;
+static uint8_t zone_ready = 0;
 
 atomic_int64_t total_pages = ATOMIC_INIT(0);
 atomic_int64_t total_allocated_pages = ATOMIC_INIT(0);
 atomic_int64_t total_available_pages = ATOMIC_INIT(0);
 
+static size_t early_get_pages(size_t npages)
+{
+	size_t ret = 0;
+
+	spinlock_irqsave_lock(&early_lock);
+
+	if (early_end - early_start >= npages * PAGE_SIZE) {
+		ret = early_start;
+		early_start += npages * PAGE_SIZE;
+	}
+
+	spinlock_irqsave_unlock(&early_lock);
+
+	return ret;
+}
+
+static int early_put_pages(size_t phyaddr, size_t npages)
+{
+	int ret = 0;
+
+	spinlock_irqsave_lock(&early_lock);
+
+	// we are only able to undo the last allocation
+	if (phyaddr + npages * PAGE_SIZE == early_start)
+		early_start = phyaddr;
+	else
+		ret = -EINVAL;
+
+	spinlock_irqsave_unlock(&early_lock);
+
+	return ret;
+}
+
 size_t get_pages(size_t npages)
 {
-	size_t i, ret = 0;
-	free_list_t* curr = free_start;
+	size_t ret = 0;
 
 	if (BUILTIN_EXPECT(!npages, 0))
 		return 0;
 	if (BUILTIN_EXPECT(npages > atomic_int64_read(&total_available_pages), 0))
 		return 0;
 
-	spinlock_lock(&list_lock);
-
-	while(curr) {
-		i = (curr->end - curr->start) / PAGE_SIZE;
-		if (i > npages) {
-			ret = curr->start;
-			curr->start += npages * PAGE_SIZE;
-			goto out;
-		} else if (i == npages) {
-			ret = curr->start;
-			if (curr->prev)
-				curr->prev = curr->next;
-			else
-				free_start = curr->next;
-			if (curr != &init_list)
-				kfree(curr);
-			goto out;
-		}
+	if (BUILTIN_EXPECT(!zone_ready, 0)) {
+		ret = early_get_pages(npages);
+	} else if (npages == 1) {
+		uint8_t flags = irq_nested_disable();
+		page_cache_t* cache = page_caches + CORE_ID;
+
+		if (!cache->count)
+			cache->count = page_zone_alloc_frames(&zone, cache->frames, PAGE_CACHE_BATCH);
+		if (cache->count)
+			ret = cache->frames[--cache->count];
 
-		curr = curr->next;
+		irq_nested_enable(flags);
+	} else {
+		ret = page_zone_alloc(&zone, npages);
 	}
-out:
-	LOG_DEBUG("get_pages: ret 0%llx, curr->start 0x%llx, curr->end 0x%llx\n", ret, curr->start, curr->end);
 
-	spinlock_unlock(&list_lock);
+	LOG_DEBUG("get_pages: ret 0x%zx, npages %zd\n", ret, npages);
 
 	if (ret) {
 		atomic_int64_add(&total_allocated_pages, npages);
@@ -109,23 +154,45 @@ out:
 
 DEFINE_PER_CORE(size_t, ztmp_addr, 0);
 
-size_t get_zeroed_page(void)
+/// Maximal number of frames in the pool of zeroed frames
+#define ZERO_POOL_MAX		16384
+/// Number of frames, which the idle loop zeroes in one step
+#define ZERO_POOL_BATCH		16
+
+/// Target size of the pool of zeroed frames (HERMIT_ZEROPOOL or "-zeropool=")
+extern uint32_t zeropool;
+
+/*
+ * Frames, which are already zeroed by the idle loop. Consequently,
+ * get_zeroed_page() doesn't have to clear the page on the hot path.
+ */
+static spinlock_irqsave_t zero_pool_lock = SPINLOCK_IRQSAVE_INIT;
+static size_t zero_pool[ZERO_POOL_MAX];
+static size_t zero_pool_depth = 0;
+static size_t zero_pool_hits = 0;
+static size_t zero_pool_misses = 0;
+static size_t zero_pool_refills = 0;
+
+/** @brief Clear a frame by mapping it to the temporary address of the core
+ *
+ * @param phyaddr Physical address of the frame
+ * @param nt if set, non-temporal stores are used and the frame doesn't pollute the cache
+ */
+static int zero_frame(size_t phyaddr, uint8_t nt)
 {
-	size_t phyaddr = get_page();
 	size_t viraddr;
 	uint8_t flags;
 
-	if (BUILTIN_EXPECT(!phyaddr, 0))
-		return 0;
-
 	flags = irq_nested_disable();
 
 	viraddr = per_core(ztmp_addr);
 	if (BUILTIN_EXPECT(!viraddr, 0))
 	{
 		viraddr = vma_alloc(PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
-		if (BUILTIN_EXPECT(!viraddr, 0))
-			goto novaddr;
+		if (BUILTIN_EXPECT(!viraddr, 0)) {
+			irq_nested_enable(flags);
+			return -ENOMEM;
+		}
 
 		LOG_DEBUG("Core %d uses 0x%zx as temporary address\n", CORE_ID, viraddr);
 		set_per_core(ztmp_addr, viraddr);
@@ -133,61 +200,148 @@ size_t get_zeroed_page(void)
 
 	__page_map(viraddr, phyaddr, 1, PG_GLOBAL|PG_RW|PG_PRESENT, 0);
 
-	memset((void*) viraddr, 0x00, PAGE_SIZE);
+	if (nt)
+		memzero_nt((void*) viraddr, PAGE_SIZE);
+	else
+		memset((void*) viraddr, 0x00, PAGE_SIZE);
 
-novaddr:
 	irq_nested_enable(flags);
 
+	return 0;
+}
+
+size_t get_zeroed_page(void)
+{
+	size_t phyaddr = 0;
+
+	spinlock_irqsave_lock(&zero_pool_lock);
+	if (zero_pool_depth) {
+		phyaddr = zero_pool[--zero_pool_depth];
+		zero_pool_hits++;
+	} else zero_pool_misses++;
+	spinlock_irqsave_unlock(&zero_pool_lock);
+
+	if (phyaddr)
+		return phyaddr;
+
+	phyaddr = get_page();
+	if (BUILTIN_EXPECT(!phyaddr, 0))
+		return 0;
+
+	if (BUILTIN_EXPECT(zero_frame(phyaddr, 0), 0)) {
+		put_page(phyaddr);
+		return 0;
+	}
+
 	return phyaddr;
 }
 
-/* TODO: reunion of elements is still missing */
+void zero_pool_refill(void)
+{
+	size_t i, phyaddr;
+	uint8_t full;
+
+	if (BUILTIN_EXPECT(!zone_ready, 0))
+		return;
+
+	for(i=0; i<ZERO_POOL_BATCH; i++)
+	{
+		spinlock_irqsave_lock(&zero_pool_lock);
+		// the pool is shrunk => release surplus frames
+		if (zero_pool_depth > zeropool) {
+			phyaddr = zero_pool[--zero_pool_depth];
+			spinlock_irqsave_unlock(&zero_pool_lock);
+			put_page(phyaddr);
+			continue;
+		}
+		full = (zero_pool_depth >= zeropool);
+		spinlock_irqsave_unlock(&zero_pool_lock);
+
+		if (full)
+			return;
+
+		phyaddr = get_page();
+		if (BUILTIN_EXPECT(!phyaddr, 0))
+			return;
+
+		if (BUILTIN_EXPECT(zero_frame(phyaddr, 1), 0)) {
+			put_page(phyaddr);
+			return;
+		}
+
+		spinlock_irqsave_lock(&zero_pool_lock);
+		if (zero_pool_depth < zeropool) {
+			zero_pool[zero_pool_depth++] = phyaddr;
+			zero_pool_refills++;
+			phyaddr = 0;
+		}
+		spinlock_irqsave_unlock(&zero_pool_lock);
+
+		if (phyaddr)
+			put_page(phyaddr);
+	}
+}
+
+void zero_pool_resize(size_t npages)
+{
+	if (npages > ZERO_POOL_MAX)
+		npages = ZERO_POOL_MAX;
+
+	zeropool = npages;
+}
+
+void zero_pool_stats(size_t* depth, size_t* hits, size_t* misses, size_t* refills)
+{
+	spinlock_irqsave_lock(&zero_pool_lock);
+
+	if (depth)
+		*depth = zero_pool_depth;
+	if (hits)
+		*hits = zero_pool_hits;
+	if (misses)
+		*misses = zero_pool_misses;
+	if (refills)
+		*refills = zero_pool_refills;
+
+	spinlock_irqsave_unlock(&zero_pool_lock);
+}
+
 int put_pages(size_t phyaddr, size_t npages)
 {
-	free_list_t* curr = free_start;
+	int ret;
 
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return -EINVAL;
 	if (BUILTIN_EXPECT(!npages, 0))
 		return -EINVAL;
 
-	spinlock_lock(&list_lock);
-
-	while(curr) {
-		if (phyaddr+npages*PAGE_SIZE == curr->start) {
-			curr->start = phyaddr;
-			goto out;
-		} else if (phyaddr == curr->end) {
-			curr->end += npages*PAGE_SIZE;
-			goto out;
-		} if (phyaddr > curr->end) {
-			free_list_t* n = kmalloc(sizeof(free_list_t));
-
-			if (BUILTIN_EXPECT(!n, 0))
-				goto out_err;
-
-			/* add new element */
-			n->start = phyaddr;
-			n->end = phyaddr + npages * PAGE_SIZE;
-			n->prev = curr;
-			n->next = curr->next;
-			curr->next = n;
+	if (BUILTIN_EXPECT(!zone_ready, 0)) {
+		ret = early_put_pages(phyaddr, npages);
+	} else if ((npages == 1) && page_zone_contains(&zone, phyaddr)) {
+		uint8_t flags = irq_nested_disable();
+		page_cache_t* cache = page_caches + CORE_ID;
+
+		if (cache->count >= PAGE_CACHE_SIZE) {
+			cache->count -= PAGE_CACHE_BATCH;
+			page_zone_free_frames(&zone, cache->frames + cache->count, PAGE_CACHE_BATCH);
 		}
+		cache->frames[cache->count++] = phyaddr;
 
-		curr = curr->next;
+		irq_nested_enable(flags);
+		ret = 0;
+	} else {
+		ret = page_zone_free(&zone, phyaddr, npages);
+	}
+
+	if (BUILTIN_EXPECT(ret, 0)) {
+		LOG_ERROR("put_pages: unable to release 0x%zx (npages %zd)\n", phyaddr, npages);
+		return ret;
 	}
-out:
-	spinlock_unlock(&list_lock);
 
 	atomic_int64_sub(&total_allocated_pages, npages);
 	atomic_int64_add(&total_available_pages, npages);
 
 	return 0;
-
-out_err:
-	spinlock_unlock(&list_lock);
-
-	return -ENOMEM;
 }
 
 void* page_alloc(size_t sz, uint32_t flags)
@@ -246,6 +400,9 @@ void page_free(void* viraddr, size_t sz)
 
 int memory_init(void)
 {
+	size_t zone_start = (size_t) -1;
+	size_t zone_end = 0;
+	void* meta;
 	int ret = 0;
 
 	// enable paging and map Multiboot modules etc.
@@ -273,19 +430,29 @@ int memory_init(void)
 					LOG_INFO("Free region 0x%zx - 0x%zx\n", start_addr, end_addr);
 
 					if ((start_addr <= base) && (end_addr >= PAGE_2M_FLOOR((size_t) &kernel_start + image_size))) {
-						init_list.start = PAGE_2M_CEIL((size_t) &kernel_start + image_size);
-						init_list.end = end_addr;
+						early_start = PAGE_2M_CEIL((size_t) &kernel_start + image_size);
+						early_end = end_addr;
 
-						LOG_INFO("Add region 0x%zx - 0x%zx\n", init_list.start, init_list.end);
+						LOG_INFO("Add region 0x%zx - 0x%zx\n", early_start, early_end);
 					}
 
 					// determine available memory
 					atomic_int64_add(&total_pages, (end_addr-start_addr) >> PAGE_BITS);
 					atomic_int64_add(&total_available_pages, (end_addr-start_addr) >> PAGE_BITS);
+
+					// determine the range, which is managed by the zone
+					if (start_addr < GAP_BELOW)
+						start_addr = GAP_BELOW;
+					if (start_addr < end_addr) {
+						if (start_addr < zone_start)
+							zone_start = start_addr;
+						if (end_addr > zone_end)
+							zone_end = end_addr;
+					}
 				}
 			}
 
-			if (!init_list.end)
+			if (!early_end)
 				goto oom;
 		} else {
 			goto oom;
@@ -295,27 +462,43 @@ int memory_init(void)
 		atomic_int64_add(&total_pages, (limit-base) >> PAGE_BITS);
 		atomic_int64_add(&total_available_pages, (limit-base) >> PAGE_BITS);
 
-		init_list.start = PAGE_2M_CEIL(base + image_size);
-		init_list.end = limit;
+		early_start = PAGE_2M_CEIL(base + image_size);
+		early_end = limit;
+
+		zone_start = early_start;
+		zone_end = early_end;
 	}
 
 	// determine allocated memory, we use 2MB pages to map the kernel
 	atomic_int64_add(&total_allocated_pages, PAGE_2M_CEIL(image_size) >> PAGE_BITS);
 	atomic_int64_sub(&total_available_pages, PAGE_2M_CEIL(image_size) >> PAGE_BITS);
 
-	LOG_INFO("free list starts at 0x%zx, limit 0x%zx\n", init_list.start, init_list.end);
-
-	// init high bandwidth memory subsystem
-	hbmemory_init();
+	LOG_INFO("early allocations start at 0x%zx, limit 0x%zx\n", early_start, early_end);
 
 	ret = vma_init();
 	if (BUILTIN_EXPECT(ret, 0))
 		LOG_WARNING("Failed to initialize VMA regions: %d\n", ret);
 
+	// the descriptors of the zone are the last early allocation
+	meta = palloc(page_zone_meta_size(zone_start, zone_end), VMA_HEAP);
+	if (BUILTIN_EXPECT(!meta, 0))
+		goto oom;
+
+	page_zone_init(&zone, zone_start, zone_end, meta);
+
+	LOG_INFO("zone 0x%zx - 0x%zx uses %zd KiB for its descriptors\n",
+		zone.base, zone_end, page_zone_meta_size(zone_start, zone_end) >> 10);
+
+	// from now on, the zone hands out pages => release the rest of the early region
+	spinlock_irqsave_lock(&early_lock);
+	zone_ready = 1;
+	if (early_start < early_end)
+		page_zone_free(&zone, early_start, (early_end - early_start) >> PAGE_BITS);
+	spinlock_irqsave_unlock(&early_lock);
+
 	// add missing free regions
 	if (mb_info) {
 		if (mb_info->flags & MULTIBOOT_INFO_MEM_MAP) {
-			free_list_t* last = &init_list;
 			size_t end_addr, start_addr;
 			multiboot_memory_map_t* mmap = (multiboot_memory_map_t*) ((size_t) mb_info->mmap_addr);
 			multiboot_memory_map_t* mmap_end = (void*) ((size_t) mb_info->mmap_addr + mb_info->mmap_length);
@@ -345,22 +528,26 @@ int memory_init(void)
 					if (start_addr >= end_addr)
 						continue;
 
-					last->next = kmalloc(sizeof(free_list_t));
-					if (BUILTIN_EXPECT(!last->next, 0))
-						goto oom;
-
 					LOG_INFO("Add region 0x%zx - 0x%zx\n", start_addr, end_addr);
 
-					last->next->prev = last;
-					last = last->next;
-					last->next = NULL;
-					last->start = start_addr;
-					last->end = end_addr;
+					if (BUILTIN_EXPECT(page_zone_free(&zone, start_addr, (end_addr - start_addr) >> PAGE_BITS), 0))
+						goto oom;
 				}
 			}
 		}
 	}
 
+	// init high bandwidth memory subsystem
+	hbmemory_init();
+
+	if (cmdline) {
+		char* found = strstr((char*) (size_t) cmdline, "-zeropool=");
+		if (found)
+			zeropool = atoi(found+strlen("-zeropool="));
+	}
+	zero_pool_resize(zeropool);
+	LOG_INFO("Keep up to %u zeroed pages in reserve\n", zeropool);
+
 	// Ok, we are now able to use our memory management => update tss
 	tss_init();
 
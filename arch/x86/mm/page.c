@@ -40,6 +40,7 @@
 #include <hermit/string.h>
 #include <hermit/spinlock.h>
 #include <hermit/tasks.h>
+#include <hermit/vma.h>
 #include <hermit/logging.h>
 
 #include <asm/multiboot.h>
@@ -93,6 +94,20 @@ static size_t * const other[PAGE_LEVELS] = {
 
 static uint8_t expect_zeroed_pages = 0;
 
+/** Back the heap by 2 MiB pages (HERMIT_HUGEPAGES or "-hugepages") */
+extern uint32_t hugepages;
+
+/** Map new heap pages at sbrk (HERMIT_POPULATE or "-populate[-zero]") */
+extern uint32_t populate_heap;
+
+/** Populate thread stacks on demand (HERMIT_LAZYSTACK or "-lazystack") */
+extern uint32_t lazystack;
+
+/** Statistics of the heap mapping, protected by page_lock */
+static size_t heap_faults = 0;
+static size_t heap_huge_faults = 0;
+static size_t lazy_stack_faults = 0;
+
 size_t virt_to_phys(size_t addr)
 {
 	if ((addr > (size_t) &kernel_start) &&
@@ -105,6 +120,13 @@ size_t virt_to_phys(size_t addr)
 
 		return phy | off;
 
+	} else if (self[1][addr >> PAGE_2M_BITS] & PG_PSE) {
+		size_t vpn   = addr >> (PAGE_2M_BITS);	// virtual page number
+		size_t entry = self[1][vpn];		// page table entry
+		size_t off   = addr  & ~PAGE_2M_MASK;	// offset within page
+		size_t phy   = entry &  PAGE_2M_MASK;	// physical page frame number
+
+		return phy | off;
 	} else {
 		size_t vpn   = addr >> PAGE_BITS;	// virtual page number
 		size_t entry = self[0][vpn];		// page table entry
@@ -134,7 +156,7 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8
 	int lvl, ret = -ENOMEM;
 	long vpn = viraddr >> PAGE_BITS;
 	long first[PAGE_LEVELS], last[PAGE_LEVELS];
-	int8_t send_ipi = 0;
+	size_t flush_start = (size_t) -1, flush_end = 0;
 
 	//kprintf("Map %d pages at 0x%zx\n", npages, viraddr);
 
@@ -170,29 +192,29 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8
 				}
 			}
 			else { /* PGT */
-				int8_t flush = 0;
-
 				/* do we have to flush the TLB? */
 				if (self[lvl][vpn] & PG_PRESENT) {
 					//kprintf("Remap address 0x%zx at core %d\n", viraddr, CORE_ID);
-					send_ipi = flush = 1;
+					if ((vpn << PAGE_BITS) < flush_start)
+						flush_start = vpn << PAGE_BITS;
+					flush_end = (vpn + 1) << PAGE_BITS;
 				}
 
 				self[lvl][vpn] = phyaddr | bits | PG_PRESENT | PG_ACCESSED | PG_DIRTY;
 
-				if (flush)
-					/* There's already a page mapped at this address.
-					 * We have to flush a single TLB entry. */
-					tlb_flush_one_page(vpn << PAGE_BITS, 0);
-
 				phyaddr += PAGE_SIZE;
 				//viraddr += PAGE_SIZE;
 			}
 		}
 	}
 
-	if (do_ipi && send_ipi)
-		ipi_tlb_flush();
+	/* There were already pages mapped in this range.
+	 * We have to flush the corresponding TLB entries. */
+	if (flush_end) {
+		tlb_flush_range(flush_start, flush_end);
+		if (do_ipi)
+			ipi_tlb_flush_range(flush_start, flush_end);
+	}
 
 	ret = 0;
 out:
@@ -213,45 +235,210 @@ int page_unmap(size_t viraddr, size_t npages)
 	/* Start iterating through the entries.
 	 * Only the PGT entries are removed. Tables remain allocated. */
 	size_t vpn, start = viraddr>>PAGE_BITS;
+	for (vpn=start; vpn<start+npages; vpn++)
+		self[0][vpn] = 0;
+
+	tlb_flush_range(start << PAGE_BITS, (start+npages) << PAGE_BITS);
+	ipi_tlb_flush_range(start << PAGE_BITS, (start+npages) << PAGE_BITS);
+
+	spinlock_irqsave_unlock(&page_lock);
+
+	/* This can't fail because we don't make checks here */
+	return 0;
+}
+
+void page_fault_stats(size_t* faults, size_t* huge_faults, size_t* stack_faults)
+{
+	spinlock_irqsave_lock(&page_lock);
+
+	if (faults)
+		*faults = heap_faults;
+	if (huge_faults)
+		*huge_faults = heap_huge_faults;
+	if (stack_faults)
+		*stack_faults = lazy_stack_faults;
+
+	spinlock_irqsave_unlock(&page_lock);
+}
+
+/** @brief Check if a virtual address is already mapped
+ *
+ * The caller has to hold page_lock.
+ */
+static int page_present(size_t vaddr)
+{
+	int lvl;
+	long vpn = vaddr >> PAGE_BITS;
+	long index[PAGE_LEVELS];
+
+	/* Calculate index boundaries for page map traversal */
+	for (lvl=0; lvl<PAGE_LEVELS; lvl++)
+		index[lvl] = vpn >> (lvl * PAGE_MAP_BITS);
+
+	/* do we have already a valid entry in the page tables */
+	for (lvl=PAGE_LEVELS-1; lvl>=0; lvl--) {
+		vpn = index[lvl];
+
+		if (!(self[lvl][vpn] & PG_PRESENT))
+			return 0;
+		if ((lvl == 1) && (self[lvl][vpn] & PG_PSE))
+			return 1;
+	}
+
+	return 1;
+}
+
+int page_unmap_free(size_t viraddr, size_t npages)
+{
+	size_t vpn, start = viraddr >> PAGE_BITS;
+
+	if (BUILTIN_EXPECT(!npages, 0))
+		return 0;
+
+	spinlock_irqsave_lock(&page_lock);
+
+	/*
+	 * Nobody is able to map the released frames before we flushed
+	 * the TLBs, because this requires page_lock.
+	 */
 	for (vpn=start; vpn<start+npages; vpn++) {
+		if (!page_present(vpn << PAGE_BITS))
+			continue;
+
+		put_page(self[0][vpn] & PAGE_MASK);
 		self[0][vpn] = 0;
-		tlb_flush_one_page(vpn << PAGE_BITS, 0);
 	}
 
-	ipi_tlb_flush();
+	tlb_flush_range(start << PAGE_BITS, (start+npages) << PAGE_BITS);
+	ipi_tlb_flush_range(start << PAGE_BITS, (start+npages) << PAGE_BITS);
 
 	spinlock_irqsave_unlock(&page_lock);
 
-	/* This can't fail because we don't make checks here */
 	return 0;
 }
 
-void page_fault_handler(struct state *s)
+/** @brief Back an address by an aligned 2 MiB page
+ *
+ * The caller has to hold page_lock. The huge page is only used, if the
+ * surrounding 2 MiB are part of [start, end) and not yet covered by a
+ * page table.
+ *
+ * @return
+ * - 0 on success
+ * - <0 if the caller has to fall back to a 4 KiB page
+ */
+static int page_map_huge(size_t viraddr, size_t start, size_t end, uint8_t zero)
 {
-	size_t viraddr = read_cr2();
-	task_t* task = per_core(current_task);
+	size_t vstart = PAGE_2M_FLOOR(viraddr);
+	long vpn = vstart >> PAGE_BITS;
+	size_t phyaddr, bits;
+	int lvl;
 
-	int check_pagetables(size_t vaddr)
-	{
-		int lvl;
-		long vpn = vaddr >> PAGE_BITS;
-		long index[PAGE_LEVELS];
+	if ((vstart < start) || (vstart + PAGE_2M_SIZE > end))
+		return -EINVAL;
+
+	/* Create missing PML4 and PDPT entries */
+	for (lvl=PAGE_LEVELS-1; lvl>1; lvl--) {
+		long index = vpn >> (lvl * PAGE_MAP_BITS);
+
+		if (!(self[lvl][index] & PG_PRESENT)) {
+			size_t paddr = get_pages(1);
+			if (BUILTIN_EXPECT(!paddr, 0))
+				return -ENOMEM;
+
+			self[lvl][index] = paddr | PG_PRESENT | PG_USER | PG_RW | PG_ACCESSED | PG_DIRTY;
+			memset(&self[lvl-1][index<<PAGE_MAP_BITS], 0, PAGE_SIZE);
+		}
+	}
+
+	/* some 4 KiB pages are already mapped in this region */
+	if (self[1][vpn >> PAGE_MAP_BITS] & PG_PRESENT)
+		return -EEXIST;
+
+	phyaddr = get_pages(PAGE_2M_SIZE >> PAGE_BITS);
+	if (BUILTIN_EXPECT(!phyaddr, 0))
+		return -ENOMEM;
+	if (BUILTIN_EXPECT(phyaddr & (PAGE_2M_SIZE-1), 0)) {
+		put_pages(phyaddr, PAGE_2M_SIZE >> PAGE_BITS);
+		return -ENOMEM;
+	}
+
+	bits = PG_USER|PG_RW|PG_PSE|PG_PRESENT|PG_ACCESSED|PG_DIRTY;
+	if (has_nx()) // set no execution flag to protect the heap
+		bits |= PG_XD;
+	self[1][vpn >> PAGE_MAP_BITS] = phyaddr | bits;
+
+	if (zero)
+		memset((void*) vstart, 0x00, PAGE_2M_SIZE);
+
+	return 0;
+}
+
+int page_populate(size_t viraddr, size_t npages, size_t bits, uint8_t zero)
+{
+	size_t vend = viraddr + npages * PAGE_SIZE;
+	size_t run, phyaddr;
+	int ret = 0;
+
+	zero |= expect_zeroed_pages;
+
+	while (viraddr < vend) {
+		spinlock_irqsave_lock(&page_lock);
+
+		if (page_present(viraddr)) {
+			spinlock_irqsave_unlock(&page_lock);
+			viraddr += PAGE_SIZE;
+			continue;
+		}
+
+		if (hugepages && !(viraddr & (PAGE_2M_SIZE-1))
+		    && !page_map_huge(viraddr, viraddr, vend, 0)) {
+			run = PAGE_2M_SIZE >> PAGE_BITS;
+			goto mapped;
+		}
+
+		// determine the unmapped pages behind viraddr, which are covered by the same page table
+		for(run=1; viraddr + run * PAGE_SIZE < vend; run++) {
+			size_t next = viraddr + run * PAGE_SIZE;
 
-		/* Calculate index boundaries for page map traversal */
-		for (lvl=0; lvl<PAGE_LEVELS; lvl++)
-			index[lvl] = vpn >> (lvl * PAGE_MAP_BITS);
+			if (!(next & (PAGE_2M_SIZE-1)) || page_present(next))
+				break;
+		}
+
+		do {
+			phyaddr = get_pages(run);
+		} while (!phyaddr && (run >>= 1));
 
-		/* do we have already a valid entry in the page tables */
-		for (lvl=PAGE_LEVELS-1; lvl>=0; lvl--) {
-			vpn = index[lvl];
+		if (BUILTIN_EXPECT(!phyaddr, 0)) {
+			spinlock_irqsave_unlock(&page_lock);
+			return -ENOMEM;
+		}
 
-			if (!(self[lvl][vpn] & PG_PRESENT))
-				return 0;
+		ret = __page_map(viraddr, phyaddr, run, bits, 0);
+		if (BUILTIN_EXPECT(ret, 0)) {
+			spinlock_irqsave_unlock(&page_lock);
+			put_pages(phyaddr, run);
+			return ret;
 		}
 
-		return 1;
+mapped:
+		spinlock_irqsave_unlock(&page_lock);
+
+		// the new pages aren't visible to anybody else => zero them without lock
+		if (zero)
+			memzero_nt((void*) viraddr, run * PAGE_SIZE);
+
+		viraddr += run * PAGE_SIZE;
 	}
 
+	return 0;
+}
+
+void page_fault_handler(struct state *s)
+{
+	size_t viraddr = read_cr2();
+	task_t* task = per_core(current_task);
+
 	spinlock_irqsave_lock(&page_lock);
 
 	if ((task->heap) && (viraddr >= task->heap->start) && (viraddr < task->heap->end)) {
@@ -261,12 +448,20 @@ void page_fault_handler(struct state *s)
 		/*
 		 * do we have a valid page table entry? => flush TLB and return
 		 */
-		if (check_pagetables(viraddr)) {
+		if (page_present(viraddr)) {
 			//tlb_flush_one_page(viraddr);
 			spinlock_irqsave_unlock(&page_lock);
 			return;
 		}
 
+		heap_faults++;
+
+		if (hugepages && !page_map_huge(viraddr, task->heap->start, task->heap->end, expect_zeroed_pages)) {
+			heap_huge_faults++;
+			spinlock_irqsave_unlock(&page_lock);
+			return;
+		}
+
 		 // on demand userspace heap mapping
 		viraddr &= PAGE_MASK;
 
@@ -293,6 +488,38 @@ void page_fault_handler(struct state *s)
 		return;
 	}
 
+	if (lazystack && task->stack && (viraddr >= (size_t) task->stack)
+	    && (viraddr < (size_t) task->stack + DEFAULT_STACK_SIZE)) {
+		size_t phyaddr;
+
+		if (page_present(viraddr)) {
+			spinlock_irqsave_unlock(&page_lock);
+			return;
+		}
+
+		lazy_stack_faults++;
+
+		// on demand stack mapping, the guard pages remain unmapped
+		viraddr &= PAGE_MASK;
+
+		phyaddr = get_page();
+		if (BUILTIN_EXPECT(!phyaddr, 0)) {
+			LOG_ERROR("out of memory: task = %u\n", task->id);
+			goto default_handler;
+		}
+
+		if (BUILTIN_EXPECT(__page_map(viraddr, phyaddr, 1, PG_RW|PG_GLOBAL|PG_NX, 0), 0)) {
+			LOG_ERROR("map_region: could not map %#lx to %#lx, task = %u\n", phyaddr, viraddr, task->id);
+			put_page(phyaddr);
+
+			goto default_handler;
+		}
+
+		spinlock_irqsave_unlock(&page_lock);
+
+		return;
+	}
+
 default_handler:
 	spinlock_irqsave_unlock(&page_lock);
 
@@ -337,6 +564,19 @@ int page_init(void)
 		}
 	} else cmdline = 0;
 
+	if (cmdline && strstr((char*) (size_t) cmdline, "-hugepages"))
+		hugepages = 1;
+	if (hugepages)
+		LOG_INFO("Use 2 MiB pages to back the heap\n");
+	if (cmdline && strstr((char*) (size_t) cmdline, "-populate"))
+		populate_heap = strstr((char*) (size_t) cmdline, "-populate-zero") ? 2 : 1;
+	if (populate_heap)
+		LOG_INFO("sbrk maps%s the heap in advance\n", populate_heap > 1 ? " and zeroes" : "");
+	if (cmdline && strstr((char*) (size_t) cmdline, "-lazystack"))
+		lazystack = 1;
+	if (lazystack)
+		LOG_INFO("Populate thread stacks on demand\n");
+
 	/* Replace default pagefault handler */
 	irq_uninstall_handler(14);
 	irq_install_handler(14, page_fault_handler);
@@ -5,7 +5,7 @@ set(MAX_CORES "512" CACHE STRING
 	"Maximum number of cores that can be managed")
 
 set(MAX_TASKS "((MAX_CORES * 2) + 2)" CACHE STRING
-	"Maximum number of tasks")
+	"Upper bound of the number of tasks, the task table is sized at boot time")
 
 set(MAX_ISLE "8" CACHE STRING
 	"Maximum number of NUMA isles")
@@ -25,6 +25,9 @@ option(DYNAMIC_TICKS
 option(SAVE_FPU
 	"Save FPU registers on context switch" ON)
 
+option(LOCK_STATS
+	"Collect contention statistics of the queued kernel locks" OFF)
+
 option(HAVE_ARCH_MEMSET	 "Use machine specific version of memset"  OFF)
 option(HAVE_ARCH_MEMCPY	 "Use machine specific version of memcpy"  OFF)
 option(HAVE_ARCH_STRLEN	 "Use machine specific version of strlen"  OFF)
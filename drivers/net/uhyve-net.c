@@ -59,22 +59,12 @@
 #include "uhyve-net.h"
 
 #define UHYVE_IRQ	11
+/// Size of the ethernet header without padding
+#define ETH_HLEN	14
 
 static int8_t uhyve_net_init_ok = 0;
 static struct netif* mynetif = NULL;
 
-static int uhyve_net_write_sync(uint8_t *data, int n)
-{
-	volatile uhyve_netwrite_t uhyve_netwrite;
-	uhyve_netwrite.data = (uint8_t*)virt_to_phys((size_t)data);
-	uhyve_netwrite.len = n;
-	uhyve_netwrite.ret = 0;
-
-	outportl(UHYVE_PORT_NETWRITE, (unsigned)virt_to_phys((size_t)&uhyve_netwrite));
-
-	return uhyve_netwrite.ret;
-}
-
 int uhyve_net_stat(void)
 {
         volatile uhyve_netstat_t uhyve_netstat;
@@ -84,27 +74,16 @@ int uhyve_net_stat(void)
         return uhyve_netstat.status;
 }
 
-static int uhyve_net_read_sync(uint8_t *data, int *n)
-{
-	volatile uhyve_netread_t uhyve_netread;
-
-	uhyve_netread.data = (uint8_t*)virt_to_phys((size_t)data);
-	uhyve_netread.len = *n;
-	uhyve_netread.ret = 0;
-
-	outportl(UHYVE_PORT_NETREAD, (unsigned)virt_to_phys((size_t)&uhyve_netread));
-	*n = uhyve_netread.len;
-
-	return uhyve_netread.ret;
-}
-
 static char mac_str[18];
+static uint32_t hermit_net_queues = 1;
 static char *hermit_net_mac_str(void)
 {
 	volatile uhyve_netinfo_t uhyve_netinfo;
 
+	uhyve_netinfo.queues = 1;
 	outportl(UHYVE_PORT_NETINFO, (unsigned)virt_to_phys((size_t)&uhyve_netinfo));
 	memcpy(mac_str, (void *)&uhyve_netinfo.mac_str, 18);
+	hermit_net_queues = uhyve_netinfo.queues;
 
 	return mac_str;
 }
@@ -121,82 +100,174 @@ static inline uint8_t dehex(char c)
                 return 0;
 }
 
+static inline void uhyve_netif_kick(uhyve_netring_t* ring, uint32_t queue)
+{
+	// pairs with the barrier of the host thread before it sleeps
+	mb();
+	if (ring->host_idle)
+		outportl(UHYVE_PORT_NETKICK, queue);
+}
+
+/*
+ * Hash of the addresses and ports of a frame. All packets of a flow are
+ * sent via the same queue and keep their order. Packets without a known
+ * header are sent via the first queue.
+ */
+static uint32_t uhyve_netif_flow_hash(const uint8_t* frame, uint32_t len)
+{
+	const uint8_t* l3 = frame + ETH_HLEN;
+	const uint8_t* addr;
+	uint32_t hash = 2166136261U;
+	uint32_t i, alen, hlen, proto;
+	uint16_t type;
+
+	if (len < ETH_HLEN)
+		return 0;
+
+	type = (frame[12] << 8) | frame[13];
+	if ((type == ETHTYPE_IP) && (len >= ETH_HLEN + 20)) {
+		hlen = (l3[0] & 0x0F) * 4;
+		// fragments don't contain the ports
+		proto = (((l3[6] & 0x3F) | l3[7]) == 0) ? l3[9] : 0;
+		addr = l3 + 12;
+		alen = 8;
+	} else if ((type == ETHTYPE_IPV6) && (len >= ETH_HLEN + 40)) {
+		hlen = 40;
+		proto = l3[6];
+		addr = l3 + 8;
+		alen = 32;
+	} else return 0;
+
+	// FNV-1a of the addresses
+	for(i=0; i<alen; i++)
+		hash = (hash ^ addr[i]) * 16777619U;
+
+	// and of the ports
+	if (((proto == IP_PROTO_TCP) || (proto == IP_PROTO_UDP)) && (len >= ETH_HLEN + hlen + 4)) {
+		for(i=0; i<4; i++)
+			hash = (hash ^ l3[hlen + i]) * 16777619U;
+	}
+
+	return hash;
+}
+
 //---------------------------- OUTPUT --------------------------------------------
 
 static err_t uhyve_netif_output(struct netif* netif, struct pbuf* p)
 {
 	uhyve_netif_t* uhyve_netif = netif->state;
-	uint8_t transmitid = uhyve_netif->tx_queue % TX_BUF_NUM;
-	uint32_t i;
-	struct pbuf *q;
-
-	if(BUILTIN_EXPECT((uhyve_netif->tx_queue - uhyve_netif->tx_complete) > (TX_BUF_NUM - 1), 0)) {
-		LOG_ERROR("uhyve_netif_output: too many packets at once\n");
-		return ERR_IF;
-	}
+	uhyve_netqueue_t* queue;
+	uhyve_netq_t* tx;
+	uint32_t i, q, slot, avail;
+	uint8_t* buf;
+	struct pbuf *r;
 
 	if(BUILTIN_EXPECT(p->tot_len > 1792, 0)) {
 		LOG_ERROR("uhyve_netif_output: packet (%i bytes) is longer than 1792 bytes\n", p->tot_len);
 		return ERR_IF;
 	}
 
-	if(uhyve_netif->tx_inuse[transmitid] == 1) {
-		LOG_ERROR("uhyve_netif_output: %i already inuse\n", transmitid);
-		return ERR_IF;
-	}
+#if ETH_PAD_SIZE
+	pbuf_header(p, -ETH_PAD_SIZE); /*drop padding word */
+#endif
 
-	uhyve_netif->tx_queue++;
-	uhyve_netif->tx_inuse[transmitid] = 1;
+	// lwIP places the headers in the first pbuf
+	q = 0;
+	if (uhyve_netif->nqueues > 1)
+		q = uhyve_netif_flow_hash((const uint8_t*) p->payload, p->len) % uhyve_netif->nqueues;
+	queue = &uhyve_netif->queues[q];
+	tx = &queue->ring->tx;
+	avail = tx->avail;
+
+	// all descriptors are in use => wait until the host sends the packets
+	for(i=0; (avail - tx->used >= UHYVE_NET_RING_SIZE) && (i < 100000); i++) {
+		if (!i)
+			uhyve_netif_kick(queue->ring, q);
+		PAUSE;
+	}
 
+	if (BUILTIN_EXPECT(avail - tx->used >= UHYVE_NET_RING_SIZE, 0)) {
 #if ETH_PAD_SIZE
-	pbuf_header(p, -ETH_PAD_SIZE); /*drop padding word */
+		pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
 #endif
+		queue->tx_drops++;
+		LINK_STATS_INC(link.drop);
+		return ERR_IF;
+	}
+
+	slot = avail & UHYVE_NET_RING_MASK;
+	buf = queue->tx_buf + slot * UHYVE_NET_BUF_LEN;
 
 	/*
-	 * q traverses through linked list of pbuf's
+	 * r traverses through linked list of pbuf's
 	 * This list MUST consist of a single packet ONLY
 	 */
-	for (q = p, i = 0; q != 0; q = q->next) {
-		memcpy(uhyve_netif->tx_buf[transmitid] + i, q->payload, q->len);
-		i += q->len;
+	for (r = p, i = 0; r != 0; r = r->next) {
+		memcpy(buf + i, r->payload, r->len);
+		i += r->len;
 	}
-	// send the packet
-	uhyve_net_write_sync(uhyve_netif->tx_buf[transmitid], p->tot_len);
+	tx->desc[slot].len = i;
 
 #if ETH_PAD_SIZE
 	pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
 #endif
 
-	LINK_STATS_INC(link.xmit);
+	// publish the packet, the host is only kicked if it sleeps
+	wmb();
+	tx->avail = avail + 1;
+	uhyve_netif_kick(queue->ring, q);
 
-	uhyve_netif->tx_complete++;
-	uhyve_netif->tx_inuse[transmitid] = 0;
-//	LOG_INFO("Transmit OK | queue = %i, complete = %i \n", uhyve_netif->tx_queue, uhyve_netif->tx_complete);
+	queue->tx_packets++;
+	queue->tx_bytes += i;
+	LINK_STATS_INC(link.xmit);
 
 	return ERR_OK;
 }
 
-static void consume_packet(void* ctx)
+//------------------------------- POLLING ----------------------------------------
+
+static inline int uhyve_netif_rx_pending(uhyve_netif_t* uhyve_netif)
 {
-	struct pbuf *p = (struct pbuf*) ctx;
+	uint32_t q;
+
+	for(q=0; q<uhyve_netif->nqueues; q++) {
+		if (uhyve_netif->queues[q].ring->rx.used != uhyve_netif->queues[q].rx_next)
+			return 1;
+	}
 
-	mynetif->input(p, mynetif);
+	return 0;
 }
 
-//------------------------------- POLLING ----------------------------------------
+static inline void uhyve_netif_set_no_irq(uhyve_netif_t* uhyve_netif, uint32_t no_irq)
+{
+	uint32_t q;
+
+	for(q=0; q<uhyve_netif->nqueues; q++)
+		uhyve_netif->queues[q].ring->rx.no_irq = no_irq;
+}
 
-static void uhyve_netif_poll(void)
+/*
+ * Handles up to budget packets of a receive queue and returns the
+ * buffers to the host. Returns the number of handled packets.
+ */
+static uint32_t uhyve_netif_rx(struct netif* netif, uint32_t q, uint32_t budget)
 {
-	if (!uhyve_net_init_ok)
-		return;
+	uhyve_netif_t* uhyve_netif = netif->state;
+	uhyve_netqueue_t* queue = &uhyve_netif->queues[q];
+	uhyve_netq_t* rx = &queue->ring->rx;
+	uint32_t n, slot, len, pos;
+	struct pbuf *p, *r;
+	uint8_t* buf;
+
+	for(n=0; (n < budget) && (rx->used != queue->rx_next); n++) {
+		rmb();
+		slot = queue->rx_next & UHYVE_NET_RING_MASK;
+		buf = queue->rx_buf + slot * UHYVE_NET_BUF_LEN;
+		len = rx->desc[slot].len;
 
-	uhyve_netif_t* uhyve_netif = mynetif->state;
-	int len = RX_BUF_LEN;
-	struct pbuf *p = NULL;
-	struct pbuf *q;
+		queue->rx_packets++;
+		queue->rx_bytes += len;
 
-	if (uhyve_net_read_sync(uhyve_netif->rx_buf, &len) == 0)
-	{
 #if ETH_PAD_SIZE
 		len += ETH_PAD_SIZE; /*allow room for Ethernet padding */
 #endif
@@ -205,41 +276,163 @@ static void uhyve_netif_poll(void)
 #if ETH_PAD_SIZE
 			pbuf_header(p, -ETH_PAD_SIZE); /*drop the padding word */
 #endif
-			uint8_t pos = 0;
-			for (q=p; q!=NULL; q=q->next) {
-				memcpy((uint8_t*) q->payload, uhyve_netif->rx_buf + pos, q->len);
-				pos += q->len;
+			for (r=p, pos=0; r!=NULL; r=r->next) {
+				memcpy((uint8_t*) r->payload, buf + pos, r->len);
+				pos += r->len;
 			}
 #if ETH_PAD_SIZE
 			pbuf_header(p, ETH_PAD_SIZE); /*reclaim the padding word */
 #endif
 
-
-			//forward packet to the IP thread
-			if (tcpip_callback_with_block(consume_packet, p, 0) == ERR_OK) {
+			if (netif->input(p, netif) == ERR_OK) {
 				LINK_STATS_INC(link.recv);
 			} else {
+				queue->rx_drops++;
 				LINK_STATS_INC(link.drop);
 				pbuf_free(p);
 			}
 		} else {
-			LOG_ERROR("uhyve_netif_poll: not enough memory!\n");
+			LOG_ERROR("uhyve_netif_rx: not enough memory!\n");
+			queue->rx_drops++;
 			LINK_STATS_INC(link.memerr);
 			LINK_STATS_INC(link.drop);
 		}
+
+		// return the buffer to the host
+		rx->desc[slot].len = UHYVE_NET_BUF_LEN;
+		queue->rx_next++;
+	}
+
+	if (n) {
+		wmb();
+		rx->avail = queue->rx_next + UHYVE_NET_RING_SIZE;
+		uhyve_netif_kick(queue->ring, q);
+	}
+
+	return n;
+}
+
+/*
+ * Runs in the context of the tcpip thread. As long as packets are
+ * pending, the interrupts of the host are suppressed. At most
+ * UHYVE_NET_BUDGET packets per queue are handled at once to give
+ * other callbacks of the tcpip thread a chance to run.
+ */
+static void uhyve_netif_poll(void* ctx)
+{
+	struct netif* netif = (struct netif*) ctx;
+	uhyve_netif_t* uhyve_netif = netif->state;
+	uint32_t q, exhausted = 0;
+
+	for(q=0; q<uhyve_netif->nqueues; q++) {
+		if (uhyve_netif_rx(netif, q, UHYVE_NET_BUDGET) == UHYVE_NET_BUDGET)
+			exhausted = 1;
+	}
+
+	if (exhausted) {
+		// further packets are pending => poll again
+		if (tcpip_callback_with_block(uhyve_netif_poll, netif, 0) == ERR_OK)
+			return;
+	}
+
+	// enable the interrupt and check for packets, which arrived in between
+	atomic_int32_set(&uhyve_netif->polling, 0);
+	uhyve_netif_set_no_irq(uhyve_netif, 0);
+	mb();
+	if (uhyve_netif_rx_pending(uhyve_netif) && !atomic_int32_test_and_set(&uhyve_netif->polling, 1)) {
+		uhyve_netif_set_no_irq(uhyve_netif, 1);
+		if (tcpip_callback_with_block(uhyve_netif_poll, netif, 0) != ERR_OK) {
+			atomic_int32_set(&uhyve_netif->polling, 0);
+			uhyve_netif_set_no_irq(uhyve_netif, 0);
+		}
 	}
 }
 
 static void uhyve_irqhandler(struct state* s)
 {
-	uhyve_netif_poll();
+	uhyve_netif_t* uhyve_netif;
+
+	if (!uhyve_net_init_ok)
+		return;
+
+	uhyve_netif = mynetif->state;
+
+	// suppress further interrupts until the receive queues are drained
+	uhyve_netif_set_no_irq(uhyve_netif, 1);
+	if (!atomic_int32_test_and_set(&uhyve_netif->polling, 1)) {
+		if (tcpip_callback_with_block(uhyve_netif_poll, mynetif, 0) != ERR_OK) {
+			LINK_STATS_INC(link.drop);
+			atomic_int32_set(&uhyve_netif->polling, 0);
+			uhyve_netif_set_no_irq(uhyve_netif, 0);
+		}
+	}
+}
+
+int uhyve_net_queue_stats(uint32_t queue, size_t* rx_packets, size_t* rx_bytes,
+			  size_t* tx_packets, size_t* tx_bytes, size_t* drops)
+{
+	uhyve_netif_t* uhyve_netif;
+	uhyve_netqueue_t* q;
+
+	if (!uhyve_net_init_ok)
+		return -ENODEV;
+
+	uhyve_netif = mynetif->state;
+	if (queue >= uhyve_netif->nqueues)
+		return -EINVAL;
+
+	q = &uhyve_netif->queues[queue];
+	if (rx_packets)
+		*rx_packets = q->rx_packets;
+	if (rx_bytes)
+		*rx_bytes = q->rx_bytes;
+	if (tx_packets)
+		*tx_packets = q->tx_packets;
+	if (tx_bytes)
+		*tx_bytes = q->tx_bytes;
+	if (drops)
+		*drops = q->rx_drops + q->tx_drops;
+
+	return 0;
 }
 
 //--------------------------------- INIT -----------------------------------------
 
+static void uhyve_netif_free_queue(uhyve_netqueue_t* queue)
+{
+	if (queue->tx_buf)
+		page_free(queue->tx_buf, UHYVE_NET_RING_SIZE * UHYVE_NET_BUF_LEN);
+	if (queue->rx_buf)
+		page_free(queue->rx_buf, UHYVE_NET_RING_SIZE * UHYVE_NET_BUF_LEN);
+	memset(queue, 0x00, sizeof(uhyve_netqueue_t));
+}
+
+static err_t uhyve_netif_alloc_queue(uhyve_netqueue_t* queue, uhyve_netring_t* ring)
+{
+	queue->ring = ring;
+	queue->rx_buf = page_alloc(UHYVE_NET_RING_SIZE * UHYVE_NET_BUF_LEN, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	queue->tx_buf = page_alloc(UHYVE_NET_RING_SIZE * UHYVE_NET_BUF_LEN, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (!queue->rx_buf || !queue->tx_buf) {
+		uhyve_netif_free_queue(queue);
+		return ERR_MEM;
+	}
+
+	// all receive buffers belong to the host
+	for (int i = 0; i < UHYVE_NET_RING_SIZE; i++) {
+		ring->rx.desc[i].addr = virt_to_phys((size_t) queue->rx_buf + i*UHYVE_NET_BUF_LEN);
+		ring->rx.desc[i].len = UHYVE_NET_BUF_LEN;
+		ring->tx.desc[i].addr = virt_to_phys((size_t) queue->tx_buf + i*UHYVE_NET_BUF_LEN);
+	}
+	ring->rx.avail = UHYVE_NET_RING_SIZE;
+
+	return ERR_OK;
+}
+
 err_t uhyve_netif_init (struct netif* netif)
 {
 	uhyve_netif_t* uhyve_netif;
+	volatile uhyve_netrings_t rings;
+	uhyve_netring_t* ring;
 	uint8_t tmp8 = 0;
 	static uint8_t num = 0;
 
@@ -251,25 +444,33 @@ err_t uhyve_netif_init (struct netif* netif)
 
 	memset(uhyve_netif, 0x00, sizeof(uhyve_netif_t));
 
-	uhyve_netif->rx_buf = page_alloc(RX_BUF_LEN + 16 /* header size */, VMA_READ|VMA_WRITE);
-	if (!(uhyve_netif->rx_buf)) {
-		LOG_ERROR("uhyve_netif_init: out of memory\n");
-		kfree(uhyve_netif);
-		return ERR_MEM;
-	}
-	memset(uhyve_netif->rx_buf, 0x00, RX_BUF_LEN + 16);
-
-	uhyve_netif->tx_buf[0] = page_alloc(TX_BUF_NUM * TX_BUF_LEN, VMA_READ|VMA_WRITE);
-	if (!(uhyve_netif->tx_buf[0])) {
+	// the host determines the number of queue pairs
+	char *hermit_mac = hermit_net_mac_str();
+	uhyve_netif->nqueues = hermit_net_queues;
+	if (!uhyve_netif->nqueues)
+		uhyve_netif->nqueues = 1;
+	if (uhyve_netif->nqueues > UHYVE_NET_MAX_QUEUES)
+		uhyve_netif->nqueues = UHYVE_NET_MAX_QUEUES;
+
+	ring = page_alloc(uhyve_netif->nqueues * sizeof(uhyve_netring_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (!ring) {
 		LOG_ERROR("uhyve_netif_init: out of memory\n");
-		page_free(uhyve_netif->rx_buf, RX_BUF_LEN + 16);
 		kfree(uhyve_netif);
 		return ERR_MEM;
 	}
-	memset(uhyve_netif->tx_buf[0], 0x00, TX_BUF_NUM * TX_BUF_LEN);
-	for (int i = 1; i < TX_BUF_NUM; i++) {
-		uhyve_netif->tx_buf[i] = uhyve_netif->tx_buf[0] + i*TX_BUF_LEN;
+	memset(ring, 0x00, uhyve_netif->nqueues * sizeof(uhyve_netring_t));
+
+	for (uint32_t q = 0; q < uhyve_netif->nqueues; q++) {
+		if (uhyve_netif_alloc_queue(&uhyve_netif->queues[q], ring + q) != ERR_OK) {
+			LOG_ERROR("uhyve_netif_init: out of memory\n");
+			while (q-- > 0)
+				uhyve_netif_free_queue(&uhyve_netif->queues[q]);
+			page_free(ring, uhyve_netif->nqueues * sizeof(uhyve_netring_t));
+			kfree(uhyve_netif);
+			return ERR_MEM;
+		}
 	}
+	atomic_int32_set(&uhyve_netif->polling, 0);
 
 	netif->state = uhyve_netif;
 	mynetif = netif;
@@ -279,7 +480,6 @@ err_t uhyve_netif_init (struct netif* netif)
 	LOG_INFO("uhyve_netif_init: Found uhyve_net interface\n");
 
 	LWIP_DEBUGF(NETIF_DEBUG, ("uhyve_netif_init: MAC address "));
-	char *hermit_mac = hermit_net_mac_str();
 	for (tmp8=0; tmp8 < ETHARP_HWADDR_LEN; tmp8++) {
 		netif->hwaddr[tmp8] = dehex(*hermit_mac++) << 4;
 		netif->hwaddr[tmp8] |= dehex(*hermit_mac++);
@@ -289,7 +489,7 @@ err_t uhyve_netif_init (struct netif* netif)
 	LWIP_DEBUGF(NETIF_DEBUG, ("\n"));
 	uhyve_netif->ethaddr = (struct eth_addr *)netif->hwaddr;
 
-	LOG_INFO("uhye_netif uses irq %d\n", UHYVE_IRQ);
+	LOG_INFO("uhye_netif uses irq %d and %u queue pair(s)\n", UHYVE_IRQ, uhyve_netif->nqueues);
 	irq_install_handler(32+UHYVE_IRQ, uhyve_irqhandler);
 
 	/*
@@ -319,5 +519,12 @@ err_t uhyve_netif_init (struct netif* netif)
 	LOG_INFO("uhyve_netif_init: OK\n");
 	uhyve_net_init_ok = 1;
 
+	// the rings of the queue pairs are physically contiguous
+	rings.rings = (uhyve_netring_t*) virt_to_phys((size_t) ring);
+	rings.num = uhyve_netif->nqueues;
+
+	// hand over the rings => the host threads start to receive packets
+	outportl(UHYVE_PORT_NETRING, (unsigned)virt_to_phys((size_t)&rings));
+
 	return ERR_OK;
 }
@@ -32,42 +32,74 @@
 
 #include <hermit/stddef.h>
 #include <hermit/spinlock.h>
+#include <asm/atomic.h>
 
 #define MIN(a, b)	(a) < (b) ? (a) : (b)
 
-#define RX_BUF_LEN 2048
-#define TX_BUF_LEN 2048
-#define TX_BUF_NUM 1		//number of tx buffer
-
 #define UHYVE_PORT_NETINFO      0x505
-#define UHYVE_PORT_NETWRITE     0x506
-#define UHYVE_PORT_NETREAD      0x507
 #define UHYVE_PORT_NETSTAT	0x508
+#define UHYVE_PORT_NETRING	0x50D
+#define UHYVE_PORT_NETKICK	0x50E
+
+/// Number of descriptors of the receive and the transmit queue (power of two)
+#define UHYVE_NET_RING_SIZE	256
+#define UHYVE_NET_RING_MASK	(UHYVE_NET_RING_SIZE - 1)
+/// Size of a packet buffer
+#define UHYVE_NET_BUF_LEN	2048
+/// Maximum number of received packets per queue, which are handled by one poll
+#define UHYVE_NET_BUDGET	64
+/// Maximum number of queue pairs
+#define UHYVE_NET_MAX_QUEUES	8
 
 // UHYVE_PORT_NETINFO
 typedef struct {
         /* OUT */
         char mac_str[18];
+        uint32_t queues;
 } __attribute__((packed)) uhyve_netinfo_t;
 
-// UHYVE_PORT_NETWRITE
+/*
+ * Descriptor of a packet buffer. For the receive queue, the guest
+ * sets len to the size of the buffer and the host replaces it by the
+ * length of the received frame. For the transmit queue, len is the
+ * length of the frame.
+ */
 typedef struct {
-        /* IN */
-        const void* data;
-        size_t len;
-        /* OUT */
-        int ret;
-} __attribute__((packed)) uhyve_netwrite_t;
+	/// guest physical address of the buffer
+	uint64_t addr;
+	uint32_t len;
+	uint32_t flags;
+} uhyve_netdesc_t;
 
-// UHYVE_PORT_NETREAD
+/*
+ * The guest publishes descriptors by increasing avail, the host
+ * returns them by increasing used. Both counters wrap around and
+ * are taken modulo UHYVE_NET_RING_SIZE to get the slot.
+ */
 typedef struct {
-        /* IN */
-        void* data;
-        /* IN / OUT */
-        size_t len;
-        /* OUT */
-        int ret;
-} __attribute__((packed)) uhyve_netread_t;
+	/// written by the guest
+	volatile uint32_t avail __attribute__ ((aligned (64)));
+	/// the guest polls the queue => the host doesn't raise an interrupt
+	volatile uint32_t no_irq;
+	/// written by the host
+	volatile uint32_t used __attribute__ ((aligned (64)));
+	uhyve_netdesc_t desc[UHYVE_NET_RING_SIZE] __attribute__ ((aligned (64)));
+} uhyve_netq_t;
+
+// one pair of queues, the layout has to match with tools/uhyve-net.h
+typedef struct {
+	/// the host thread sleeps => new descriptors have to be kicked
+	volatile uint32_t host_idle __attribute__ ((aligned (64)));
+	uhyve_netq_t rx;
+	uhyve_netq_t tx;
+} uhyve_netring_t;
+
+// UHYVE_PORT_NETRING
+typedef struct {
+	/* IN */
+	uhyve_netring_t* rings;
+	uint32_t num;
+} __attribute__((packed)) uhyve_netrings_t;
 
 // UHYVE_PORT_NETSTAT
 typedef struct {
@@ -75,6 +107,21 @@ typedef struct {
         int status;
 } __attribute__((packed)) uhyve_netstat_t;
 
+/// State and statistics of a queue pair
+typedef struct uhyve_netqueue {
+	uhyve_netring_t* ring;
+	uint8_t* rx_buf;
+	uint8_t* tx_buf;
+	/// next descriptor of the receive queue, which will be consumed
+	uint32_t rx_next;
+	size_t rx_packets;
+	size_t rx_bytes;
+	size_t rx_drops;
+	size_t tx_packets;
+	size_t tx_bytes;
+	size_t tx_drops;
+} uhyve_netqueue_t;
+
 /*
  * Helper struct to hold private data used to operate your ethernet interface.
  */
@@ -82,14 +129,23 @@ typedef struct {
 typedef struct uhyve_netif {
 	struct eth_addr *ethaddr;
 	/* Add whatever per-interface state that is needed here. */
-	uint8_t* tx_buf[TX_BUF_NUM];
-	uint32_t tx_queue;
-	uint32_t tx_complete;
-	uint8_t tx_inuse[TX_BUF_NUM];
-	uint8_t* rx_buf;
+	uhyve_netqueue_t queues[UHYVE_NET_MAX_QUEUES];
+	uint32_t nqueues;
+	/// a poll of the receive queues is pending
+	atomic_int32_t polling;
 } uhyve_netif_t;
 
 err_t uhyve_netif_init(struct netif* netif);
 int uhyve_net_stat(void);
 
+/** @brief Statistics of a queue pair
+ *
+ * @return
+ * - 0 on success
+ * - -ENODEV if the device isn't initialized
+ * - -EINVAL if the queue doesn't exist
+ */
+int uhyve_net_queue_stats(uint32_t queue, size_t* rx_packets, size_t* rx_bytes,
+			  size_t* tx_packets, size_t* tx_bytes, size_t* drops);
+
 #endif
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @author Stefan Lankes
+ * @file include/hermit/futex.h
+ * @brief Wait queues keyed by the address of a user-level lock
+ *
+ * A futex doesn't need any kernel object per lock. The waiting tasks are
+ * kept in a hash table of wait queues, which is indexed by the address of
+ * the lock word. Therefore, an uncontended lock never enters the kernel.
+ */
+
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Block the current task, if *addr still contains val
+ *
+ * @param addr Address of the lock word
+ * @param val Expected value of the lock word
+ * @param ns Timeout in nanoseconds, 0 waits without timeout
+ * @return
+ * - 0 on success (the caller has to check the lock word again)
+ * - -EINVAL (-22) on invalid argument
+ * - -EAGAIN (-11) if *addr doesn't contain val
+ * - -ETIME (-62) on timer expired
+ */
+int futex_wait(int32_t* addr, int32_t val, uint64_t ns);
+
+/** @brief Wake up tasks, which are waiting on addr
+ *
+ * @param addr Address of the lock word
+ * @param count Maximum number of tasks to wake up
+ * @return
+ * - number of woken tasks
+ * - -EINVAL (-22) on invalid argument
+ */
+int futex_wake(int32_t* addr, int32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -32,6 +32,7 @@
 #include <hermit/mailbox_types.h>
 #include <hermit/tasks.h>
 #include <hermit/semaphore.h>
+#include <hermit/ring.h>
 #include <hermit/errno.h>
 
 #ifdef __cplusplus
@@ -39,16 +40,17 @@ extern "C" {
 #endif
 
 #define MAILBOX(name, type) 	\
+	RING_MPSC(mailbox_##name, type, MAILBOX_SIZE) \
+	\
 	inline static int mailbox_##name##_init(mailbox_##name##_t* m) { \
 		if (BUILTIN_EXPECT(!m, 0)) \
 			return -EINVAL; \
 	\
-		memset(m->buffer, 0x00, sizeof(type)*MAILBOX_SIZE); \
-		m->wpos = m->rpos = 0; \
+		ring_mpsc_mailbox_##name##_init(&m->ring); \
+		atomic_int32_set(&m->sleeping, 0); \
+		atomic_int32_set(&m->waiters, 0); \
 		sem_init(&m->mails, 0); \
-		sem_init(&m->boxes, MAILBOX_SIZE); \
-		spinlock_init(&m->rlock); \
-		spinlock_init(&m->wlock); \
+		sem_init(&m->boxes, 0); \
 	\
 		return 0; \
 	}\
@@ -59,22 +61,39 @@ extern "C" {
 	\
 		sem_destroy(&m->mails); \
 		sem_destroy(&m->boxes); \
-		spinlock_destroy(&m->rlock); \
-		spinlock_destroy(&m->wlock); \
 	\
 		return 0; \
 	} \
 	\
+	/* wakeup the receiver, if it sleeps */ \
+	inline static void mailbox_##name##_notify(mailbox_##name##_t* m) { \
+		mb(); \
+		if (atomic_int32_read(&m->sleeping) && atomic_int32_test_and_set(&m->sleeping, 0)) \
+			sem_post(&m->mails); \
+	} \
+	\
+	/* wakeup a sender, which waits for a free box */ \
+	inline static void mailbox_##name##_release(mailbox_##name##_t* m) { \
+		mb(); \
+		if (atomic_int32_read(&m->waiters)) \
+			sem_post(&m->boxes); \
+	} \
+	\
 	inline static int mailbox_##name##_post(mailbox_##name##_t* m, type mail) { \
 		if (BUILTIN_EXPECT(!m, 0)) \
 			return -EINVAL; \
 	\
-		sem_wait(&m->boxes, 0); \
-		spinlock_lock(&m->wlock); \
-		m->buffer[m->wpos] = mail; \
-		m->wpos = (m->wpos+1) % MAILBOX_SIZE; \
-		spinlock_unlock(&m->wlock); \
-		sem_post(&m->mails); \
+		while (ring_mpsc_mailbox_##name##_push(&m->ring, mail)) { \
+			/* mailbox is full => register as waiter and check again */ \
+			atomic_int32_inc(&m->waiters); \
+			if (!ring_mpsc_mailbox_##name##_push(&m->ring, mail)) { \
+				atomic_int32_dec(&m->waiters); \
+				break; \
+			} \
+			sem_wait(&m->boxes, 0); \
+			atomic_int32_dec(&m->waiters); \
+		} \
+		mailbox_##name##_notify(m); \
 	\
 		return 0; \
 	} \
@@ -83,30 +102,39 @@ extern "C" {
 		if (BUILTIN_EXPECT(!m, 0)) \
 			return -EINVAL; \
 	\
-		if (sem_trywait(&m->boxes)) \
+		if (ring_mpsc_mailbox_##name##_push(&m->ring, mail)) \
 			return -EBUSY; \
-		spinlock_lock(&m->wlock); \
-		m->buffer[m->wpos] = mail; \
-		m->wpos = (m->wpos+1) % MAILBOX_SIZE; \
-		spinlock_unlock(&m->wlock); \
-		sem_post(&m->mails); \
+		mailbox_##name##_notify(m); \
 	\
 		return 0; \
 	} \
 	\
 	inline static int mailbox_##name##_fetch(mailbox_##name##_t* m, type* mail, uint32_t ms) { \
+		uint64_t deadline = 0; \
 		int err; \
 	\
 		if (BUILTIN_EXPECT(!m || !mail, 0)) \
 			return -EINVAL; \
 	\
-		err = sem_wait(&m->mails, ms); \
-		if (err) return err; \
-		spinlock_lock(&m->rlock); \
-		*mail = m->buffer[m->rpos]; \
-		m->rpos = (m->rpos+1) % MAILBOX_SIZE; \
-		spinlock_unlock(&m->rlock); \
-		sem_post(&m->boxes); \
+		if (ms) \
+			deadline = get_rdtsc() + (uint64_t) ms * 1000ULL * (uint64_t) get_cpu_frequency(); \
+	\
+		while (ring_mpsc_mailbox_##name##_pop(&m->ring, mail)) { \
+			/* mailbox is empty => announce the sleep and check again */ \
+			atomic_int32_test_and_set(&m->sleeping, 1); \
+			if (!ring_mpsc_mailbox_##name##_pop(&m->ring, mail)) { \
+				atomic_int32_set(&m->sleeping, 0); \
+				break; \
+			} \
+			err = deadline ? sem_wait_until(&m->mails, deadline) : sem_wait(&m->mails, 0); \
+			if (err) { \
+				atomic_int32_set(&m->sleeping, 0); \
+				if (ring_mpsc_mailbox_##name##_pop(&m->ring, mail)) \
+					return err; \
+				break; \
+			} \
+		} \
+		mailbox_##name##_release(m); \
 	\
 		return 0; \
 	} \
@@ -115,13 +143,9 @@ extern "C" {
 		if (BUILTIN_EXPECT(!m || !mail, 0)) \
 			return -EINVAL; \
 	\
-		if (sem_trywait(&m->mails) != 0) \
+		if (ring_mpsc_mailbox_##name##_pop(&m->ring, mail)) \
 			return -EINVAL; \
-		spinlock_lock(&m->rlock); \
-		*mail = m->buffer[m->rpos]; \
-		m->rpos = (m->rpos+1) % MAILBOX_SIZE; \
-		spinlock_unlock(&m->rlock); \
-		sem_post(&m->boxes); \
+		mailbox_##name##_release(m); \
 	\
 		return 0; \
 	}\
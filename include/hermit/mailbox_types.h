@@ -35,6 +35,7 @@
 #define __MAILBOX_TYPES_H__
 
 #include <hermit/semaphore_types.h>
+#include <hermit/ring_types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,13 +51,19 @@ typedef struct {
 	int32_t	result;
 } wait_msg_t;
 
+/** @brief Mailbox with multiple senders and a single receiver
+ *
+ * The messages are stored in a lock-free ring. The semaphores are only
+ * used, if the receiver (or a sender) has to sleep.
+ */
 #define MAILBOX_TYPES(name, type) 	\
+	RING_MPSC_TYPES(mailbox_##name, type, MAILBOX_SIZE) \
 	typedef struct mailbox_##name { \
-		type buffer[MAILBOX_SIZE]; \
-		int wpos, rpos; \
+		ring_mpsc_mailbox_##name##_t ring; \
+		atomic_int32_t sleeping; \
+		atomic_int32_t waiters; \
 		sem_t mails; \
 		sem_t boxes; \
-		spinlock_t rlock, wlock; \
 	} mailbox_##name##_t;
 
 MAILBOX_TYPES(wait_msg, wait_msg_t)
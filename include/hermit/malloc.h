@@ -43,12 +43,24 @@ extern "C" {
 #define BUDDY_MAX	32 // 4 GB
 /// Binary exponent of minimal buddy size
 #define BUDDY_MIN	6  // 64 Byte >= cache line
-/// Binary exponent of the size which we allocate with buddy_fill()
+/// Binary exponent of an arena, which is split into smaller buddies
 #define BUDDY_ALLOC	16 // 64 KByte = 16 * PAGE_SIZE
 
 #define BUDDY_LISTS	(BUDDY_MAX-BUDDY_MIN+1)
 #define BUDDY_MAGIC	0xBABE
 
+/// Binary exponent of the largest size class, which is cached per core
+#define BUDDY_CACHE_MAX	12 // 4 KByte
+#define BUDDY_CACHE_LISTS	(BUDDY_CACHE_MAX-BUDDY_MIN+1)
+/// Binary exponent of a magazine
+#define MAGAZINE_EXP	9 // 512 Byte
+/// Number of buddies, which fit into one magazine
+#define MAGAZINE_SIZE	((1 << MAGAZINE_EXP) / sizeof(void*) - 2)
+/// Maximal number of bytes, which are cached by one magazine
+#define MAGAZINE_BYTES	(1 << 15) // 32 KByte
+/// Maximal number of full / empty magazines in the depot of a size class
+#define DEPOT_MAX	16
+
 union buddy;
 
 /** @brief Buddy
@@ -74,9 +86,28 @@ typedef union buddy {
 	} prefix;
 } buddy_t;
 
+/** @brief Magazine
+ *
+ * A magazine is a stack of free buddies of the same size class. Each core
+ * owns two magazines per size class, which serve kmalloc() and kfree()
+ * without touching any shared state. Full and empty magazines are exchanged
+ * with a depot, which is shared by all cores.
+ */
+typedef struct magazine {
+	/// Pointer to the next magazine in the depot
+	struct magazine* next;
+	/// Number of buddies in this magazine
+	size_t rounds;
+	/// Stack of free buddies
+	buddy_t* buddies[MAGAZINE_SIZE];
+} magazine_t;
+
 /** @brief Dump free buddies */
 void buddy_dump(void);
 
+/** @brief Print statistics of the per core kmalloc caches */
+void print_kmalloc_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -48,9 +48,31 @@ size_t get_pages(size_t npages);
  */
 static inline size_t get_page(void) { return get_pages(1); }
 
-/** @brief Get a single zeroed page */
+/** @brief Get a single zeroed page
+ *
+ * If possible, the page is taken from the pool of zeroed pages.
+ */
 size_t get_zeroed_page(void);
 
+/** @brief Refill the pool of zeroed pages
+ *
+ * This function is called by the idle loop and zeroes only a small
+ * batch of pages per call.
+ */
+void zero_pool_refill(void);
+
+/** @brief Change the number of zeroed pages, which are kept in reserve */
+void zero_pool_resize(size_t npages);
+
+/** @brief Statistics of the pool of zeroed pages
+ *
+ * @param depth Number of zeroed pages in the pool
+ * @param hits Number of requests, which are served by the pool
+ * @param misses Number of requests, which found an empty pool
+ * @param refills Number of pages, which are zeroed by the idle loop
+ */
+void zero_pool_stats(size_t* depth, size_t* hits, size_t* misses, size_t* refills);
+
 /** @brief release physical page frames */
 int put_pages(size_t phyaddr, size_t npages);
 
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @author Stefan Lankes
+ * @file include/hermit/page_zone.h
+ * @brief Buddy allocator for physical page frames
+ *
+ * A zone manages a contiguous range of physical memory. Free blocks of
+ * 2^order frames are kept in one list per order. Because the physical
+ * memory isn't mapped into the kernel address space, the links of these
+ * lists are not stored in the free frames. Instead, each zone owns a small
+ * array of descriptors with one entry per frame.
+ */
+
+#ifndef __PAGE_ZONE_H__
+#define __PAGE_ZONE_H__
+
+#include <hermit/stddef.h>
+#include <hermit/spinlock_types.h>
+#include <asm/page.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Largest block of a zone (2^ZONE_MAX_ORDER frames = 1 GiB)
+#define ZONE_MAX_ORDER	18
+/// Number of free lists
+#define ZONE_ORDERS	(ZONE_MAX_ORDER + 1)
+
+/** @brief Descriptor of a page frame
+ *
+ * Only the first frame of a free block uses its links.
+ */
+typedef struct page_frame {
+	/// Index of the next free block with the same order
+	uint32_t next;
+	/// Index of the previous free block with the same order
+	uint32_t prev;
+} page_frame_t;
+
+/** @brief Physical memory zone */
+typedef struct page_zone {
+	/// Physical address of the first frame, aligned to the largest block
+	size_t base;
+	/// Number of frames, which are described by this zone
+	size_t nframes;
+	/// Number of free frames
+	size_t nr_free;
+	/// Heads of the free lists
+	uint32_t free_lists[ZONE_ORDERS];
+	/// One descriptor per frame
+	page_frame_t* frames;
+	/// order+1, if the frame starts a free block of 2^order frames
+	uint8_t* orders;
+	/// Lock to protect the free lists
+	spinlock_irqsave_t lock;
+} page_zone_t;
+
+/** @brief Size of the metadata to describe the physical range [start, end) */
+size_t page_zone_meta_size(size_t start, size_t end);
+
+/** @brief Initialize a zone for the physical range [start, end)
+ *
+ * Initially, all frames are marked as used. Use page_zone_free() to
+ * hand out free memory to the zone.
+ *
+ * @param zone Zone to initialize
+ * @param start Physical start address
+ * @param end Physical end address
+ * @param meta Memory of at least page_zone_meta_size() bytes
+ */
+void page_zone_init(page_zone_t* zone, size_t start, size_t end, void* meta);
+
+/** @brief Check if a physical address is described by the zone */
+static inline int page_zone_contains(page_zone_t* zone, size_t phyaddr)
+{
+	return (zone->nframes && (phyaddr >= zone->base)
+		&& (((phyaddr - zone->base) >> PAGE_BITS) < zone->nframes));
+}
+
+/** @brief Allocate contiguous page frames
+ *
+ * @return
+ * - physical address of the first frame
+ * - 0 on failure
+ */
+size_t page_zone_alloc(page_zone_t* zone, size_t npages);
+
+/** @brief Release contiguous page frames
+ *
+ * The range doesn't need to be identical to a previous allocation.
+ * Neighbouring free blocks are merged.
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the range isn't part of the zone
+ */
+int page_zone_free(page_zone_t* zone, size_t phyaddr, size_t npages);
+
+/** @brief Allocate up to n single frames with one lock acquisition
+ *
+ * @return Number of frames stored in the array
+ */
+size_t page_zone_alloc_frames(page_zone_t* zone, size_t* frames, size_t n);
+
+/** @brief Release n single frames with one lock acquisition */
+void page_zone_free_frames(page_zone_t* zone, size_t* frames, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @author Stefan Lankes
+ * @file include/hermit/ring.h
+ * @brief Lock-free bounded rings
+ *
+ * The macros generate typed functions for the rings of ring_types.h.
+ * Push functions return the number of stored entries, pop functions the
+ * number of fetched entries. Both never block.
+ */
+
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <hermit/stddef.h>
+#include <hermit/errno.h>
+#include <hermit/ring_types.h>
+#include <asm/atomic.h>
+#include <asm/processor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RING_SPSC(name, type, size) \
+	inline static int ring_spsc_##name##_init(ring_spsc_##name##_t* r) { \
+		if (BUILTIN_EXPECT(!r, 0)) \
+			return -EINVAL; \
+	\
+		r->head = r->tail = 0; \
+	\
+		return 0; \
+	} \
+	\
+	inline static uint32_t ring_spsc_##name##_push_n(ring_spsc_##name##_t* r, type const* v, uint32_t n) { \
+		const uint32_t tail = r->tail; \
+		uint32_t i, free = (size) - (tail - r->head); \
+	\
+		if (n > free) \
+			n = free; \
+		for(i=0; i<n; i++) \
+			r->buffer[(tail + i) & ((size) - 1)] = v[i]; \
+		/* the entries have to be written before they are published */ \
+		cmb(); \
+		r->tail = tail + n; \
+	\
+		return n; \
+	} \
+	\
+	inline static uint32_t ring_spsc_##name##_pop_n(ring_spsc_##name##_t* r, type* v, uint32_t n) { \
+		const uint32_t head = r->head; \
+		uint32_t i, used = r->tail - head; \
+	\
+		if (n > used) \
+			n = used; \
+		cmb(); \
+		for(i=0; i<n; i++) \
+			v[i] = r->buffer[(head + i) & ((size) - 1)]; \
+		cmb(); \
+		r->head = head + n; \
+	\
+		return n; \
+	} \
+	\
+	inline static int ring_spsc_##name##_push(ring_spsc_##name##_t* r, type v) { \
+		return ring_spsc_##name##_push_n(r, &v, 1) ? 0 : -EOVERFLOW; \
+	} \
+	\
+	inline static int ring_spsc_##name##_pop(ring_spsc_##name##_t* r, type* v) { \
+		return ring_spsc_##name##_pop_n(r, v, 1) ? 0 : -ENOENT; \
+	}
+
+#define RING_MPSC(name, type, size) \
+	inline static int ring_mpsc_##name##_init(ring_mpsc_##name##_t* r) { \
+		uint32_t i; \
+	\
+		if (BUILTIN_EXPECT(!r, 0)) \
+			return -EINVAL; \
+	\
+		atomic_int32_set(&r->tail, 0); \
+		r->head = 0; \
+		for(i=0; i<(size); i++) \
+			r->slots[i].seq = i; \
+	\
+		return 0; \
+	} \
+	\
+	inline static uint32_t ring_mpsc_##name##_push_n(ring_mpsc_##name##_t* r, type const* v, uint32_t n) { \
+		uint32_t pos, i; \
+	\
+		do { \
+			pos = (uint32_t) atomic_int32_read(&r->tail); \
+			/* the consumer frees the slots in order => count the free slots behind tail */ \
+			for(i=0; (i<n) && (r->slots[(pos + i) & ((size) - 1)].seq == pos + i); i++) \
+				; \
+			if (!i) \
+				return 0; \
+		} while (atomic_int32_cmpxchg(&r->tail, (int32_t) pos, (int32_t) (pos + i)) != (int32_t) pos); \
+	\
+		n = i; \
+		for(i=0; i<n; i++) { \
+			r->slots[(pos + i) & ((size) - 1)].data = v[i]; \
+			cmb(); \
+			r->slots[(pos + i) & ((size) - 1)].seq = pos + i + 1; \
+		} \
+	\
+		return n; \
+	} \
+	\
+	inline static uint32_t ring_mpsc_##name##_pop_n(ring_mpsc_##name##_t* r, type* v, uint32_t n) { \
+		uint32_t head = r->head; \
+		uint32_t i; \
+	\
+		for(i=0; i<n; i++, head++) { \
+			if (r->slots[head & ((size) - 1)].seq != head + 1) \
+				break; \
+			cmb(); \
+			v[i] = r->slots[head & ((size) - 1)].data; \
+			cmb(); \
+			r->slots[head & ((size) - 1)].seq = head + (size); \
+		} \
+		r->head = head; \
+	\
+		return i; \
+	} \
+	\
+	inline static int ring_mpsc_##name##_push(ring_mpsc_##name##_t* r, type v) { \
+		return ring_mpsc_##name##_push_n(r, &v, 1) ? 0 : -EOVERFLOW; \
+	} \
+	\
+	inline static int ring_mpsc_##name##_pop(ring_mpsc_##name##_t* r, type* v) { \
+		return ring_mpsc_##name##_pop_n(r, v, 1) ? 0 : -ENOENT; \
+	}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
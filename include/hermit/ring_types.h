@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @author Stefan Lankes
+ * @file include/hermit/ring_types.h
+ * @brief Type definitions of the lock-free rings
+ *
+ * The rings are bounded and their size has to be a power of two. The
+ * indices run freely and are masked on access. The producer and consumer
+ * side are placed on separate cache lines.
+ */
+
+#ifndef __RING_TYPES_H__
+#define __RING_TYPES_H__
+
+#include <hermit/stddef.h>
+#include <asm/atomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Ring with a single producer and a single consumer */
+#define RING_SPSC_TYPES(name, type, size) \
+	typedef struct ring_spsc_##name { \
+		/* next entry to write, only changed by the producer */ \
+		volatile uint32_t tail __attribute__ ((aligned (CACHE_LINE))); \
+		/* next entry to read, only changed by the consumer */ \
+		volatile uint32_t head __attribute__ ((aligned (CACHE_LINE))); \
+		type buffer[size] __attribute__ ((aligned (CACHE_LINE))); \
+	} ring_spsc_##name##_t;
+
+/** @brief Ring with multiple producers and a single consumer
+ *
+ * Each slot has a sequence number. The slot at position pos is free,
+ * if the sequence is pos, and it contains a message, if the sequence
+ * is pos+1. Producers reserve slots by a cmpxchg on tail.
+ */
+#define RING_MPSC_TYPES(name, type, size) \
+	typedef struct ring_mpsc_##name { \
+		/* next entry to reserve, shared by all producers */ \
+		atomic_int32_t tail __attribute__ ((aligned (CACHE_LINE))); \
+		/* next entry to read, only changed by the consumer */ \
+		uint32_t head __attribute__ ((aligned (CACHE_LINE))); \
+		struct { \
+			volatile uint32_t seq; \
+			type data; \
+		} slots[size] __attribute__ ((aligned (CACHE_LINE))); \
+	} ring_mpsc_##name##_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
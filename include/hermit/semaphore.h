@@ -113,73 +113,135 @@ inline static int sem_trywait(sem_t* s)
 	return ret;
 }
 
-/** @brief Blocking wait for semaphore
+/** @brief Search a waiter in the queue of the semaphore
+ *
+ * Has to be called with the lock of the semaphore.
+ *
+ * @return Position in the queue or MAX_TASKS, if sem_post has dequeued the task
+ */
+inline static unsigned int sem_find(sem_t* s, tid_t id)
+{
+	unsigned int pos;
+
+	for(pos=s->rpos; pos!=s->wpos; pos=(pos + 1) % MAX_TASKS) {
+		if (s->queue[pos] == id)
+			return pos;
+	}
+
+	return MAX_TASKS;
+}
+
+/** @brief Remove a waiter from the queue of the semaphore
+ *
+ * Has to be called with the lock of the semaphore.
+ */
+inline static void sem_dequeue(sem_t* s, tid_t id)
+{
+	unsigned int pos = sem_find(s, id);
+	unsigned int next;
+
+	if (pos >= MAX_TASKS)
+		return;
+
+	// close the gap to keep the order of the other waiters
+	for(next=(pos + 1) % MAX_TASKS; next!=s->wpos; pos=next, next=(next + 1) % MAX_TASKS)
+		s->queue[pos] = s->queue[next];
+	s->queue[pos] = MAX_TASKS;
+	s->wpos = pos;
+}
+
+/** @brief Wait for semaphore until the TSC reaches a deadline
+ *
+ * The task is queued only once. A timer, which expires before the
+ * deadline, is just armed again.
  *
  * @param s Address of the according sem_t structure
- * @param ms Timeout in milliseconds
+ * @param tsc TSC value, at which the wait is aborted
  * @return
  * - 0 on success
  * - -EINVAL on invalid argument
  * - -ETIME on timer expired
  */
-inline static int sem_wait(sem_t* s, uint32_t ms)
+inline static int sem_wait_until(sem_t* s, uint64_t tsc)
 {
 	task_t* curr_task = per_core(current_task);
+	int ret = 0;
 
 	if (BUILTIN_EXPECT(!s, 0))
 		return -EINVAL;
 
-	if (!ms) {
-next_try1:
+	spinlock_irqsave_lock(&s->lock);
+	if (s->value > 0) {
+		s->value--;
+		goto out;
+	}
+
+	s->queue[s->wpos] = curr_task->id;
+	s->wpos = (s->wpos + 1) % MAX_TASKS;
+
+	while (1) {
+		if (get_rdtsc() >= tsc) {
+			ret = -ETIME;
+			break;
+		}
+
+		set_hrtimer(tsc);
+		spinlock_irqsave_unlock(&s->lock);
+		reschedule();
 		spinlock_irqsave_lock(&s->lock);
+
 		if (s->value > 0) {
 			s->value--;
-			spinlock_irqsave_unlock(&s->lock);
-		} else {
+			break;
+		}
+
+		// sem_post has dequeued the task, but another task got the resource
+		if (sem_find(s, curr_task->id) >= MAX_TASKS) {
 			s->queue[s->wpos] = curr_task->id;
 			s->wpos = (s->wpos + 1) % MAX_TASKS;
-			block_current_task();
-			spinlock_irqsave_unlock(&s->lock);
-			reschedule();
-			goto next_try1;
-		}
-	} else {
-		uint32_t ticks = (ms * TIMER_FREQ) / 1000;
-		uint32_t remain = (ms * TIMER_FREQ) % 1000;
-
-		if (ticks) {
-			uint64_t deadline = get_clock_tick() + ticks;
-
-next_try2:
-			spinlock_irqsave_lock(&s->lock);
-			if (s->value > 0) {
-				s->value--;
-				spinlock_irqsave_unlock(&s->lock);
-				return 0;
-			} else {
-				if (get_clock_tick() >= deadline) {
-					spinlock_irqsave_unlock(&s->lock);
-					goto timeout;
-				}
-				s->queue[s->wpos] = curr_task->id;
-				s->wpos = (s->wpos + 1) % MAX_TASKS;
-				set_timer(deadline);
-				spinlock_irqsave_unlock(&s->lock);
-				reschedule();
-				goto next_try2;
-			}
 		}
+	}
 
-timeout:
-		while (remain) {
-			udelay(1000);
-			remain--;
+	// a wakeup by the timer keeps the task in the queue
+	sem_dequeue(s, curr_task->id);
 
-			if (!sem_trywait(s))
-				return 0;
-		}
+out:
+	spinlock_irqsave_unlock(&s->lock);
+
+	return ret;
+}
+
+/** @brief Blocking wait for semaphore
+ *
+ * @param s Address of the according sem_t structure
+ * @param ms Timeout in milliseconds
+ * @return
+ * - 0 on success
+ * - -EINVAL on invalid argument
+ * - -ETIME on timer expired
+ */
+inline static int sem_wait(sem_t* s, uint32_t ms)
+{
+	task_t* curr_task = per_core(current_task);
 
-		return -ETIME;
+	if (BUILTIN_EXPECT(!s, 0))
+		return -EINVAL;
+
+	if (ms)
+		return sem_wait_until(s, get_rdtsc() + (uint64_t) ms * 1000ULL * (uint64_t) get_cpu_frequency());
+
+next_try:
+	spinlock_irqsave_lock(&s->lock);
+	if (s->value > 0) {
+		s->value--;
+		spinlock_irqsave_unlock(&s->lock);
+	} else {
+		s->queue[s->wpos] = curr_task->id;
+		s->wpos = (s->wpos + 1) % MAX_TASKS;
+		block_current_task();
+		spinlock_irqsave_unlock(&s->lock);
+		reschedule();
+		goto next_try;
 	}
 
 	return 0;
@@ -45,7 +45,7 @@ extern "C" {
 
 typedef void (*signal_handler_t)(int);
 
-// This is used in deqeue.h (HACK)
+// This is used by the signal queue
 typedef struct _sig {
 	tid_t dest;
 	int signum;
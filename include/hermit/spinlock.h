@@ -47,6 +47,24 @@
 extern "C" {
 #endif
 
+/// Lock bit of a queued lock, the upper bits hold the tail of the queue
+#define SPINLOCK_QUEUED_LOCKED	1
+
+/** @brief Wait for a ticket lock (contended path) */
+void spinlock_ticket_wait(spinlock_irqsave_t* s, int64_t ticket);
+
+/** @brief Enqueue the current core and wait for a queued lock (contended path) */
+void spinlock_queued_wait(spinlock_irqsave_t* s);
+
+/** @brief Account the acquisition of a lock with statistics */
+void lock_stats_acquired(spinlock_irqsave_t* s);
+
+/** @brief Account the hold time of a lock with statistics */
+void lock_stats_released(spinlock_irqsave_t* s);
+
+/** @brief Print the statistics of all locks, which have been used */
+void print_lock_stats(void);
+
 /** @brief Initialization of a spinlock
  *
  * Initialize each spinlock before use!
@@ -146,10 +164,35 @@ inline static int spinlock_irqsave_init(spinlock_irqsave_t* s) {
 	s->flags = 0;
 	s->coreid = (uint32_t)-1;
 	s->counter = 0;
+	s->mode = SPINLOCK_TICKET;
+	s->stats = NULL;
+	s->hold_start = 0;
 
 	return 0;
 }
 
+/** @brief Initialization of a queued irqsave spinlock
+ *
+ * Each waiter spins on a node of its own core instead of the
+ * shared lock word. Use it for heavily contended locks.
+ *
+ * @param s Pointer to the spinlock structure to initialize
+ * @param stats Optional statistics, which may be shared by several locks
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int spinlock_irqsave_init_queued(spinlock_irqsave_t* s, lock_stats_t* stats) {
+	int ret = spinlock_irqsave_init(s);
+
+	if (!ret) {
+		s->mode = SPINLOCK_QUEUED;
+		s->stats = stats;
+	}
+
+	return ret;
+}
+
 /** @brief Destroy irqsave spinlock after use
  * @return
  * - 0 on success
@@ -184,15 +227,24 @@ inline static int spinlock_irqsave_lock(spinlock_irqsave_t* s) {
 		return 0;
 	}
 
-	ticket = atomic_int64_inc(&s->queue);
-	while (atomic_int64_read(&s->dequeue) != ticket) {
-		PAUSE;
+	if (s->mode == SPINLOCK_QUEUED) {
+		if (BUILTIN_EXPECT(atomic_int64_cmpxchg(&s->queue, 0, SPINLOCK_QUEUED_LOCKED) != 0, 0))
+			spinlock_queued_wait(s);
+	} else {
+		ticket = atomic_int64_inc(&s->queue);
+		if (BUILTIN_EXPECT(atomic_int64_read(&s->dequeue) != ticket, 0))
+			spinlock_ticket_wait(s, ticket);
 	}
 
 	s->coreid = CORE_ID;
 	s->flags = flags;
 	s->counter = 1;
 
+#ifdef LOCK_STATS
+	if (s->stats)
+		lock_stats_acquired(s);
+#endif
+
 	return 0;
 }
 
@@ -209,11 +261,19 @@ inline static int spinlock_irqsave_unlock(spinlock_irqsave_t* s) {
 
 	s->counter--;
 	if (!s->counter) {
+#ifdef LOCK_STATS
+		if (s->stats)
+			lock_stats_released(s);
+#endif
+
 		flags = s->flags;
 		s->coreid = (uint32_t) -1;
 		s->flags = 0;
 
-		atomic_int64_inc(&s->dequeue);
+		if (s->mode == SPINLOCK_QUEUED)
+			atomic_int64_dec(&s->queue);
+		else
+			atomic_int64_inc(&s->dequeue);
 
 		irq_nested_enable(flags);
 	}
@@ -53,8 +53,45 @@ typedef struct spinlock {
 	uint32_t counter;
 } spinlock_t;
 
+/// Waiters take a ticket and spin on the shared dequeue counter
+#define SPINLOCK_TICKET		0
+/// Waiters are queued and each one spins on its own per-core node
+#define SPINLOCK_QUEUED		1
+
+/// Number of queue nodes per core (waiting is only possible with disabled interrupts)
+#define SPINLOCK_QUEUE_NODES	2
+
+/** @brief Queue node of a core, which waits for a queued lock */
+typedef struct spinlock_node {
+	/// next waiter in the queue
+	struct spinlock_node* volatile next;
+	/// cleared by the predecessor, if the node is the head of the queue
+	volatile uint32_t wait;
+} __attribute__ ((aligned (CACHE_LINE))) spinlock_node_t;
+
+/** @brief Contention statistics of one or more locks
+ *
+ * The statistics are only collected, if the kernel is built with LOCK_STATS.
+ */
+typedef struct lock_stats {
+	/// name, which is used by print_lock_stats
+	const char* name;
+	/// number of acquisitions
+	atomic_int64_t acquisitions;
+	/// number of acquisitions, which had to wait
+	atomic_int64_t contended;
+	/// cycles, which are spent while waiting for the lock
+	atomic_int64_t spin_cycles;
+	/// longest hold time in cycles
+	atomic_int64_t max_hold;
+	/// set, if the statistics are part of the list of all statistics
+	atomic_int32_t registered;
+	/// next entry in the list of all statistics
+	struct lock_stats* next;
+} lock_stats_t;
+
 typedef struct spinlock_irqsave {
-	/// Internal queue
+	/// Internal queue (lock word of a queued lock)
 	atomic_int64_t queue;
 	/// Internal dequeue
 	atomic_int64_t dequeue;
@@ -64,12 +101,22 @@ typedef struct spinlock_irqsave {
 	uint32_t counter;
 	/// Interrupt flag
 	uint8_t flags;
+	/// SPINLOCK_TICKET or SPINLOCK_QUEUED
+	uint8_t mode;
+	/// optional contention statistics
+	lock_stats_t* stats;
+	/// TSC value of the last acquisition
+	uint64_t hold_start;
 } spinlock_irqsave_t;
 
 /// Macro for spinlock initialization
 #define SPINLOCK_INIT { ATOMIC_INIT(0), ATOMIC_INIT(1), MAX_TASKS, 0}
 /// Macro for irqsave spinlock initialization
-#define SPINLOCK_IRQSAVE_INIT { ATOMIC_INIT(0), ATOMIC_INIT(1), (uint32_t)-1, 0, 0}
+#define SPINLOCK_IRQSAVE_INIT { ATOMIC_INIT(0), ATOMIC_INIT(1), (uint32_t)-1, 0, 0, SPINLOCK_TICKET, NULL, 0}
+/// Macro for the initialization of a queued irqsave spinlock with optional statistics
+#define SPINLOCK_IRQSAVE_QUEUED_INIT(s) { ATOMIC_INIT(0), ATOMIC_INIT(1), (uint32_t)-1, 0, 0, SPINLOCK_QUEUED, s, 0}
+/// Macro for the initialization of lock statistics
+#define LOCK_STATS_INIT(n) { n, ATOMIC_INIT(0), ATOMIC_INIT(0), ATOMIC_INIT(0), ATOMIC_INIT(0), ATOMIC_INIT(0), NULL}
 
 #ifdef __cplusplus
 }
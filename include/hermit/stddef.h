@@ -65,6 +65,10 @@ extern const size_t image_size;
 #define UHYVE_PORT_READ		0x502
 #define UHYVE_PORT_EXIT		0x503
 #define UHYVE_PORT_LSEEK	0x504
+#define UHYVE_PORT_RINGINIT	0x509
+#define UHYVE_PORT_DOORBELL	0x50A
+#define UHYVE_PORT_READV	0x50B
+#define UHYVE_PORT_WRITEV	0x50C
 
 #define BUILTIN_EXPECT(exp, b)		__builtin_expect((exp), (b))
 //#define BUILTIN_EXPECT(exp, b)	(exp)
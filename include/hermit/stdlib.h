@@ -62,6 +62,13 @@ void NORETURN do_abort(void);
  */
 void* palloc(size_t sz, uint32_t flags);
 
+/** @brief Release memory, which is allocated by palloc()
+ *
+ * @param addr Pointer to the memory range
+ * @param sz Size of the memory range
+ */
+void pfree(void* addr, size_t sz);
+
 /** @brief The memory allocator function
  *
  * This allocator uses a buddy system to allocate memory.
@@ -79,6 +86,17 @@ void* create_stack(size_t sz);
  */
 int destroy_stack(void* addr, size_t sz);
 
+/** @brief Create a stack with guard pages, which is populated on demand
+ *
+ * Only the upper mapped bytes are backed by page frames. The
+ * remaining pages are mapped by the page fault handler.
+ */
+void* create_lazy_stack(size_t sz, size_t mapped);
+
+/** @brief Destroy a stack created by create_lazy_stack()
+ */
+int destroy_lazy_stack(void* addr, size_t sz);
+
 /** @brief Release memory back to the buddy system
  *
  * Every block of memory allocated by kmalloc() is prefixed with a buddy_t
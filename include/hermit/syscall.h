@@ -73,19 +73,41 @@ int sys_setprio(tid_t* id, int prio);
 void NORETURN sys_exit(int arg);
 ssize_t sys_read(int fd, char* buf, size_t len);
 ssize_t sys_write(int fd, const char* buf, size_t len);
+ssize_t sys_pread(int fd, char* buf, size_t len, off_t offset);
+ssize_t sys_pwrite(int fd, const char* buf, size_t len, off_t offset);
 ssize_t sys_sbrk(ssize_t incr);
+ssize_t sys_sbrk_populate(ssize_t incr, int zero);
 int sys_open(const char* name, int flags, int mode);
 int sys_close(int fd);
 void sys_msleep(unsigned int ms);
+int sys_nanosleep(uint64_t ns);
+int sys_clock_nanosleep(uint64_t deadline);
+uint64_t sys_clock_gettime_ns(void);
 int sys_sem_init(sem_t** sem, unsigned int value);
 int sys_sem_destroy(sem_t* sem);
 int sys_sem_wait(sem_t* sem);
 int sys_sem_post(sem_t* sem);
 int sys_sem_timedwait(sem_t *sem, unsigned int ms);
+int sys_sem_timedwait_ns(sem_t *sem, uint64_t ns);
 int sys_sem_cancelablewait(sem_t* sem, unsigned int ms);
+int sys_futex_wait(int32_t* addr, int32_t val, uint64_t ns);
+int sys_futex_wake(int32_t* addr, int32_t count);
 int sys_clone(tid_t* id, void* ep, void* argv);
 off_t sys_lseek(int fd, off_t offset, int whence);
 size_t sys_get_ticks(void);
+void sys_heap_stats(size_t* faults, size_t* huge_faults);
+void sys_zero_pool_resize(size_t npages);
+void sys_zero_pool_stats(size_t* depth, size_t* hits, size_t* misses, size_t* refills);
+int sys_net_queue_stats(uint32_t queue, size_t* rx_packets, size_t* rx_bytes, size_t* tx_packets, size_t* tx_bytes, size_t* drops);
+int sys_sched_stats(uint32_t core_id, size_t* migrated_in, size_t* migrated_out);
+int sys_sched_usage(tid_t* id, uint64_t* run_ns, uint64_t* wait_ns, uint64_t* nvcsw, uint64_t* nivcsw);
+int sys_getrusage(int who, /*struct rusage *usage*/ void* usage);
+int sys_sched_setaffinity(tid_t* id, size_t size, const void* mask);
+int sys_sched_getaffinity(tid_t* id, size_t size, void* mask);
+int sys_sched_isolate(int32_t core_id);
+int sys_sched_unisolate(void);
+int sys_sched_setdeadline(uint64_t runtime_ns, uint64_t period_ns);
+int sys_sched_wait_period(void);
 int sys_rcce_init(int session_id);
 size_t sys_rcce_malloc(int session_id, int ue);
 int sys_rcce_fini(int session_id);
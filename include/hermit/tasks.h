@@ -70,6 +70,18 @@ size_t** scheduler(void);
  */
 int multitasking_init(void);
 
+/** @brief Allocate the task table
+ *
+ * The number of task structures is derived from the memory size
+ * (or set by "-maxtasks=N") and limited by MAX_TASKS. Has to be
+ * called after memory_init() and before the other cores are booted.
+ *
+ * @return
+ * - 0 on success
+ * - -ENOMEM (-12) on failure
+ */
+int task_table_init(void);
+
 
 /** @brief Clone current task with a specific entry point
  *
@@ -175,6 +187,14 @@ int wakeup_task(tid_t);
  */
 void wakeup_core(uint32_t core_id);
 
+/** @brief Interrupt a core, which has to reprogram its timer
+ *
+ * In contrast to wakeup_core(), the IPI is also sent to a busy core.
+ *
+ * @param core_id Specifies the core
+ */
+void notify_core(uint32_t core_id);
+
 /** @brief Block current task
  *
  * The current task's status will be changed to TASK_BLOCKED
@@ -187,9 +207,20 @@ int block_current_task(void);
 
 /** @brief Block task until a new arrived
  *
+ * Depending on the idle mode, the core polls its ready queue for a
+ * while before it sleeps with MWAIT or HLT.
  */
 void wait_for_task(void);
 
+/** @brief Select the idle mode and initialize the idle governor */
+void idle_init(void);
+
+/** @brief Set the length of a round robin time slice (HERMIT_TIMESLICE or "-timeslice=") */
+void timeslice_init(void);
+
+/** @brief Print the idle residency and wakeup latencies per core */
+void print_idle_stats(void);
+
 /** @brief Get readyqueue of the current core
  *
  * @return
@@ -219,6 +250,19 @@ int get_task(tid_t id, task_t** task);
  */
 int set_timer(uint64_t deadline);
 
+/** @brief Block current task until a TSC deadline expires
+ *
+ * Distant deadlines are handled by the timer wheel, which may wake up
+ * the task a little bit earlier. Therefore, the caller has to check the
+ * deadline again after the reschedule.
+ *
+ * @param tsc TSC value, at which the timer expires
+ * @return
+ *  - 0 on success
+ *  - -EINVAL (-22) on failure
+ */
+int set_hrtimer(uint64_t tsc);
+
 
 /** @brief check is a timer is expired
  *
@@ -238,6 +282,133 @@ void NORETURN leave_kernel_task(void);
  */
 void check_scheduling(void);
 
+/** @brief Balance the load between the cores
+ *
+ * An idle core pulls a ready task from the busiest core. A busy core
+ * does this periodically and wakes up an idle core, if it's overloaded.
+ */
+void check_balance(void);
+
+/** @brief Print the number of migrated tasks per core */
+void print_sched_stats(void);
+
+/** @brief Number of tasks moved by the load balancer
+ *
+ * @param core_id Core of interest
+ * @param migrated_in Number of tasks, which the core has pulled
+ * @param migrated_out Number of tasks, which other cores have pulled from it
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the core isn't available
+ */
+int sched_stats(uint32_t core_id, size_t* migrated_in, size_t* migrated_out);
+
+/** @brief CPU time accounting of a task
+ *
+ * Tasks with the same priority share a core in time slices of
+ * HERMIT_TIMESLICE microseconds (default one clock tick).
+ *
+ * @param id Task of interest
+ * @param run_ns Time on the CPU
+ * @param wait_ns Time in a ready queue
+ * @param nvcsw Number of task switches, because the task blocked
+ * @param nivcsw Number of task switches, because the task was preempted
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on invalid task
+ */
+int task_usage(tid_t id, uint64_t* run_ns, uint64_t* wait_ns, uint64_t* nvcsw, uint64_t* nivcsw);
+
+/** @brief CPU time of all tasks including the finished ones (in ns)
+ *
+ * The time of the idle tasks isn't included.
+ */
+uint64_t total_run_time(void);
+
+/** @brief Give the current task a core exclusively
+ *
+ * The task moves to the core and other ready tasks leave it. Afterwards,
+ * neither new tasks nor the load balancer use the core. With DYNAMIC_TICKS,
+ * the core receives only the timer interrupts of its owner.
+ *
+ * @param core_id Core, which the task owns afterwards
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the core isn't available
+ * - -EBUSY (-16) if the core is owned by another task or if no other core is left
+ */
+int isolate_task(uint32_t core_id);
+
+/** @brief Release the core, which the current task owns exclusively
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the task doesn't own its core
+ */
+int unisolate_task(void);
+
+/** @brief Restrict a task to a set of cores
+ *
+ * The mask contains one bit per core, bit i of byte j describes core 8*j+i.
+ * The current task moves immediately to an allowed core, other tasks move
+ * when they are woken up the next time. The load balancer respects the mask.
+ *
+ * @param id Task id
+ * @param mask Bit mask of allowed cores
+ * @param size Size of the mask in bytes
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the task is invalid or the mask contains no online core
+ * - -EBUSY (-16) if the mask excludes the core of a deadline task or of an isolated task
+ */
+int set_task_affinity(tid_t id, const void* mask, size_t size);
+
+/** @brief Get the online cores, on which a task is allowed to run
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on invalid task
+ */
+int get_task_affinity(tid_t id, void* mask, size_t size);
+
+/** @brief Change the priority of a task at runtime
+ *
+ * A task, which is queued on a ready queue, gets the new priority
+ * the next time it's queued.
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on invalid task or priority or if the task is a deadline task
+ */
+int set_task_prio(tid_t id, uint8_t prio);
+
+/** @brief Turn the current task into a periodic deadline task
+ *
+ * Deadline tasks run with REALTIME_PRIO in front of all other tasks
+ * of this priority and are ordered by their deadlines (EDF). The deadline
+ * is the end of the current period. The runtime is only used for the
+ * admission control, the bandwidth of all deadline tasks on a core is
+ * limited to 95%. Deadline tasks stay on their core.
+ *
+ * @param runtime_ns Runtime per period, 0 to return to the normal class
+ * @param period_ns Period of the task
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the runtime exceeds the period
+ * - -EBUSY (-16) if the core doesn't have enough bandwidth left
+ */
+int set_task_deadline(uint64_t runtime_ns, uint64_t period_ns);
+
+/** @brief Finish the current period of a deadline task
+ *
+ * The task sleeps until the begin of the next period.
+ *
+ * @return
+ * - number of missed deadlines
+ * - -EINVAL (-22) if the current task isn't a deadline task
+ */
+int wait_next_period(void);
+
 /** @brief This function shutdowns the (ip) network
  */
 int network_shutdown(void);
@@ -263,6 +434,7 @@ static inline void check_workqueues_in_irqhandler(int irq)
 #endif
 
 	check_timers();
+	check_balance();
 
 	if (go_down)
 		shutdown_system();
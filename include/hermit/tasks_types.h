@@ -59,6 +59,22 @@ extern "C" {
 #define TASK_FPU_INIT		(1 << 0)
 #define TASK_FPU_USED		(1 << 1)
 #define TASK_TIMER		(1 << 2)
+#define TASK_MIGRATE		(1 << 3)
+
+/// Tasks of the default class are scheduled round-robin per priority
+#define SCHED_NORMAL	0
+/// Periodic tasks, which run with REALTIME_PRIO in the order of their deadlines
+#define SCHED_DEADLINE	1
+
+/// Number of 64-bit words of a mask with one bit per core
+#define AFFINITY_WORDS	((MAX_CORES + 63) / 64)
+
+/// Number of bits of a slot index of the timer wheels
+#define TIMER_WHEEL_BITS	6
+/// Number of slots per timer wheel
+#define TIMER_WHEEL_SIZE	(1 << TIMER_WHEEL_BITS)
+/// Number of timer wheels per core, the last one covers 2^18 ticks
+#define TIMER_WHEEL_LEVELS	3
 
 #define MAX_PRIO	31
 #define REALTIME_PRIO	31
@@ -87,12 +103,28 @@ typedef struct task {
 	uint8_t			flags;
 	/// Task priority
 	uint8_t			prio;
-	/// timeout for a blocked task
+	/// Scheduling class (SCHED_NORMAL, SCHED_DEADLINE)
+	uint8_t			policy;
+	/// Priority, which is applied when the task is queued the next time
+	uint8_t			new_prio;
+	/// timeout for a blocked task (clock tick or TSC value of a high-resolution timer)
 	uint64_t		timeout;
+	/// head of the timer wheel slot, which holds the task
+	struct task**		timer_slot;
 	/// starting time/tick of the task
 	uint64_t		start_tick;
 	/// last TSC, when the task got the CPU
 	uint64_t		last_tsc;
+	/// TSC, when the task was queued in a ready queue
+	uint64_t		ready_tsc;
+	/// time on the CPU (in cycles)
+	uint64_t		run_cycles;
+	/// time in a ready queue (in cycles)
+	uint64_t		wait_cycles;
+	/// number of task switches, because the task blocked
+	uint64_t		nvcsw;
+	/// number of task switches, because the task was preempted
+	uint64_t		nivcsw;
 	/// the userspace heap
 	vma_t*			heap;
 	/// parent thread
@@ -109,6 +141,18 @@ typedef struct task {
 	int		lwip_err;
 	/// Handler for (POSIX) Signals
 	signal_handler_t signal_handler;
+	/// Runtime of a deadline task per period (in cycles)
+	uint64_t		dl_runtime;
+	/// Period of a deadline task (in cycles)
+	uint64_t		dl_period;
+	/// Absolute deadline of the current period (TSC)
+	uint64_t		dl_deadline;
+	/// Number of missed deadlines
+	uint64_t		dl_misses;
+	/// Page for the segment lists of uhyve's vectored I/O
+	void*			uhyve_segs;
+	/// Cores, on which the task is allowed to run
+	uint64_t		affinity[AFFINITY_WORDS];
 	/// FPU state
 	union fpu_state	fpu;
 } task_t;
@@ -118,6 +162,34 @@ typedef struct {
         task_t* last;
 } task_list_t;
 
+/** @brief Hierarchical timing wheel of a core
+ *
+ * A slot of level L covers 2^(L*TIMER_WHEEL_BITS) clock ticks. A timer
+ * is stored in the lowest level, which covers its distance to the
+ * current tick, and moves down to the lower levels as time passes.
+ * Insertion and cancellation are O(1). The slots are linked by the
+ * next/prev pointers of the tasks.
+ *
+ * Sleeps shorter than a few ticks are kept in a separate list, which
+ * stores the deadline as TSC value and is not counted in count.
+ */
+typedef struct {
+	/// last processed clock tick
+	uint64_t	tick;
+	/// number of pending timers
+	uint32_t	count;
+	/// indicates the used slots of each level
+	uint64_t	bitmap[TIMER_WHEEL_LEVELS];
+	/// heads of the slots
+	task_t*		slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+	/// timers beyond the last level
+	task_t*		overflow;
+	/// timers with a TSC deadline, sorted by their expiry
+	task_t*		hrtimers;
+	/// end of the time slice of the current task (TSC, 0 = no other task to share the core)
+	uint64_t	slice_end;
+} timer_wheel_t;
+
 /** @brief Represents a queue for all runable tasks */
 typedef struct {
 	/// idle task
@@ -130,15 +202,34 @@ typedef struct {
 	uint32_t	nr_tasks;
 	/// indicates the used priority queues
 	uint32_t	prio_bitmap;
+	/// written by other cores to ask an idle core to look for work
+	volatile uint32_t balance_kick;
 	/// a queue for each priority
 	task_list_t	queue[MAX_PRIO];
-	/// a queue for timers
-	task_list_t     timers;
+	/// pending timers
+	timer_wheel_t	timers;
 	/// lock for this runqueue
 	spinlock_irqsave_t lock;
+	/// clock tick of the last periodic load balancing
+	uint64_t	last_balance;
+	/// number of tasks, which this core has pulled from other cores
+	uint64_t	migrated_in;
+	/// number of tasks, which other cores have pulled from this core
+	uint64_t	migrated_out;
+	/// task, which owns this core exclusively
+	task_t*		isolated;
+	/// bandwidth reserved by deadline tasks (1 << DL_BW_SHIFT = 100%)
+	uint64_t	dl_bandwidth;
 } readyqueues_t;
 
 
+/** @brief Check if a task is allowed to run on a core */
+static inline int task_affinity_isset(const task_t* task, uint32_t core_id)
+{
+	return (task->affinity[core_id / 64] >> (core_id % 64)) & 1;
+}
+
+
 static inline void task_list_remove_task(task_list_t* list, task_t* task)
 {
 	if (task->prev)
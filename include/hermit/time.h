@@ -63,6 +63,33 @@ int timer_init(void);
  */
 int timer_wait(unsigned int ticks);
 
+/** @brief Block the current task for some nanoseconds
+ *
+ * On a system with TSC-deadline timer, the task wakes up within
+ * a few microseconds. Very short sleeps are realized by busy waiting.
+ *
+ * @param ns Amount of nanoseconds to wait
+ * @return
+ * - 0 on success
+ */
+int timer_nanosleep(uint64_t ns);
+
+/** @brief Block the current task until the TSC reaches the deadline
+ *
+ * @param tsc TSC value, at which the task wakes up
+ * @return
+ * - 0 on success
+ */
+int timer_nanosleep_until(uint64_t tsc);
+
+/** @brief Get nanoseconds since system boot
+ */
+uint64_t get_clock_ns(void);
+
+/** @brief Convert nanoseconds to TSC cycles without overflow
+ */
+uint64_t ns_to_cycles(uint64_t ns);
+
 DECLARE_PER_CORE(uint64_t, timer_ticks);
 
 /** @brief Returns the current number of ticks.
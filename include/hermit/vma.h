@@ -70,6 +70,10 @@ struct vma;
  *
  * Each item in this linked list marks a used part of the virtual address space.
  * Its used by vm_alloc() to find holes between them.
+ *
+ * In addition, the VMAs are organized as AVL tree, which is sorted by the
+ * start address. Each node knows the largest hole in front of a VMA of its
+ * subtree. Consequently, lookups and the first fit search need O(log n).
  */
 typedef struct vma {
 	/// Start address of the memory area
@@ -82,6 +86,16 @@ typedef struct vma {
 	struct vma* next;
 	/// Pointer to previous VMA element in the list
 	struct vma* prev;
+	/// Left child in the tree (lower addresses)
+	struct vma* left;
+	/// Right child in the tree (higher addresses)
+	struct vma* right;
+	/// Parent in the tree
+	struct vma* parent;
+	/// Largest hole in front of a VMA of this subtree
+	size_t max_gap;
+	/// Height of this subtree
+	int height;
 } vma_t;
 
 /** @brief Initalize the kernelspace VMA list
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/errno.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/futex.h>
+#include <hermit/time.h>
+#include <asm/processor.h>
+
+/// Number of wait queues, must be a power of two
+#define FUTEX_BUCKETS	256
+
+/** @brief Entry of a wait queue
+ *
+ * The entry lives on the stack of the waiting task.
+ */
+typedef struct futex_waiter {
+	/// address, on which the task waits
+	int32_t*		addr;
+	/// waiting task
+	tid_t			id;
+	/// set by futex_wake
+	volatile int32_t	woken;
+	/// next entry in the queue
+	struct futex_waiter*	next;
+	/// previous entry in the queue
+	struct futex_waiter*	prev;
+} futex_waiter_t;
+
+typedef struct {
+	/// FIFO of waiting tasks
+	futex_waiter_t*		first;
+	futex_waiter_t*		last;
+	/// lock for this queue
+	spinlock_irqsave_t	lock;
+} __attribute__ ((aligned (CACHE_LINE))) futex_bucket_t;
+
+static futex_bucket_t futex_buckets[FUTEX_BUCKETS] = {
+	[0 ... FUTEX_BUCKETS-1] = {NULL, NULL, SPINLOCK_IRQSAVE_INIT}};
+
+static inline futex_bucket_t* futex_bucket(int32_t* addr)
+{
+	size_t key = (size_t) addr >> 2;
+
+	// mix the upper bits into the index
+	key ^= (key >> 8) ^ (key >> 16);
+
+	return &futex_buckets[key & (FUTEX_BUCKETS-1)];
+}
+
+static inline void futex_unlink(futex_bucket_t* bucket, futex_waiter_t* w)
+{
+	if (w->prev)
+		w->prev->next = w->next;
+	else
+		bucket->first = w->next;
+	if (w->next)
+		w->next->prev = w->prev;
+	else
+		bucket->last = w->prev;
+	w->next = w->prev = NULL;
+}
+
+int futex_wait(int32_t* addr, int32_t val, uint64_t ns)
+{
+	futex_bucket_t* bucket;
+	futex_waiter_t w;
+	uint64_t deadline = 0;
+	int ret = 0;
+
+	if (BUILTIN_EXPECT(!addr || ((size_t) addr & 3), 0))
+		return -EINVAL;
+
+	if (ns)
+		deadline = get_rdtsc() + ns_to_cycles(ns);
+
+	bucket = futex_bucket(addr);
+	w.addr = addr;
+	w.id = per_core(current_task)->id;
+	w.woken = 0;
+
+	spinlock_irqsave_lock(&bucket->lock);
+
+	// futex_wake holds the same lock => no wakeup can get lost
+	if (*((volatile int32_t*) addr) != val) {
+		spinlock_irqsave_unlock(&bucket->lock);
+		return -EAGAIN;
+	}
+
+	w.next = NULL;
+	w.prev = bucket->last;
+	if (bucket->last)
+		bucket->last->next = &w;
+	else
+		bucket->first = &w;
+	bucket->last = &w;
+
+	if (deadline)
+		set_hrtimer(deadline);
+	else
+		block_current_task();
+
+	spinlock_irqsave_unlock(&bucket->lock);
+	reschedule();
+
+	spinlock_irqsave_lock(&bucket->lock);
+	if (!w.woken) {
+		// timeout or another wakeup => leave the queue
+		futex_unlink(bucket, &w);
+		if (deadline && (get_rdtsc() >= deadline))
+			ret = -ETIME;
+	}
+	spinlock_irqsave_unlock(&bucket->lock);
+
+	return ret;
+}
+
+int futex_wake(int32_t* addr, int32_t count)
+{
+	futex_bucket_t* bucket;
+	futex_waiter_t* w;
+	futex_waiter_t* next;
+	int ret = 0;
+
+	if (BUILTIN_EXPECT(!addr || ((size_t) addr & 3), 0))
+		return -EINVAL;
+
+	bucket = futex_bucket(addr);
+
+	spinlock_irqsave_lock(&bucket->lock);
+
+	for(w=bucket->first; w && (ret < count); w=next) {
+		next = w->next;
+		if (w->addr != addr)
+			continue;
+
+		futex_unlink(bucket, w);
+		w->woken = 1;
+		wakeup_task(w->id);
+		ret++;
+	}
+
+	spinlock_irqsave_unlock(&bucket->lock);
+
+	return ret;
+}
@@ -41,6 +41,7 @@
 #include <asm/page.h>
 #include <asm/uart.h>
 #include <asm/multiboot.h>
+#include <asm/uhyve.h>
 
 #include <lwip/init.h>
 #include <lwip/sys.h>
@@ -122,6 +123,9 @@ static int hermit_init(void)
 	timer_init();
 	multitasking_init();
 	memory_init();
+	idle_init();
+	timeslice_init();
+	task_table_init();
 	signal_init();
 
 	return 0;
@@ -299,6 +303,7 @@ int smp_main(void)
 
 	while(1) {
 		check_workqueues();
+		zero_pool_refill();
 		wait_for_task();
 	}
 
@@ -570,10 +575,15 @@ int hermit_main(void)
 	print_status();
 	//vma_dump();
 
+	// queue the I/O requests to uhyve instead of one VM exit per request
+	if (is_uhyve())
+		uhyve_ring_init();
+
 	create_kernel_task_on_core(NULL, initd, NULL, NORMAL_PRIO, boot_processor);
 
 	while(1) {
 		check_workqueues();
+		zero_pool_refill();
 		wait_for_task();
 	}
 
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Contended paths of the irqsave spinlocks and the lock statistics
+ *
+ * A queued lock uses its queue field as lock word. Bit 0 marks the lock
+ * as taken, the upper bits hold the node of the last waiter. Only the
+ * head of the queue spins on the lock word. All other waiters spin on
+ * their own node until their predecessor becomes the owner. Afterwards,
+ * the node is free again. Consequently, a core needs only one node per
+ * nesting level of waiting and not per held lock.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/spinlock.h>
+#include <hermit/logging.h>
+#include <asm/processor.h>
+
+/// Position of the tail in the lock word
+#define SPINLOCK_TAIL_SHIFT	8
+
+static spinlock_node_t spinlock_nodes[MAX_CORES][SPINLOCK_QUEUE_NODES];
+
+/// number of nodes, which the core currently uses
+DEFINE_PER_CORE_STATIC(uint32_t, spinlock_depth, 0);
+
+/// list of all statistics, which are in use
+static lock_stats_t* lock_stats_list = NULL;
+static spinlock_irqsave_t lock_stats_lock = SPINLOCK_IRQSAVE_INIT;
+
+static inline spinlock_node_t* spinlock_decode_tail(int64_t val)
+{
+	const uint64_t code = ((uint64_t) val >> SPINLOCK_TAIL_SHIFT) - 1;
+
+	return &spinlock_nodes[code / SPINLOCK_QUEUE_NODES][code % SPINLOCK_QUEUE_NODES];
+}
+
+static inline void lock_stats_waited(spinlock_irqsave_t* s, uint64_t start)
+{
+#ifdef LOCK_STATS
+	if (s->stats) {
+		atomic_int64_inc(&s->stats->contended);
+		atomic_int64_add(&s->stats->spin_cycles, get_rdtsc() - start);
+	}
+#endif
+}
+
+void spinlock_ticket_wait(spinlock_irqsave_t* s, int64_t ticket)
+{
+	const uint64_t start = get_rdtsc();
+
+	while (atomic_int64_read(&s->dequeue) != ticket) {
+		PAUSE;
+	}
+
+	lock_stats_waited(s, start);
+}
+
+void spinlock_queued_wait(spinlock_irqsave_t* s)
+{
+	const uint64_t start = get_rdtsc();
+	const uint32_t idx = per_core(spinlock_depth);
+	spinlock_node_t* node;
+	int64_t val, old, tail;
+
+	// no free node => spin on the lock word and bypass the queue
+	if (BUILTIN_EXPECT(idx >= SPINLOCK_QUEUE_NODES, 0)) {
+		do {
+			val = atomic_int64_read(&s->queue);
+			if (val & SPINLOCK_QUEUED_LOCKED) {
+				PAUSE;
+				continue;
+			}
+		} while (atomic_int64_cmpxchg(&s->queue, val, val | SPINLOCK_QUEUED_LOCKED) != val);
+
+		lock_stats_waited(s, start);
+		return;
+	}
+
+	set_per_core(spinlock_depth, idx + 1);
+
+	node = &spinlock_nodes[CORE_ID][idx];
+	node->next = NULL;
+	node->wait = 1;
+	tail = (int64_t) (CORE_ID * SPINLOCK_QUEUE_NODES + idx + 1) << SPINLOCK_TAIL_SHIFT;
+
+	// append our node to the queue
+	val = atomic_int64_read(&s->queue);
+	while ((old = atomic_int64_cmpxchg(&s->queue, val, (val & SPINLOCK_QUEUED_LOCKED) | tail)) != val)
+		val = old;
+
+	// wait until our predecessor owns the lock
+	if (val & ~SPINLOCK_QUEUED_LOCKED) {
+		spinlock_decode_tail(val)->next = node;
+		while (node->wait) {
+			PAUSE;
+		}
+	}
+
+	// we are the head of the queue => wait for the owner
+	for(;;) {
+		val = atomic_int64_read(&s->queue);
+		if (val & SPINLOCK_QUEUED_LOCKED) {
+			PAUSE;
+			continue;
+		}
+
+		if (val == tail) {
+			// last waiter => the queue becomes empty
+			if (atomic_int64_cmpxchg(&s->queue, val, SPINLOCK_QUEUED_LOCKED) == val)
+				break;
+		} else if (atomic_int64_cmpxchg(&s->queue, val, val | SPINLOCK_QUEUED_LOCKED) == val) {
+			// the successor may not be linked yet
+			while (!node->next) {
+				PAUSE;
+			}
+			node->next->wait = 0;
+			break;
+		}
+	}
+
+	set_per_core(spinlock_depth, idx);
+
+	lock_stats_waited(s, start);
+}
+
+void lock_stats_acquired(spinlock_irqsave_t* s)
+{
+	lock_stats_t* stats = s->stats;
+
+	if (BUILTIN_EXPECT(!atomic_int32_read(&stats->registered), 0)) {
+		spinlock_irqsave_lock(&lock_stats_lock);
+		if (!atomic_int32_read(&stats->registered)) {
+			stats->next = lock_stats_list;
+			lock_stats_list = stats;
+			atomic_int32_set(&stats->registered, 1);
+		}
+		spinlock_irqsave_unlock(&lock_stats_lock);
+	}
+
+	atomic_int64_inc(&stats->acquisitions);
+	s->hold_start = get_rdtsc();
+}
+
+void lock_stats_released(spinlock_irqsave_t* s)
+{
+	lock_stats_t* stats = s->stats;
+	const int64_t hold = get_rdtsc() - s->hold_start;
+	int64_t max = atomic_int64_read(&stats->max_hold);
+
+	while (hold > max) {
+		int64_t old = atomic_int64_cmpxchg(&stats->max_hold, max, hold);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+
+void print_lock_stats(void)
+{
+	lock_stats_t* stats;
+
+	for(stats=lock_stats_list; stats; stats=stats->next) {
+		const int64_t contended = atomic_int64_read(&stats->contended);
+
+		LOG_INFO("Lock %s: %lld acquisitions, %lld contended, %lld spin cycles per contention, max. hold time %lld cycles\n",
+			stats->name, atomic_int64_read(&stats->acquisitions), contended,
+			contended ? atomic_int64_read(&stats->spin_cycles) / contended : 0,
+			atomic_int64_read(&stats->max_hold));
+	}
+}
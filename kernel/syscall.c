@@ -32,6 +32,7 @@
 #include <hermit/syscall.h>
 #include <hermit/spinlock.h>
 #include <hermit/semaphore.h>
+#include <hermit/futex.h>
 #include <hermit/time.h>
 #include <hermit/rcce.h>
 #include <hermit/memory.h>
@@ -44,6 +45,8 @@
 #include <lwip/err.h>
 #include <lwip/stats.h>
 
+#include <net/uhyve-net.h>
+
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
  * maintaining a value, rather their address is their value.
@@ -51,7 +54,8 @@
 extern const void kernel_start;
 
 //TODO: don't use one big kernel lock to comminicate with all proxies
-static spinlock_irqsave_t lwip_lock = SPINLOCK_IRQSAVE_INIT;
+static lock_stats_t lwip_stats = LOCK_STATS_INIT("lwip_lock");
+static spinlock_irqsave_t lwip_lock = SPINLOCK_IRQSAVE_QUEUED_INIT(&lwip_stats);
 
 extern spinlock_irqsave_t stdio_lock;
 extern int32_t isle;
@@ -106,7 +110,45 @@ int sys_getprio(tid_t* id)
 
 int sys_setprio(tid_t* id, int prio)
 {
-	return -ENOSYS;
+	task_t* task = per_core(current_task);
+
+	if (BUILTIN_EXPECT((prio <= IDLE_PRIO) || (prio > MAX_PRIO), 0))
+		return -EINVAL;
+
+	return set_task_prio(id ? *id : task->id, (uint8_t) prio);
+}
+
+int sys_sched_setaffinity(tid_t* id, size_t size, const void* mask)
+{
+	return set_task_affinity(id ? *id : per_core(current_task)->id, mask, size);
+}
+
+int sys_sched_getaffinity(tid_t* id, size_t size, void* mask)
+{
+	return get_task_affinity(id ? *id : per_core(current_task)->id, mask, size);
+}
+
+int sys_sched_isolate(int32_t core_id)
+{
+	if (core_id < 0)
+		core_id = CORE_ID;
+
+	return isolate_task((uint32_t) core_id);
+}
+
+int sys_sched_unisolate(void)
+{
+	return unisolate_task();
+}
+
+int sys_sched_setdeadline(uint64_t runtime_ns, uint64_t period_ns)
+{
+	return set_task_deadline(runtime_ns, period_ns);
+}
+
+int sys_sched_wait_period(void)
+{
+	return wait_next_period();
 }
 
 void NORETURN do_exit(int arg);
@@ -152,12 +194,93 @@ typedef struct {
 	size_t len;
 } __attribute__((packed)) sys_read_t;
 
+#ifndef SEEK_SET
+#define SEEK_SET	0
+#define SEEK_CUR	1
+#endif
+
 typedef struct {
 	int fd;
-	char* buf;
-        size_t len;
+	int cnt;
+	uhyve_seg_t* segs;
+	off_t offset;
 	ssize_t ret;
-} __attribute__((packed)) uhyve_read_t;
+} __attribute__((packed)) uhyve_rw_t;
+
+/** @brief Vectored read or write by uhyve
+ *
+ * The buffers are translated to guest physical segments. An I/O vector,
+ * which needs more than UHYVE_IOV_MAX segments, is transferred by several
+ * requests.
+ *
+ * @param offset File offset or -1 to use and update the file position
+ */
+static ssize_t uhyve_rw(unsigned short port, int fd, const struct iovec* iov, int iovcnt, off_t offset)
+{
+	task_t* curr_task = per_core(current_task);
+	// the arguments may not cross a page boundary
+	uhyve_rw_t args __attribute__ ((aligned (sizeof(uhyve_rw_t))));
+	uhyve_seg_t* segs;
+	ssize_t total = 0;
+	size_t pos = 0, bytes, len;
+	uint32_t cnt;
+	int i = 0;
+
+	if (BUILTIN_EXPECT(iovcnt < 0, 0))
+		return -EINVAL;
+
+	// the segment list is stored in a page of the task, because the task may block
+	if (BUILTIN_EXPECT(!curr_task->uhyve_segs, 0)) {
+		curr_task->uhyve_segs = page_alloc(PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+		if (BUILTIN_EXPECT(!curr_task->uhyve_segs, 0))
+			return -ENOMEM;
+	}
+	segs = (uhyve_seg_t*) curr_task->uhyve_segs;
+
+	while (i < iovcnt) {
+		cnt = 0;
+		bytes = 0;
+
+		while ((i < iovcnt) && (cnt < UHYVE_IOV_MAX)) {
+			len = iov[i].iov_len - pos;
+			len = uhyve_add_segments(segs, &cnt, (char*) iov[i].iov_base + pos, len);
+			bytes += len;
+
+			// the list is full
+			if (pos + len < iov[i].iov_len) {
+				pos += len;
+				break;
+			}
+
+			pos = 0;
+			i++;
+		}
+
+		if (!cnt)
+			break;
+
+		args.fd = fd;
+		args.cnt = cnt;
+		args.segs = (uhyve_seg_t*) virt_to_phys((size_t) segs);
+		args.offset = offset;
+		args.ret = -EIO;
+
+		uhyve_submit(port, &args);
+
+		if (args.ret < 0)
+			return total ? total : args.ret;
+
+		total += args.ret;
+		if (offset >= 0)
+			offset += args.ret;
+
+		// short transfer => end of file or a full device
+		if ((size_t) args.ret < bytes)
+			break;
+	}
+
+	return total;
+}
 
 ssize_t sys_read(int fd, char* buf, size_t len)
 {
@@ -174,11 +297,9 @@ ssize_t sys_read(int fd, char* buf, size_t len)
 	}
 
 	if (is_uhyve()) {
-		uhyve_read_t uhyve_args = {fd, (char*) virt_to_phys((size_t) buf), len, -1};
-
-		uhyve_send(UHYVE_PORT_READ, (unsigned)virt_to_phys((size_t)&uhyve_args));
+		struct iovec iov = {buf, len};
 
-		return uhyve_args.ret;
+		return uhyve_rw(UHYVE_PORT_READV, fd, &iov, 1, -1);
 	}
 
 	spinlock_irqsave_lock(&lwip_lock);
@@ -207,7 +328,49 @@ ssize_t sys_read(int fd, char* buf, size_t len)
 
 ssize_t readv(int d, const struct iovec *iov, int iovcnt)
 {
-	return -ENOSYS;
+	ssize_t ret, total = 0;
+	int i;
+
+	if (is_uhyve() && !(d & LWIP_FD_BIT))
+		return uhyve_rw(UHYVE_PORT_READV, d, iov, iovcnt, -1);
+
+	for(i=0; i<iovcnt; i++) {
+		ret = sys_read(d, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0)
+			return total ? total : ret;
+
+		total += ret;
+		if ((size_t) ret < iov[i].iov_len)
+			break;
+	}
+
+	return total;
+}
+
+ssize_t sys_pread(int fd, char* buf, size_t len, off_t offset)
+{
+	off_t pos;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT((fd & LWIP_FD_BIT) || (offset < 0), 0))
+		return -EINVAL;
+
+	if (is_uhyve()) {
+		struct iovec iov = {buf, len};
+
+		return uhyve_rw(UHYVE_PORT_READV, fd, &iov, 1, offset);
+	}
+
+	// the proxy doesn't know pread => emulate it
+	pos = sys_lseek(fd, 0, SEEK_CUR);
+	if (pos < 0)
+		return pos;
+	if (sys_lseek(fd, offset, SEEK_SET) < 0)
+		return -EINVAL;
+	ret = sys_read(fd, buf, len);
+	sys_lseek(fd, pos, SEEK_SET);
+
+	return ret;
 }
 
 typedef struct {
@@ -216,12 +379,6 @@ typedef struct {
 	size_t len;
 } __attribute__((packed)) sys_write_t;
 
-typedef struct {
-	int fd;
-	const char* buf;
-	size_t len;
-} __attribute__((packed)) uhyve_write_t;
-
 ssize_t sys_write(int fd, const char* buf, size_t len)
 {
 	if (BUILTIN_EXPECT(!buf, 0))
@@ -240,11 +397,9 @@ ssize_t sys_write(int fd, const char* buf, size_t len)
 	}
 
 	if (is_uhyve()) {
-		uhyve_write_t uhyve_args = {fd, (const char*) virt_to_phys((size_t) buf), len};
-
-		uhyve_send(UHYVE_PORT_WRITE, (unsigned)virt_to_phys((size_t)&uhyve_args));
+		struct iovec iov = {(void*) buf, len};
 
-		return uhyve_args.len;
+		return uhyve_rw(UHYVE_PORT_WRITEV, fd, &iov, 1, -1);
 	}
 
 	spinlock_irqsave_lock(&lwip_lock);
@@ -285,10 +440,60 @@ ssize_t sys_write(int fd, const char* buf, size_t len)
 
 ssize_t writev(int fildes, const struct iovec *iov, int iovcnt)
 {
-	return -ENOSYS;
+	ssize_t ret, total = 0;
+	int i;
+
+	if (is_uhyve() && !(fildes & LWIP_FD_BIT))
+		return uhyve_rw(UHYVE_PORT_WRITEV, fildes, iov, iovcnt, -1);
+
+	for(i=0; i<iovcnt; i++) {
+		ret = sys_write(fildes, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0)
+			return total ? total : ret;
+
+		total += ret;
+		if ((size_t) ret < iov[i].iov_len)
+			break;
+	}
+
+	return total;
 }
 
-ssize_t sys_sbrk(ssize_t incr)
+ssize_t sys_pwrite(int fd, const char* buf, size_t len, off_t offset)
+{
+	off_t pos;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT((fd & LWIP_FD_BIT) || (offset < 0), 0))
+		return -EINVAL;
+
+	if (is_uhyve()) {
+		struct iovec iov = {(void*) buf, len};
+
+		return uhyve_rw(UHYVE_PORT_WRITEV, fd, &iov, 1, offset);
+	}
+
+	// the proxy doesn't know pwrite => emulate it
+	pos = sys_lseek(fd, 0, SEEK_CUR);
+	if (pos < 0)
+		return pos;
+	if (sys_lseek(fd, offset, SEEK_SET) < 0)
+		return -EINVAL;
+	ret = sys_write(fd, buf, len);
+	sys_lseek(fd, pos, SEEK_SET);
+
+	return ret;
+}
+
+/*
+ * Heap population at sbrk (HERMIT_POPULATE or "-populate" on the command line)
+ * 0 => pages are mapped by the page fault handler
+ * 1 => new heap pages are mapped by sys_sbrk
+ * 2 => new heap pages are mapped and zeroed by sys_sbrk
+ */
+extern uint32_t populate_heap;
+
+static ssize_t __sys_sbrk(ssize_t incr, int populate, int zero)
 {
 	ssize_t ret;
 	vma_t* heap = per_core(current_task)->heap;
@@ -314,9 +519,20 @@ ssize_t sys_sbrk(ssize_t incr)
 			vma_free(PAGE_FLOOR(ret), PAGE_CEIL(heap->end));
 			vma_add(PAGE_FLOOR(ret), PAGE_CEIL(heap->end), VMA_HEAP|VMA_USER);
 		}
+
+		// map the new pages right now instead of waiting for the page faults
+		if (populate && (incr > 0)) {
+			size_t flags = PG_USER|PG_RW;
+
+			if (has_nx()) // set no execution flag to protect the heap
+				flags |= PG_XD;
+
+			if (page_populate(PAGE_FLOOR(ret), (PAGE_CEIL(heap->end) - PAGE_FLOOR(ret)) >> PAGE_BITS, flags, zero))
+				LOG_WARNING("sys_sbrk: unable to populate 0x%zx - 0x%zx\n", ret, heap->end);
+		}
 	} else ret = -ENOMEM;
 
-	// allocation and mapping of new pages for the heap
+	// otherwise, allocation and mapping of new pages for the heap
 	// is catched by the pagefault handler
 
 	spinlock_unlock(&heap_lock);
@@ -324,6 +540,16 @@ ssize_t sys_sbrk(ssize_t incr)
 	return ret;
 }
 
+ssize_t sys_sbrk(ssize_t incr)
+{
+	return __sys_sbrk(incr, populate_heap, populate_heap > 1);
+}
+
+ssize_t sys_sbrk_populate(ssize_t incr, int zero)
+{
+	return __sys_sbrk(incr, 1, zero);
+}
+
 typedef struct {
 	const char* name;
 	int flags;
@@ -336,7 +562,7 @@ int sys_open(const char* name, int flags, int mode)
 	if (is_uhyve()) {
 		uhyve_open_t uhyve_open = {(const char*)virt_to_phys((size_t)name), flags, mode, -1};
 
-		uhyve_send(UHYVE_PORT_OPEN, (unsigned)virt_to_phys((size_t) &uhyve_open));
+		uhyve_submit(UHYVE_PORT_OPEN, &uhyve_open);
 
 		return uhyve_open.ret;
 	}
@@ -419,7 +645,7 @@ int sys_close(int fd)
 	if (is_uhyve()) {
 		uhyve_close_t uhyve_close = {fd, -1};
 
-		uhyve_send(UHYVE_PORT_CLOSE, (unsigned)virt_to_phys((size_t) &uhyve_close));
+		uhyve_submit(UHYVE_PORT_CLOSE, &uhyve_close);
 
 		return uhyve_close.ret;
 	}
@@ -494,10 +720,27 @@ int sys_spinlock_unlock(spinlock_t* lock)
 
 void sys_msleep(unsigned int ms)
 {
-	if (ms * TIMER_FREQ / 1000 > 0)
-		timer_wait(ms * TIMER_FREQ / 1000);
-	else if (ms > 0)
-		udelay(ms * 1000);
+	timer_nanosleep((uint64_t) ms * 1000000ULL);
+}
+
+int sys_nanosleep(uint64_t ns)
+{
+	return timer_nanosleep(ns);
+}
+
+int sys_clock_nanosleep(uint64_t deadline)
+{
+	uint64_t now = get_clock_ns();
+
+	if (deadline <= now)
+		return 0;
+
+	return timer_nanosleep(deadline - now);
+}
+
+uint64_t sys_clock_gettime_ns(void)
+{
+	return get_clock_ns();
 }
 
 int sys_sem_init(sem_t** sem, unsigned int value)
@@ -558,6 +801,14 @@ int sys_sem_timedwait(sem_t *sem, unsigned int ms)
 	return sem_wait(sem, ms);
 }
 
+int sys_sem_timedwait_ns(sem_t *sem, uint64_t ns)
+{
+	if (BUILTIN_EXPECT(!sem, 0))
+		return -EINVAL;
+
+	return sem_wait_until(sem, get_rdtsc() + ns_to_cycles(ns));
+}
+
 int sys_sem_cancelablewait(sem_t* sem, unsigned int ms)
 {
 	if (BUILTIN_EXPECT(!sem, 0))
@@ -566,6 +817,16 @@ int sys_sem_cancelablewait(sem_t* sem, unsigned int ms)
 	return sem_wait(sem, ms);
 }
 
+int sys_futex_wait(int32_t* addr, int32_t val, uint64_t ns)
+{
+	return futex_wait(addr, val, ns);
+}
+
+int sys_futex_wake(int32_t* addr, int32_t count)
+{
+	return futex_wake(addr, count);
+}
+
 int sys_clone(tid_t* id, void* ep, void* argv)
 {
 	return clone_task(id, ep, argv, per_core(current_task)->prio);
@@ -589,7 +850,7 @@ off_t sys_lseek(int fd, off_t offset, int whence)
 	if (is_uhyve()) {
 		uhyve_lseek_t uhyve_lseek = { fd, offset, whence };
 
-		outportl(UHYVE_PORT_LSEEK, (unsigned)virt_to_phys((size_t) &uhyve_lseek));
+		uhyve_submit(UHYVE_PORT_LSEEK, &uhyve_lseek);
 
 		return uhyve_lseek.offset;
 	}
@@ -777,6 +1038,78 @@ size_t sys_get_ticks(void)
 	return get_clock_tick();
 }
 
+void sys_heap_stats(size_t* faults, size_t* huge_faults)
+{
+	page_fault_stats(faults, huge_faults, NULL);
+}
+
+void sys_zero_pool_resize(size_t npages)
+{
+	zero_pool_resize(npages);
+}
+
+void sys_zero_pool_stats(size_t* depth, size_t* hits, size_t* misses, size_t* refills)
+{
+	zero_pool_stats(depth, hits, misses, refills);
+}
+
+int sys_net_queue_stats(uint32_t queue, size_t* rx_packets, size_t* rx_bytes, size_t* tx_packets, size_t* tx_bytes, size_t* drops)
+{
+	return uhyve_net_queue_stats(queue, rx_packets, rx_bytes, tx_packets, tx_bytes, drops);
+}
+
+int sys_sched_stats(uint32_t core_id, size_t* migrated_in, size_t* migrated_out)
+{
+	return sched_stats(core_id, migrated_in, migrated_out);
+}
+
+int sys_sched_usage(tid_t* id, uint64_t* run_ns, uint64_t* wait_ns, uint64_t* nvcsw, uint64_t* nivcsw)
+{
+	return task_usage(id ? *id : per_core(current_task)->id, run_ns, wait_ns, nvcsw, nivcsw);
+}
+
+#define RUSAGE_SELF	0
+#define RUSAGE_CHILDREN	-1
+#define RUSAGE_THREAD	1
+
+/// Layout of struct rusage in newlib (two struct timeval)
+typedef struct {
+	int64_t utime_sec;
+	int64_t utime_usec;
+	int64_t stime_sec;
+	int64_t stime_usec;
+} rusage_t;
+
+int sys_getrusage(int who, /*struct rusage *usage*/ void* usage)
+{
+	rusage_t* ru = (rusage_t*) usage;
+	uint64_t ns = 0;
+
+	if (BUILTIN_EXPECT(!ru, 0))
+		return -EINVAL;
+
+	switch (who) {
+	case RUSAGE_SELF:
+		ns = total_run_time();
+		break;
+	case RUSAGE_THREAD:
+		task_usage(per_core(current_task)->id, &ns, NULL, NULL, NULL);
+		break;
+	case RUSAGE_CHILDREN:
+		// there are no child processes
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	// the kernel runs in the same privilege level => all time is user time
+	ru->utime_sec = ns / 1000000000ULL;
+	ru->utime_usec = (ns % 1000000000ULL) / 1000ULL;
+	ru->stime_sec = ru->stime_usec = 0;
+
+	return 0;
+}
+
 int sys_stat(const char* file, /*struct stat *st*/ void* st)
 {
 	return -ENOSYS;
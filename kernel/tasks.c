@@ -38,35 +38,61 @@
 #include <hermit/memory.h>
 #include <hermit/logging.h>
 #include <asm/processor.h>
+#include <asm/multiboot.h>
 
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
  * maintaining a value, rather their address is their value.
  */
 extern atomic_int32_t cpu_online;
+extern int32_t possible_cpus;
+extern atomic_int64_t total_pages;
 
 volatile uint32_t go_down = 0;
 
 #define TLS_OFFSET	8
 
+/// Part of the memory, which may be used by the stacks of all tasks (1/TASK_MEM_SHARE)
+#define TASK_MEM_SHARE	4
+/// Marks the end of the list of free task ids
+#define TID_NIL		((tid_t) -1)
+
+/** @brief Task structure of the boot task
+ *
+ * It's used until task_table_init() allocates the task table and
+ * stays the idle task of the boot processor.
+ */
+static task_t boot_task = {0, TASK_IDLE, 0, NULL, NULL, NULL, TASK_DEFAULT_FLAGS, 0, SCHED_NORMAL, 0, 0, NULL, 0, 0, 0, 0, 0, 0, 0, NULL, 0, NULL, NULL, 0, 0, 0, NULL, 0, 0, 0, 0, NULL, {0}, FPU_STATE_INIT};
+
 /** @brief Array of task structures (aka PCB)
  *
- * A task's id will be its position in this array.
+ * A task's id will be its position in this array. The array is sized at
+ * boot time (see task_table_init()), at most MAX_TASKS entries are used.
  */
-static task_t task_table[MAX_TASKS] = { \
-        [0]                 = {0, TASK_IDLE, 0, NULL, NULL, NULL, TASK_DEFAULT_FLAGS, 0, 0, 0, 0, NULL, 0, NULL, NULL, 0, 0, 0, NULL, FPU_STATE_INIT}, \
-        [1 ... MAX_TASKS-1] = {0, TASK_INVALID, 0, NULL, NULL, NULL, TASK_DEFAULT_FLAGS, 0, 0, 0, 0, NULL, 0, NULL, NULL, 0, 0, 0, NULL, FPU_STATE_INIT}};
+static task_t* task_table = &boot_task;
+/// Number of entries in task_table
+static uint32_t max_tasks = 1;
 
-static spinlock_irqsave_t table_lock = SPINLOCK_IRQSAVE_INIT;
+/** @brief Lock-free stack of free task ids
+ *
+ * The lower 32 bits hold the id on top of the stack, the upper 32 bits
+ * a tag, which is increased by every operation to avoid the ABA problem.
+ */
+static atomic_int64_t free_tids = ATOMIC_INIT(TID_NIL);
+/// Link to the next free id, one entry per task
+static tid_t* free_tids_next = NULL;
+
+/// shared by the locks of all ready queues
+static lock_stats_t readyqueue_stats = LOCK_STATS_INIT("readyqueues");
 
 #if MAX_CORES > 1
 static readyqueues_t readyqueues[MAX_CORES] = { \
-		[0 ... MAX_CORES-1]   = {NULL, NULL, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, {NULL, NULL}, SPINLOCK_IRQSAVE_INIT}};
+		[0 ... MAX_CORES-1]   = {NULL, NULL, 0, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, {0, 0, {0}, {{NULL}}, NULL, NULL, 0}, SPINLOCK_IRQSAVE_QUEUED_INIT(&readyqueue_stats), 0, 0, 0}};
 #else
-static readyqueues_t readyqueues[1] = {[0] = {task_table+0, NULL, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, {NULL, NULL}, SPINLOCK_IRQSAVE_INIT}};
+static readyqueues_t readyqueues[1] = {[0] = {&boot_task, NULL, 0, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, {0, 0, {0}, {{NULL}}, NULL, NULL, 0}, SPINLOCK_IRQSAVE_QUEUED_INIT(&readyqueue_stats), 0, 0, 0}};
 #endif
 
-DEFINE_PER_CORE(task_t*, current_task, task_table+0);
+DEFINE_PER_CORE(task_t*, current_task, &boot_task);
 
 #if MAX_CORES > 1
 DEFINE_PER_CORE(uint32_t, __core_id, 0);
@@ -75,12 +101,381 @@ DEFINE_PER_CORE(uint32_t, __core_id, 0);
 extern const void boot_stack;
 extern const void boot_ist;
 
+/** Populate thread stacks on demand (HERMIT_LAZYSTACK or "-lazystack") */
+extern uint32_t lazystack;
+
+/** Length of a round robin time slice in microseconds (HERMIT_TIMESLICE or "-timeslice=") */
+extern uint32_t timeslice;
+
+/// Default time slice: one clock tick
+#define TIME_SLICE_US	(1000000 / TIMER_FREQ)
+
+/// Run time of all finished tasks (in cycles)
+static atomic_int64_t exited_cycles = ATOMIC_INIT(0);
+
+/// Number of stack pairs, which are kept per core for reuse
+#define STACK_CACHE_SIZE	16
+/// Part of a lazy stack, which is mapped in advance
+#define LAZY_STACK_MAPPED	(4*PAGE_SIZE)
+
+/** @brief Per core cache of ready mapped stacks
+ *
+ * A finished task leaves its stack and IST with the guard pages in
+ * place, so that the next task creation avoids vma_alloc, get_pages,
+ * page_map and the TLB shootdown of the unmapping.
+ * Only the owning core touches a cache and it does so with disabled interrupts.
+ */
+typedef struct stack_cache {
+	/// Number of cached stack pairs
+	uint32_t count;
+	/// Thread stacks of DEFAULT_STACK_SIZE bytes
+	void* stacks[STACK_CACHE_SIZE];
+	/// Interrupt stacks of KERNEL_STACK_SIZE bytes
+	void* ists[STACK_CACHE_SIZE];
+} __attribute__ ((aligned (CACHE_LINE))) stack_cache_t;
+
+static stack_cache_t stack_caches[MAX_CORES];
+
+static void release_stacks(void* stack, void* ist)
+{
+	if (stack) {
+		if (lazystack)
+			destroy_lazy_stack(stack, DEFAULT_STACK_SIZE);
+		else
+			destroy_stack(stack, DEFAULT_STACK_SIZE);
+	}
+
+	if (ist)
+		destroy_stack(ist, KERNEL_STACK_SIZE);
+}
+
+/** @brief Get a stack and an IST for a new task */
+static int get_stacks(void** stack, void** ist)
+{
+	stack_cache_t* cache;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+	cache = stack_caches + CORE_ID;
+	if (cache->count) {
+		cache->count--;
+		*stack = cache->stacks[cache->count];
+		*ist = cache->ists[cache->count];
+		irq_nested_enable(flags);
+
+		return 0;
+	}
+	irq_nested_enable(flags);
+
+	if (lazystack)
+		*stack = create_lazy_stack(DEFAULT_STACK_SIZE, LAZY_STACK_MAPPED);
+	else
+		*stack = create_stack(DEFAULT_STACK_SIZE);
+	if (BUILTIN_EXPECT(!*stack, 0))
+		return -ENOMEM;
+
+	*ist = create_stack(KERNEL_STACK_SIZE);
+	if (BUILTIN_EXPECT(!*ist, 0)) {
+		release_stacks(*stack, NULL);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/** @brief Return the stacks of a task to the cache of the current core */
+static void put_stacks(void* stack, void* ist)
+{
+	stack_cache_t* cache;
+	uint8_t flags;
+
+	if (BUILTIN_EXPECT(!stack || !ist, 0)) {
+		release_stacks(stack, ist);
+		return;
+	}
+
+	flags = irq_nested_disable();
+	cache = stack_caches + CORE_ID;
+	if (cache->count < STACK_CACHE_SIZE) {
+		cache->stacks[cache->count] = stack;
+		cache->ists[cache->count] = ist;
+		cache->count++;
+		irq_nested_enable(flags);
+
+		return;
+	}
+	irq_nested_enable(flags);
+
+	release_stacks(stack, ist);
+}
+
+/** @brief Take a free task id from the lock-free stack
+ *
+ * @return The task id or TID_NIL, if all task structures are in use
+ */
+static tid_t tid_alloc(void)
+{
+	int64_t old, new;
+	tid_t id;
+
+	do {
+		old = atomic_int64_read(&free_tids);
+		id = (tid_t) old;
+		if (id == TID_NIL)
+			return TID_NIL;
+		new = ((old & ~0xFFFFFFFFLL) + (1LL << 32)) | free_tids_next[id];
+	} while (atomic_int64_cmpxchg(&free_tids, old, new) != old);
+
+	return id;
+}
+
+/** @brief Return a task id to the lock-free stack */
+static void tid_free(tid_t id)
+{
+	int64_t old, new;
+
+	do {
+		old = atomic_int64_read(&free_tids);
+		free_tids_next[id] = (tid_t) old;
+		new = ((old & ~0xFFFFFFFFLL) + (1LL << 32)) | id;
+	} while (atomic_int64_cmpxchg(&free_tids, old, new) != old);
+}
+
+int task_table_init(void)
+{
+	size_t n;
+	task_t* table;
+	tid_t* next;
+	uint32_t i;
+	uint8_t flags;
+
+	// the stacks of all tasks may use up to 1/TASK_MEM_SHARE of the memory
+	n = (atomic_int64_read(&total_pages) << PAGE_BITS) / (TASK_MEM_SHARE * (DEFAULT_STACK_SIZE + KERNEL_STACK_SIZE));
+
+	if (cmdline) {
+		char* found = strstr((char*) (size_t) cmdline, "-maxtasks=");
+		if (found)
+			n = atoi(found+strlen("-maxtasks="));
+	}
+
+	// at least one idle task per core and some application threads
+	if (n < 2 * (size_t) possible_cpus + 2)
+		n = 2 * (size_t) possible_cpus + 2;
+	if (n > MAX_TASKS)
+		n = MAX_TASKS;
+
+	table = (task_t*) palloc(n * sizeof(task_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	next = (tid_t*) kmalloc(n * sizeof(tid_t));
+	if (BUILTIN_EXPECT(!table || !next, 0)) {
+		LOG_ERROR("Unable to allocate a task table with %zd entries\n", n);
+		return -ENOMEM;
+	}
+
+	for(i=1; i<n; i++) {
+		memset(table+i, 0x00, sizeof(task_t));
+		table[i].status = TASK_INVALID;
+		table[i].flags = TASK_DEFAULT_FLAGS;
+		next[i] = (i+1 < n) ? i+1 : TID_NIL;
+	}
+
+	// only the boot task exists => move it to the new table
+	flags = irq_nested_disable();
+	memcpy(table, &boot_task, sizeof(task_t));
+	task_table = table;
+	free_tids_next = next;
+	max_tasks = n;
+	set_per_core(current_task, task_table+0);
+	readyqueues[CORE_ID].idle = task_table+0;
+	atomic_int64_set(&free_tids, 1);
+	irq_nested_enable(flags);
+
+	LOG_INFO("Task table provides %u entries\n", max_tasks);
+
+	return 0;
+}
+
+
+/// Mask of a slot index
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SIZE - 1)
+/// Sleeps of at least this number of ticks are mainly handled by the timer wheel
+#define HRTIMER_MAX_TICKS	2
+
+static inline uint64_t cycles_per_tick(void)
+{
+	return (uint64_t) get_cpu_frequency() * 1000000ULL / (uint64_t) TIMER_FREQ;
+}
+
+static inline uint64_t cycles_per_slice(void)
+{
+	return (uint64_t) timeslice * (uint64_t) get_cpu_frequency();
+}
 
-static void update_timer(task_t* first)
+void timeslice_init(void)
 {
-	if(first) {
-		if(first->timeout > get_clock_tick()) {
-			timer_deadline((uint32_t) (first->timeout - get_clock_tick()));
+	if (cmdline) {
+		char* found = strstr((char*) (size_t) cmdline, "-timeslice=");
+		if (found)
+			timeslice = atoi(found+strlen("-timeslice="));
+	}
+
+	if (!timeslice)
+		timeslice = TIME_SLICE_US;
+}
+
+static inline void timer_slot_push(task_t** head, task_t* task)
+{
+	task->prev = NULL;
+	task->next = *head;
+	if (*head)
+		(*head)->prev = task;
+	*head = task;
+	task->timer_slot = head;
+}
+
+/** @brief Store a timer in the wheel, which covers its distance to wheel->tick
+ *
+ * The timeout must not be older than wheel->tick.
+ */
+static void timer_wheel_insert(timer_wheel_t* wheel, task_t* task)
+{
+	uint64_t timeout = task->timeout;
+	uint64_t delta = timeout - wheel->tick;
+	uint32_t lvl, idx;
+
+	for(lvl=0; lvl<TIMER_WHEEL_LEVELS; lvl++) {
+		if (delta < (1ULL << ((lvl+1) * TIMER_WHEEL_BITS))) {
+			idx = (timeout >> (lvl * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+			timer_slot_push(&wheel->slots[lvl][idx], task);
+			wheel->bitmap[lvl] |= (1ULL << idx);
+			return;
+		}
+	}
+
+	timer_slot_push(&wheel->overflow, task);
+}
+
+/** @brief Remove a timer from its slot */
+static void timer_wheel_remove(timer_wheel_t* wheel, task_t* task)
+{
+	task_t** head = task->timer_slot;
+
+	if (task->prev)
+		task->prev->next = task->next;
+	else
+		*head = task->next;
+	if (task->next)
+		task->next->prev = task->prev;
+	task->next = task->prev = NULL;
+	task->timer_slot = NULL;
+
+	// slot is empty => update bitmap of its level
+	if (!*head && (head != &wheel->overflow) && (head != &wheel->hrtimers)) {
+		size_t pos = head - &wheel->slots[0][0];
+
+		wheel->bitmap[pos / TIMER_WHEEL_SIZE] &= ~(1ULL << (pos % TIMER_WHEEL_SIZE));
+	}
+}
+
+/** @brief Insert a high-resolution timer into the sorted list of the wheel */
+static void timer_hr_insert(timer_wheel_t* wheel, task_t* task)
+{
+	task_t* prev = NULL;
+	task_t* next = wheel->hrtimers;
+
+	while (next && (next->timeout <= task->timeout)) {
+		prev = next;
+		next = next->next;
+	}
+
+	task->prev = prev;
+	task->next = next;
+	if (prev)
+		prev->next = task;
+	else
+		wheel->hrtimers = task;
+	if (next)
+		next->prev = task;
+	task->timer_slot = &wheel->hrtimers;
+}
+
+/** @brief Next tick, at which the wheel has to be processed
+ *
+ * For the lowest level, this is the exact expiry of the earliest timer.
+ * For the higher levels, it's the next point, at which a slot is moved
+ * to the lower levels.
+ *
+ * @return next tick or 0, if no timer is pending
+ */
+static uint64_t timer_wheel_next(timer_wheel_t* wheel)
+{
+	uint64_t next = 0, t, rot;
+	uint32_t lvl, shift;
+
+	if (!wheel->count)
+		return 0;
+
+	if (wheel->bitmap[0]) {
+		// search the first used slot behind the current tick
+		shift = (wheel->tick + 1) & TIMER_WHEEL_MASK;
+		rot = (wheel->bitmap[0] >> shift) | (shift ? wheel->bitmap[0] << (TIMER_WHEEL_SIZE - shift) : 0);
+		next = wheel->tick + 1 + lsb(rot);
+	}
+
+	for(lvl=1; lvl<=TIMER_WHEEL_LEVELS; lvl++) {
+		if ((lvl < TIMER_WHEEL_LEVELS) ? !wheel->bitmap[lvl] : !wheel->overflow)
+			continue;
+
+		// next boundary of the lower level
+		t = ((wheel->tick >> (lvl * TIMER_WHEEL_BITS)) + 1) << (lvl * TIMER_WHEEL_BITS);
+		if (!next || (t < next))
+			next = t;
+		break;
+	}
+
+	return next;
+}
+
+/** @brief Move the timers of a higher level slot to the lower levels */
+static void timer_wheel_cascade(timer_wheel_t* wheel, task_t** head)
+{
+	task_t* task;
+
+	while ((task = *head) != NULL) {
+		timer_wheel_remove(wheel, task);
+		timer_wheel_insert(wheel, task);
+	}
+}
+
+static void update_timer(timer_wheel_t* wheel)
+{
+#ifdef DYNAMIC_TICKS
+	uint64_t next = timer_wheel_next(wheel);
+	uint64_t current_tick = get_clock_tick();
+	uint64_t deadline = 0;
+
+	if (wheel->hrtimers)
+		deadline = wheel->hrtimers->timeout;
+
+	// the time slice of the current task may end before
+	// => an expired slice is handled by the scheduler
+	if ((wheel->slice_end > get_rdtsc()) && (!deadline || (wheel->slice_end < deadline)))
+		deadline = wheel->slice_end;
+
+	if (deadline) {
+		// the wheel may expire before the first high-resolution timer
+		if (next) {
+			uint64_t t = get_rdtsc();
+
+			if (next > current_tick)
+				t += (next - current_tick) * cycles_per_tick();
+			if (t < deadline)
+				deadline = t;
+		}
+
+		timer_deadline_tsc(deadline);
+	} else if (next) {
+		if (next > current_tick) {
+			timer_deadline((uint32_t) (next - current_tick));
 		} else {
 			// workaround: start timer so new head will be serviced
 			timer_deadline(1);
@@ -89,86 +484,166 @@ static void update_timer(task_t* first)
 		// prevent spurious interrupts
 		timer_disable();
 	}
+#endif
 }
 
 
 static void timer_queue_remove(uint32_t core_id, task_t* task)
 {
-	if(BUILTIN_EXPECT(!task, 0)) {
+	if(BUILTIN_EXPECT(!task || !task->timer_slot, 0)) {
 		return;
 	}
 
-	task_list_t* timer_queue = &readyqueues[core_id].timers;
+	timer_wheel_t* wheel = &readyqueues[core_id].timers;
 
-#ifdef DYNAMIC_TICKS
-	// if task is first in timer queue, we need to update the oneshot
-	// timer for the next task
-	if(timer_queue->first == task) {
-		update_timer(task->next);
-	}
-#endif
+	if (task->timer_slot != &wheel->hrtimers)
+		wheel->count--;
+	timer_wheel_remove(wheel, task);
 
-	task_list_remove_task(timer_queue, task);
+	// only the own timer can be programmed
+	if (core_id == CORE_ID)
+		update_timer(wheel);
 }
 
 
-static void timer_queue_push(uint32_t core_id, task_t* task)
+static void timer_queue_push(uint32_t core_id, task_t* task, int hr)
 {
-	task_list_t* timer_queue = &readyqueues[core_id].timers;
+	timer_wheel_t* wheel = &readyqueues[core_id].timers;
 
 	spinlock_irqsave_lock(&readyqueues[core_id].lock);
 
-	task_t* first = timer_queue->first;
+	if (hr) {
+		timer_hr_insert(wheel, task);
+	} else {
+		// no pending timers => the wheel is able to skip the idle time
+		if (!wheel->count)
+			wheel->tick = get_clock_tick();
+		// an expired timer is handled with the next tick
+		if (task->timeout <= wheel->tick)
+			task->timeout = wheel->tick + 1;
+
+		timer_wheel_insert(wheel, task);
+		wheel->count++;
+	}
+
+	update_timer(wheel);
 
-	if(!first) {
-		timer_queue->first = timer_queue->last = task;
-		task->next = task->prev = NULL;
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+}
 
-        #ifdef DYNAMIC_TICKS
-		    update_timer(task);
-        #endif
-	} else {
-		// lookup position where to insert task
-		task_t* tmp = first;
-		while(tmp && (task->timeout >= tmp->timeout))
-			tmp = tmp->next;
-
-		if(!tmp) {
-			// insert at the end of queue
-			task->next = NULL;
-			task->prev = timer_queue->last;
-
-			// there has to be a last element because there is also a first one
-			timer_queue->last->next = task;
-			timer_queue->last = task;
-		} else {
-			task->next = tmp;
-			task->prev = tmp->prev;
-			tmp->prev = task;
 
-			if(task->prev)
-				task->prev->next = task;
+/** @brief Start a time slice, if the core has to share its time
+ *
+ * Has to be called with the lock of the ready queue. The scheduler
+ * checks at the end of the slice if a task with the same priority is
+ * waiting and rotates the tasks.
+ */
+static void time_slice_start(uint32_t core_id)
+{
+	timer_wheel_t* wheel = &readyqueues[core_id].timers;
 
-			if(timer_queue->first == tmp) {
-				timer_queue->first = task;
+	if ((readyqueues[core_id].nr_tasks < 2) || wheel->slice_end)
+		return;
 
-                #ifdef DYNAMIC_TICKS
-				    update_timer(task);
-                #endif
-			}
-		}
+	wheel->slice_end = get_rdtsc() + cycles_per_slice();
+
+#ifdef DYNAMIC_TICKS
+	// only the own timer can be programmed => a remote core reprograms
+	// its timer on the exit path of the IPI
+	if (core_id == CORE_ID)
+		update_timer(wheel);
+	else
+		notify_core(core_id);
+#endif
+}
+
+
+/** @brief Update the time slice after a scheduling decision
+ *
+ * A slice is only required, if another task with the same priority is
+ * ready. The preempted task isn't queued yet, but it's waiting as well.
+ */
+static void time_slice_update(uint32_t core_id, task_t* curr_task, int switched, uint64_t now)
+{
+	timer_wheel_t* wheel = &readyqueues[core_id].timers;
+	task_t* old = readyqueues[core_id].old_task;
+	uint64_t slice_end = 0;
+
+	if ((curr_task->status == TASK_RUNNING) && (curr_task->policy == SCHED_NORMAL)
+	    && ((readyqueues[core_id].prio_bitmap & (1 << curr_task->prio))
+	        || (old && (old->status == TASK_READY) && (old->prio == curr_task->prio)))) {
+		slice_end = wheel->slice_end;
+		if (switched || !slice_end || (slice_end <= now))
+			slice_end = now + cycles_per_slice();
 	}
 
-	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+	if (slice_end != wheel->slice_end) {
+		wheel->slice_end = slice_end;
+		update_timer(wheel);
+	}
+}
+
+
+/// Bandwidth of a core, which is available for deadline tasks (95%)
+#define DL_BW_SHIFT	20
+#define DL_BW_MAX	((95ULL << DL_BW_SHIFT) / 100)
+
+static inline uint64_t dl_bandwidth(task_t* task)
+{
+	return (task->dl_runtime << DL_BW_SHIFT) / task->dl_period;
+}
+
+/// Check if task a has to run before task b
+static inline int dl_before(task_t* a, task_t* b)
+{
+	return (a->policy == SCHED_DEADLINE)
+		&& ((b->policy != SCHED_DEADLINE) || (a->dl_deadline < b->dl_deadline));
+}
+
+/** @brief Insert a task in front of all tasks with a later deadline
+ *
+ * Tasks without a deadline are handled as tasks with an infinite deadline.
+ */
+static inline void task_list_insert_deadline(task_list_t* list, task_t* task)
+{
+	task_t* pos;
+
+	for(pos=list->first; pos && !dl_before(task, pos); pos=pos->next)
+		;
+
+	if (!pos) {
+		task_list_push_back(list, task);
+		return;
+	}
+
+	task->next = pos;
+	task->prev = pos->prev;
+	if (pos->prev)
+		pos->prev->next = task;
+	else
+		list->first = task;
+	pos->prev = task;
 }
 
 
 static inline void readyqueues_push_back(uint32_t core_id, task_t* task)
 {
+	task_list_t* readyqueue;
+
+	// a new priority is applied, when the task isn't part of a queue
+	if (task->new_prio) {
+		task->prio = task->new_prio;
+		task->new_prio = 0;
+	}
+
 	// idle task (prio=0) doesn't have a queue
-	task_list_t* readyqueue = &readyqueues[core_id].queue[task->prio - 1];
+	readyqueue = &readyqueues[core_id].queue[task->prio - 1];
 
-	task_list_push_back(readyqueue, task);
+	if (task->policy == SCHED_DEADLINE)
+		task_list_insert_deadline(readyqueue, task);
+	else
+		task_list_push_back(readyqueue, task);
+	task->ready_tsc = get_rdtsc();
 
 	// update priority bitmap
 	readyqueues[core_id].prio_bitmap |= (1 << task->prio);
@@ -188,6 +663,224 @@ static inline void readyqueues_remove(uint32_t core_id, task_t* task)
 }
 
 
+static void isolate_drain(uint32_t core_id);
+
+/// Interval of the periodic load balancing in clock ticks
+#define BALANCE_INTERVAL	(TIMER_FREQ / 10)
+
+/** @brief Pull a ready task from the busiest core
+ *
+ * A task is only moved, if the victim runs at least two tasks more
+ * than the current core. The task, which owns the FPU of the victim,
+ * isn't moved, because its FPU state isn't saved. Deadline tasks and
+ * tasks, whose affinity mask excludes the current core, stay as well.
+ *
+ * @return 1, if a task was moved to the current core
+ */
+static int load_balance(void)
+{
+	const uint32_t core_id = CORE_ID;
+	uint32_t i, victim = MAX_CORES;
+	uint32_t nr_tasks = readyqueues[core_id].nr_tasks;
+	uint32_t max = nr_tasks + 1;
+	task_t* task = NULL;
+	int32_t prio;
+
+	// search the busiest core without holding its lock
+	for(i=0; i<MAX_CORES; i++) {
+		if ((i == core_id) || !readyqueues[i].idle || !readyqueues[i].prio_bitmap)
+			continue;
+		// isolated cores hand over their tasks in isolate_drain()
+		if (readyqueues[i].isolated)
+			continue;
+		if (readyqueues[i].nr_tasks > max) {
+			max = readyqueues[i].nr_tasks;
+			victim = i;
+		}
+	}
+
+	if (victim >= MAX_CORES)
+		return 0;
+
+	spinlock_irqsave_lock(&readyqueues[victim].lock);
+
+	// recheck and take the most recently queued task with the highest priority
+	if (readyqueues[victim].nr_tasks >= nr_tasks + 2) {
+		for(prio=MAX_PRIO; !task && (prio>0); prio--) {
+			if (!(readyqueues[victim].prio_bitmap & (1 << prio)))
+				continue;
+
+			for(task=readyqueues[victim].queue[prio-1].last; task; task=task->prev) {
+				if ((task->status == TASK_READY) && (task->policy == SCHED_NORMAL)
+				    && task_affinity_isset(task, core_id)
+				    && (readyqueues[victim].fpu_owner != task->id))
+					break;
+			}
+		}
+
+		if (task) {
+			readyqueues_remove(victim, task);
+			readyqueues[victim].nr_tasks--;
+			readyqueues[victim].migrated_out++;
+		}
+	}
+
+	spinlock_irqsave_unlock(&readyqueues[victim].lock);
+
+	if (!task)
+		return 0;
+
+	LOG_DEBUG("move task %u from core %u to core %u\n", task->id, victim, core_id);
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	task->last_core = core_id;
+	readyqueues_push_back(core_id, task);
+	readyqueues[core_id].nr_tasks++;
+	readyqueues[core_id].migrated_in++;
+	time_slice_start(core_id);
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	return 1;
+}
+
+void check_balance(void)
+{
+	const uint32_t core_id = CORE_ID;
+	const uint64_t tick = get_clock_tick();
+	uint32_t i;
+
+	if (BUILTIN_EXPECT(go_down || !readyqueues[core_id].idle, 0))
+		return;
+
+	// an isolated core doesn't take tasks, but it hands over the tasks of other owners
+	if (readyqueues[core_id].isolated) {
+		if (readyqueues[core_id].prio_bitmap)
+			isolate_drain(core_id);
+		return;
+	}
+
+	// an idle core steals work immediately
+	if (!readyqueues[core_id].nr_tasks) {
+		readyqueues[core_id].balance_kick = 0;
+		load_balance();
+		return;
+	}
+
+	if (tick - readyqueues[core_id].last_balance < BALANCE_INTERVAL)
+		return;
+	readyqueues[core_id].last_balance = tick;
+
+	if (load_balance() || (readyqueues[core_id].nr_tasks < 2))
+		return;
+
+	// we are overloaded => ask a sleeping core to take over a task
+	for(i=0; i<MAX_CORES; i++) {
+		if ((i == core_id) || !readyqueues[i].idle || readyqueues[i].nr_tasks || readyqueues[i].isolated)
+			continue;
+
+		// touch the monitored cache line of a core waiting with mwait
+		readyqueues[i].balance_kick = 1;
+		wakeup_core(i);
+		break;
+	}
+}
+
+void print_sched_stats(void)
+{
+	uint64_t migrations = 0;
+	uint32_t i;
+
+	for(i=0; i<MAX_CORES; i++) {
+		if (!readyqueues[i].migrated_in && !readyqueues[i].migrated_out)
+			continue;
+
+		LOG_INFO("Core %u: %llu tasks pulled, %llu tasks handed over\n",
+			i, readyqueues[i].migrated_in, readyqueues[i].migrated_out);
+		migrations += readyqueues[i].migrated_in;
+	}
+
+	LOG_INFO("Load balancer moved %llu tasks\n", migrations);
+}
+
+int sched_stats(uint32_t core_id, size_t* migrated_in, size_t* migrated_out)
+{
+	if (BUILTIN_EXPECT((core_id >= MAX_CORES) || !readyqueues[core_id].idle, 0))
+		return -EINVAL;
+
+	if (migrated_in)
+		*migrated_in = readyqueues[core_id].migrated_in;
+	if (migrated_out)
+		*migrated_out = readyqueues[core_id].migrated_out;
+
+	return 0;
+}
+
+static inline uint64_t cycles_to_ns(uint64_t cycles)
+{
+	return (cycles * 1000ULL) / (uint64_t) get_cpu_frequency();
+}
+
+/** @brief Read the counters of a task including the current period (in cycles) */
+static void task_account(task_t* task, uint64_t* run, uint64_t* wait, uint64_t* nvcsw, uint64_t* nivcsw)
+{
+	const uint32_t core_id = task->last_core;
+	uint64_t now;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+	now = get_rdtsc();
+	*run = task->run_cycles;
+	*wait = task->wait_cycles;
+	if ((task->status == TASK_RUNNING) && task->last_tsc)
+		*run += now - task->last_tsc;
+	else if (task->status == TASK_READY)
+		*wait += now - task->ready_tsc;
+	*nvcsw = task->nvcsw;
+	*nivcsw = task->nivcsw;
+
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+}
+
+int task_usage(tid_t id, uint64_t* run_ns, uint64_t* wait_ns, uint64_t* nvcsw, uint64_t* nivcsw)
+{
+	uint64_t run, wait, vcsw, ivcsw;
+
+	if (BUILTIN_EXPECT((id >= max_tasks) || (task_table[id].status == TASK_INVALID), 0))
+		return -EINVAL;
+
+	task_account(task_table+id, &run, &wait, &vcsw, &ivcsw);
+
+	if (run_ns)
+		*run_ns = cycles_to_ns(run);
+	if (wait_ns)
+		*wait_ns = cycles_to_ns(wait);
+	if (nvcsw)
+		*nvcsw = vcsw;
+	if (nivcsw)
+		*nivcsw = ivcsw;
+
+	return 0;
+}
+
+uint64_t total_run_time(void)
+{
+	uint64_t total = atomic_int64_read(&exited_cycles);
+	uint64_t run, wait, vcsw, ivcsw;
+	tid_t i;
+
+	for(i=0; i<max_tasks; i++) {
+		const uint32_t status = task_table[i].status;
+
+		if ((status == TASK_INVALID) || (status == TASK_IDLE))
+			continue;
+
+		task_account(task_table+i, &run, &wait, &vcsw, &ivcsw);
+		total += run;
+	}
+
+	return cycles_to_ns(total);
+}
+
 void fpu_handler(void)
 {
 	task_t* task = per_core(current_task);
@@ -226,19 +919,15 @@ void check_scheduling(void)
 
 	if (prio > curr_task->prio) {
 		reschedule();
-#ifdef DYNAMIC_TICKS
 	} else if ((prio > 0) && (prio == curr_task->prio)) {
-		// if a task is ready, check if the current task runs already one tick (one time slice)
-		// => reschedule to realize round robin
-
-		const uint64_t diff_cycles = get_rdtsc() - curr_task->last_tsc;
-		const uint64_t cpu_freq_hz = 1000000ULL * (uint64_t) get_cpu_frequency();
+		// if a task is ready, check if the time slice of the current task is
+		// expired => reschedule to realize round robin
+		const uint64_t slice_end = readyqueues[CORE_ID].timers.slice_end;
 
-		if (((diff_cycles * (uint64_t) TIMER_FREQ) / cpu_freq_hz) > 0) {
+		if (!slice_end || (get_rdtsc() >= slice_end)) {
 			LOG_DEBUG("Time slice expired for task %d on core %d. New task has priority %u.\n", curr_task->id, CORE_ID, prio);
 			reschedule();
 		}
-#endif
 	}
 }
 
@@ -282,38 +971,33 @@ int multitasking_init(void)
 
 int set_idle_task(void)
 {
-	uint32_t i, core_id = CORE_ID;
-	int ret = -ENOMEM;
-
-	spinlock_irqsave_lock(&table_lock);
-
-	for(i=0; i<MAX_TASKS; i++) {
-		if (task_table[i].status == TASK_INVALID) {
-			task_table[i].id = i;
-			task_table[i].status = TASK_IDLE;
-			task_table[i].last_core = core_id;
-			task_table[i].last_stack_pointer = NULL;
-			task_table[i].stack = (char*) ((size_t)&boot_stack + core_id * KERNEL_STACK_SIZE);
-			task_table[i].ist_addr = create_stack(KERNEL_STACK_SIZE);
-			task_table[i].prio = IDLE_PRIO;
-			task_table[i].heap = NULL;
-			readyqueues[core_id].idle = task_table+i;
-			set_per_core(current_task, readyqueues[core_id].idle);
-			arch_init_task(task_table+i);
-			ret = 0;
+	uint32_t core_id = CORE_ID;
+	tid_t i;
 
-			break;
-		}
-	}
+	i = tid_alloc();
+	if (BUILTIN_EXPECT(i == TID_NIL, 0))
+		return -ENOMEM;
 
-	spinlock_irqsave_unlock(&table_lock);
+	task_table[i].id = i;
+	task_table[i].status = TASK_IDLE;
+	task_table[i].last_core = core_id;
+	task_table[i].last_stack_pointer = NULL;
+	task_table[i].stack = (char*) ((size_t)&boot_stack + core_id * KERNEL_STACK_SIZE);
+	task_table[i].ist_addr = create_stack(KERNEL_STACK_SIZE);
+	task_table[i].prio = IDLE_PRIO;
+	task_table[i].heap = NULL;
+	task_table[i].last_tsc = task_table[i].run_cycles = 0;
+	readyqueues[core_id].idle = task_table+i;
+	set_per_core(current_task, readyqueues[core_id].idle);
+	arch_init_task(task_table+i);
 
-	return ret;
+	return 0;
 }
 
 void finish_task_switch(void)
 {
 	task_t* old;
+	task_t* migrate = NULL;
 	const uint32_t core_id = CORE_ID;
 
 	spinlock_irqsave_lock(&readyqueues[core_id].lock);
@@ -323,22 +1007,16 @@ void finish_task_switch(void)
 
 		if (old->status == TASK_FINISHED) {
 			/* cleanup task */
-			if (old->stack) {
-				LOG_INFO("Release stack at 0x%zx\n", old->stack);
-				destroy_stack(old->stack, DEFAULT_STACK_SIZE);
-				old->stack = NULL;
-			}
+			LOG_DEBUG("Release stack at 0x%zx\n", old->stack);
+			put_stacks(old->stack, old->ist_addr);
+			old->stack = NULL;
+			old->ist_addr = NULL;
 
 			if (!old->parent && old->heap) {
 				kfree(old->heap);
 				old->heap = NULL;
 			}
 
-			if (old->ist_addr) {
-				destroy_stack(old->ist_addr, KERNEL_STACK_SIZE);
-				old->ist_addr = NULL;
-			}
-
 			old->last_stack_pointer = NULL;
 
 			if (readyqueues[core_id].fpu_owner == old->id)
@@ -346,6 +1024,10 @@ void finish_task_switch(void)
 
 			/* signalizes that this task could be reused */
 			old->status = TASK_INVALID;
+			tid_free(old->id);
+		} else if (old->flags & TASK_MIGRATE) {
+			// the stack isn't used anymore => the new core is able to run the task
+			migrate = old;
 		} else {
 			// re-enqueue old task
 			readyqueues_push_back(core_id, old);
@@ -353,6 +1035,11 @@ void finish_task_switch(void)
 	}
 
 	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	if (migrate) {
+		migrate->flags &= ~TASK_MIGRATE;
+		wakeup_task(migrate->id);
+	}
 }
 
 
@@ -369,8 +1056,21 @@ void NORETURN do_exit(int arg)
 	// decrease the number of active tasks
 	spinlock_irqsave_lock(&readyqueues[core_id].lock);
 	readyqueues[core_id].nr_tasks--;
+	atomic_int64_add(&exited_cycles, curr_task->run_cycles + (get_rdtsc() - curr_task->last_tsc));
+	// release the core and the reserved bandwidth
+	if (readyqueues[core_id].isolated == curr_task)
+		readyqueues[core_id].isolated = NULL;
+	if (curr_task->policy == SCHED_DEADLINE) {
+		readyqueues[core_id].dl_bandwidth -= dl_bandwidth(curr_task);
+		curr_task->policy = SCHED_NORMAL;
+	}
 	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
 
+	if (curr_task->uhyve_segs) {
+		page_free(curr_task->uhyve_segs, PAGE_SIZE);
+		curr_task->uhyve_segs = NULL;
+	}
+
 	// do we need to release the TLS?
 	tls_addr = (void*)get_tls();
 	if (tls_addr) {
@@ -403,25 +1103,39 @@ void NORETURN do_abort(void) {
 }
 
 
-static uint32_t get_next_core_id(void)
+static inline int core_available(uint32_t core_id, const task_t* task)
 {
-	uint32_t i;
-	static uint32_t core_id = MAX_CORES;
+	return readyqueues[core_id].idle && !readyqueues[core_id].isolated
+		&& (!task || task_affinity_isset(task, core_id));
+}
 
-	if (core_id >= MAX_CORES)
-		core_id = CORE_ID;
+/** @brief Select the next core for a task in a round-robin fashion
+ *
+ * @param task Task, whose affinity mask restricts the choice, or NULL
+ * @return Core id or MAX_CORES, if no core is available
+ */
+static uint32_t get_next_core_id(const task_t* task)
+{
+	uint32_t i, core_id;
+	int32_t old;
+	static atomic_int32_t next_core = ATOMIC_INIT(MAX_CORES);
 
 	// we assume OpenMP applications
 	// => number of threads is (normaly) equal to the number of cores
 	// => search next available core
-	for(i=0, core_id=(core_id+1)%MAX_CORES; i<2*MAX_CORES; i++, core_id=(core_id+1)%MAX_CORES)
-		if (readyqueues[core_id].idle)
-			break;
+	do {
+		old = atomic_int32_read(&next_core);
+		core_id = (old >= MAX_CORES) ? CORE_ID : (uint32_t) old;
 
-	if (BUILTIN_EXPECT(!readyqueues[core_id].idle, 0)) {
-		LOG_ERROR("BUG: no core available!\n");
-		return MAX_CORES;
-	}
+		for(i=0, core_id=(core_id+1)%MAX_CORES; i<2*MAX_CORES; i++, core_id=(core_id+1)%MAX_CORES)
+			if (core_available(core_id, task))
+				break;
+
+		if (BUILTIN_EXPECT(!core_available(core_id, task), 0)) {
+			LOG_ERROR("No core available for task %d\n", task ? (int) task->id : -1);
+			return MAX_CORES;
+		}
+	} while (atomic_int32_cmpxchg(&next_core, old, core_id) != old);
 
 	return core_id;
 }
@@ -445,84 +1159,82 @@ int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio)
 
 	curr_task = per_core(current_task);
 
-	stack = create_stack(DEFAULT_STACK_SIZE);
-	if (BUILTIN_EXPECT(!stack, 0))
+	if (BUILTIN_EXPECT(get_stacks(&stack, &ist), 0))
 		return -ENOMEM;
 
-	ist =  create_stack(KERNEL_STACK_SIZE);
-	if (BUILTIN_EXPECT(!ist, 0)) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		return -ENOMEM;
+	// the new task inherits the affinity mask of its parent
+	core_id = get_next_core_id(curr_task);
+	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0)) {
+		ret = -EINVAL;
+		goto out;
 	}
 
-	spinlock_irqsave_lock(&table_lock);
-
-	core_id = get_next_core_id();
-	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0))
-	{
-		spinlock_irqsave_unlock(&table_lock);
-		ret = -EINVAL;
+	i = tid_alloc();
+	if (BUILTIN_EXPECT(i == TID_NIL, 0)) {
+		ret = -ENOMEM;
 		goto out;
 	}
 
-	for(i=0; i<MAX_TASKS; i++) {
-		if (task_table[i].status == TASK_INVALID) {
-			task_table[i].id = i;
-			task_table[i].status = TASK_READY;
-			task_table[i].last_core = core_id;
-			task_table[i].last_stack_pointer = NULL;
-			task_table[i].stack = stack;
-			task_table[i].prio = prio;
-			task_table[i].heap = curr_task->heap;
-			task_table[i].start_tick = get_clock_tick();
-			task_table[i].last_tsc = 0;
-			task_table[i].parent = curr_task->id;
-			task_table[i].tls_addr = curr_task->tls_addr;
-			task_table[i].tls_size = curr_task->tls_size;
-			task_table[i].ist_addr = ist;
-			task_table[i].lwip_err = 0;
-			task_table[i].signal_handler = NULL;
-
-			if (id)
-				*id = i;
-
-			ret = create_default_frame(task_table+i, ep, arg, core_id);
-			if (ret)
-				goto out;
-
-                        // add task in the readyqueues
-			spinlock_irqsave_lock(&readyqueues[core_id].lock);
-			readyqueues[core_id].prio_bitmap |= (1 << prio);
-			readyqueues[core_id].nr_tasks++;
-			if (!readyqueues[core_id].queue[prio-1].first) {
-				task_table[i].next = task_table[i].prev = NULL;
-				readyqueues[core_id].queue[prio-1].first = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			} else {
-				task_table[i].prev = readyqueues[core_id].queue[prio-1].last;
-				task_table[i].next = NULL;
-				readyqueues[core_id].queue[prio-1].last->next = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			}
-			// should we wakeup the core?
-			if (readyqueues[core_id].nr_tasks == 1)
-				wakeup_core(core_id);
-			spinlock_irqsave_unlock(&readyqueues[core_id].lock);
- 			break;
-		}
+	task_table[i].id = i;
+	task_table[i].status = TASK_READY;
+	task_table[i].last_core = core_id;
+	task_table[i].last_stack_pointer = NULL;
+	task_table[i].stack = stack;
+	task_table[i].prio = prio;
+	task_table[i].policy = SCHED_NORMAL;
+	task_table[i].new_prio = 0;
+	task_table[i].dl_runtime = task_table[i].dl_period = 0;
+	task_table[i].dl_deadline = task_table[i].dl_misses = 0;
+	memcpy(task_table[i].affinity, curr_task->affinity, sizeof(task_table[i].affinity));
+	task_table[i].heap = curr_task->heap;
+	task_table[i].start_tick = get_clock_tick();
+	task_table[i].last_tsc = 0;
+	task_table[i].ready_tsc = get_rdtsc();
+	task_table[i].run_cycles = task_table[i].wait_cycles = 0;
+	task_table[i].nvcsw = task_table[i].nivcsw = 0;
+	task_table[i].parent = curr_task->id;
+	task_table[i].tls_addr = curr_task->tls_addr;
+	task_table[i].tls_size = curr_task->tls_size;
+	task_table[i].ist_addr = ist;
+	task_table[i].lwip_err = 0;
+	task_table[i].signal_handler = NULL;
+	task_table[i].uhyve_segs = NULL;
+
+	ret = create_default_frame(task_table+i, ep, arg, core_id);
+	if (ret) {
+		task_table[i].status = TASK_INVALID;
+		tid_free(i);
+		goto out;
 	}
 
-	spinlock_irqsave_unlock(&table_lock);
+	if (id)
+		*id = i;
 
-	if (!ret) {
-		LOG_DEBUG("start new thread %d on core %d with stack address %p\n", i, core_id, stack);
+	// add task in the readyqueues
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	readyqueues[core_id].prio_bitmap |= (1 << prio);
+	readyqueues[core_id].nr_tasks++;
+	if (!readyqueues[core_id].queue[prio-1].first) {
+		task_table[i].next = task_table[i].prev = NULL;
+		readyqueues[core_id].queue[prio-1].first = task_table+i;
+		readyqueues[core_id].queue[prio-1].last = task_table+i;
+	} else {
+		task_table[i].prev = readyqueues[core_id].queue[prio-1].last;
+		task_table[i].next = NULL;
+		readyqueues[core_id].queue[prio-1].last->next = task_table+i;
+		readyqueues[core_id].queue[prio-1].last = task_table+i;
 	}
+	// should we wakeup the core?
+	if (readyqueues[core_id].nr_tasks == 1)
+		wakeup_core(core_id);
+	time_slice_start(core_id);
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	LOG_DEBUG("start new thread %d on core %d with stack address %p\n", i, core_id, stack);
 
 out:
-	if (ret) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		destroy_stack(ist, KERNEL_STACK_SIZE);
-	}
+	if (ret)
+		put_stacks(stack, ist);
 
 	return ret;
 }
@@ -546,80 +1258,80 @@ int create_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio, uint32_t c
 		return -EINVAL;
 	if (BUILTIN_EXPECT(!readyqueues[core_id].idle, 0))
 		return -EINVAL;
+	if (BUILTIN_EXPECT(readyqueues[core_id].isolated != NULL, 0))
+		return -EBUSY;
 
-	stack = create_stack(DEFAULT_STACK_SIZE);
-	if (BUILTIN_EXPECT(!stack, 0))
+	if (BUILTIN_EXPECT(get_stacks(&stack, &ist), 0))
 		return -ENOMEM;
 
-	ist = create_stack(KERNEL_STACK_SIZE);
-	if (BUILTIN_EXPECT(!ist, 0)) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		return -ENOMEM;
-	}
-
 	counter = kmalloc(sizeof(atomic_int64_t));
 	if (BUILTIN_EXPECT(!counter, 0)) {
-		destroy_stack(stack, KERNEL_STACK_SIZE);
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
+		put_stacks(stack, ist);
 		return -ENOMEM;
 	}
 	atomic_int64_set((atomic_int64_t*) counter, 0);
 
-	spinlock_irqsave_lock(&table_lock);
-
-	for(i=0; i<MAX_TASKS; i++) {
-		if (task_table[i].status == TASK_INVALID) {
-			task_table[i].id = i;
-			task_table[i].status = TASK_READY;
-			task_table[i].last_core = core_id;
-			task_table[i].last_stack_pointer = NULL;
-			task_table[i].stack = stack;
-			task_table[i].prio = prio;
-			task_table[i].heap = NULL;
-			task_table[i].start_tick = get_clock_tick();
-			task_table[i].last_tsc = 0;
-			task_table[i].parent = 0;
-			task_table[i].ist_addr = ist;
-			task_table[i].tls_addr = 0;
-			task_table[i].tls_size = 0;
-			task_table[i].lwip_err = 0;
-			task_table[i].signal_handler = NULL;
-
-			if (id)
-				*id = i;
-
-			ret = create_default_frame(task_table+i, ep, arg, core_id);
-			if (ret)
-				goto out;
-
-			// add task in the readyqueues
-			spinlock_irqsave_lock(&readyqueues[core_id].lock);
-			readyqueues[core_id].prio_bitmap |= (1 << prio);
-			readyqueues[core_id].nr_tasks++;
-			if (!readyqueues[core_id].queue[prio-1].first) {
-				task_table[i].next = task_table[i].prev = NULL;
-				readyqueues[core_id].queue[prio-1].first = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			} else {
-				task_table[i].prev = readyqueues[core_id].queue[prio-1].last;
-				task_table[i].next = NULL;
-				readyqueues[core_id].queue[prio-1].last->next = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			}
-			spinlock_irqsave_unlock(&readyqueues[core_id].lock);
-			break;
-		}
+	i = tid_alloc();
+	if (BUILTIN_EXPECT(i == TID_NIL, 0))
+		goto out;
+
+	task_table[i].id = i;
+	task_table[i].status = TASK_READY;
+	task_table[i].last_core = core_id;
+	task_table[i].last_stack_pointer = NULL;
+	task_table[i].stack = stack;
+	task_table[i].prio = prio;
+	task_table[i].policy = SCHED_NORMAL;
+	task_table[i].new_prio = 0;
+	task_table[i].dl_runtime = task_table[i].dl_period = 0;
+	task_table[i].dl_deadline = task_table[i].dl_misses = 0;
+	memset(task_table[i].affinity, 0xFF, sizeof(task_table[i].affinity));
+	task_table[i].heap = NULL;
+	task_table[i].start_tick = get_clock_tick();
+	task_table[i].last_tsc = 0;
+	task_table[i].ready_tsc = get_rdtsc();
+	task_table[i].run_cycles = task_table[i].wait_cycles = 0;
+	task_table[i].nvcsw = task_table[i].nivcsw = 0;
+	task_table[i].parent = 0;
+	task_table[i].ist_addr = ist;
+	task_table[i].tls_addr = 0;
+	task_table[i].tls_size = 0;
+	task_table[i].lwip_err = 0;
+	task_table[i].signal_handler = NULL;
+	task_table[i].uhyve_segs = NULL;
+
+	ret = create_default_frame(task_table+i, ep, arg, core_id);
+	if (ret) {
+		task_table[i].status = TASK_INVALID;
+		tid_free(i);
+		goto out;
 	}
 
-	if (!ret)
-		LOG_INFO("start new task %d on core %d with stack address %p\n", i, core_id, stack);
+	if (id)
+		*id = i;
 
-out:
-	spinlock_irqsave_unlock(&table_lock);
+	// add task in the readyqueues
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	readyqueues[core_id].prio_bitmap |= (1 << prio);
+	readyqueues[core_id].nr_tasks++;
+	if (!readyqueues[core_id].queue[prio-1].first) {
+		task_table[i].next = task_table[i].prev = NULL;
+		readyqueues[core_id].queue[prio-1].first = task_table+i;
+		readyqueues[core_id].queue[prio-1].last = task_table+i;
+	} else {
+		task_table[i].prev = readyqueues[core_id].queue[prio-1].last;
+		task_table[i].next = NULL;
+		readyqueues[core_id].queue[prio-1].last->next = task_table+i;
+		readyqueues[core_id].queue[prio-1].last = task_table+i;
+	}
+	time_slice_start(core_id);
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	LOG_INFO("start new task %d on core %d with stack address %p\n", i, core_id, stack);
 
+out:
 	if (ret) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		destroy_stack(ist, KERNEL_STACK_SIZE);
+		put_stacks(stack, ist);
 		kfree(counter);
 	}
 
@@ -657,7 +1369,8 @@ int wakeup_task(tid_t id)
 	task = &task_table[id];
 	core_id = task->last_core;
 
-	if (task->status == TASK_BLOCKED) {
+	// a migrating task is woken up by finish_task_switch()
+	if ((task->status == TASK_BLOCKED) && !(task->flags & TASK_MIGRATE)) {
 		LOG_DEBUG("wakeup task %d on core %d\n", id, core_id);
 
 		task->status = TASK_READY;
@@ -665,6 +1378,13 @@ int wakeup_task(tid_t id)
 
 		spinlock_irqsave_lock(&readyqueues[core_id].lock);
 
+		// isolate_drain() may have moved the timer to another core
+		while (BUILTIN_EXPECT(task->last_core != core_id, 0)) {
+			spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+			core_id = task->last_core;
+			spinlock_irqsave_lock(&readyqueues[core_id].lock);
+		}
+
 		// if task is in timer queue, remove it
 		if (task->flags & TASK_TIMER) {
 			task->flags &= ~TASK_TIMER;
@@ -672,6 +1392,20 @@ int wakeup_task(tid_t id)
 			timer_queue_remove(core_id, task);
 		}
 
+		// an isolated core runs only its owner and a task runs only on cores of its
+		// affinity mask => move the task, unless its FPU state is still in the
+		// registers of the core
+		if (BUILTIN_EXPECT(((readyqueues[core_id].isolated && (readyqueues[core_id].isolated != task))
+		    || !task_affinity_isset(task, core_id)) && (readyqueues[core_id].fpu_owner != task->id), 0)) {
+			const uint32_t dest = get_next_core_id(task);
+
+			if (dest < MAX_CORES) {
+				spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+				core_id = task->last_core = dest;
+				spinlock_irqsave_lock(&readyqueues[core_id].lock);
+			}
+		}
+
 		// add task to the ready queue
 		readyqueues_push_back(core_id, task);
 
@@ -681,6 +1415,7 @@ int wakeup_task(tid_t id)
 		// should we wakeup the core?
 		if (readyqueues[core_id].nr_tasks == 1)
 			wakeup_core(core_id);
+		time_slice_start(core_id);
 
 		LOG_DEBUG("update nr_tasks on core %d to %d\n", core_id, readyqueues[core_id].nr_tasks);
 
@@ -736,7 +1471,452 @@ int block_current_task(void)
 }
 
 
-int set_timer(uint64_t deadline)
+/** @brief Move the current task to another core
+ *
+ * The task leaves its core like a blocked task. As soon as its stack
+ * isn't used anymore, finish_task_switch() wakes up the task on the new core.
+ */
+static void migrate_current_task(uint32_t core_id)
+{
+	task_t* curr_task = per_core(current_task);
+	const uint32_t src = CORE_ID;
+	uint8_t flags;
+
+	if (core_id == src)
+		return;
+
+	flags = irq_nested_disable();
+
+	// the FPU state is kept in the registers of this core => save it
+	spinlock_irqsave_lock(&readyqueues[src].lock);
+	if (readyqueues[src].fpu_owner == curr_task->id) {
+		save_fpu_state(&curr_task->fpu);
+		curr_task->flags &= ~TASK_FPU_USED;
+		readyqueues[src].fpu_owner = 0;
+	}
+	spinlock_irqsave_unlock(&readyqueues[src].lock);
+
+	curr_task->flags |= TASK_MIGRATE;
+	block_task(curr_task->id);
+	curr_task->last_core = core_id;
+	reschedule();
+
+	irq_nested_enable(flags);
+}
+
+
+/** @brief Search a timer of the wheel, which doesn't belong to the task owner */
+static task_t* timer_wheel_foreign(timer_wheel_t* wheel, task_t* owner)
+{
+	uint32_t lvl, idx;
+	task_t* task;
+
+	for(task=wheel->hrtimers; task; task=task->next) {
+		if (task != owner)
+			return task;
+	}
+
+	for(task=wheel->overflow; task; task=task->next) {
+		if (task != owner)
+			return task;
+	}
+
+	for(lvl=0; lvl<TIMER_WHEEL_LEVELS; lvl++) {
+		if (!wheel->bitmap[lvl])
+			continue;
+
+		for(idx=0; idx<TIMER_WHEEL_SIZE; idx++) {
+			for(task=wheel->slots[lvl][idx]; task; task=task->next) {
+				if (task != owner)
+					return task;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/** @brief Move the timer of a blocked task from an isolated core to dest
+ *
+ * The task has already been removed from the wheel of its previous core
+ * and its last_core points to dest. A wakeup in between makes the timer
+ * obsolete.
+ */
+static void isolate_move_timer(uint32_t dest, task_t* task, int hr)
+{
+	timer_wheel_t* wheel = &readyqueues[dest].timers;
+
+	spinlock_irqsave_lock(&readyqueues[dest].lock);
+
+	if ((task->status == TASK_BLOCKED) && (task->flags & TASK_TIMER) && !task->timer_slot) {
+		if (hr) {
+			timer_hr_insert(wheel, task);
+		} else {
+			if (!wheel->count)
+				wheel->tick = get_clock_tick();
+			if (task->timeout <= wheel->tick)
+				task->timeout = wheel->tick + 1;
+
+			timer_wheel_insert(wheel, task);
+			wheel->count++;
+		}
+
+#ifdef DYNAMIC_TICKS
+		if (dest == CORE_ID)
+			update_timer(wheel);
+		else
+			notify_core(dest);
+#endif
+	}
+
+	spinlock_irqsave_unlock(&readyqueues[dest].lock);
+}
+
+/** @brief Move all ready tasks except the owner away from an isolated core
+ *
+ * Tasks, which own the FPU of the core, stay until the owner uses the FPU.
+ * The timers of blocked tasks are moved to the cores, which wake them up.
+ */
+static void isolate_drain(uint32_t core_id)
+{
+	task_t* task;
+	uint32_t dest = MAX_CORES;
+	int32_t prio;
+
+	do {
+		task = NULL;
+
+		spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+		for(prio=MAX_PRIO; !task && (prio>0); prio--) {
+			if (!(readyqueues[core_id].prio_bitmap & (1 << prio)))
+				continue;
+
+			for(task=readyqueues[core_id].queue[prio-1].first; task; task=task->next) {
+				if ((task != readyqueues[core_id].isolated) && (task->status == TASK_READY)
+				    && (readyqueues[core_id].fpu_owner != task->id))
+					break;
+			}
+		}
+
+		if (task) {
+			readyqueues_remove(core_id, task);
+			readyqueues[core_id].nr_tasks--;
+			readyqueues[core_id].migrated_out++;
+		}
+
+		spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+		if (!task)
+			break;
+
+		dest = get_next_core_id(task);
+		if (BUILTIN_EXPECT(dest >= MAX_CORES, 0))
+			dest = core_id;
+
+		LOG_DEBUG("move task %u from isolated core %u to core %u\n", task->id, core_id, dest);
+
+		spinlock_irqsave_lock(&readyqueues[dest].lock);
+		task->last_core = dest;
+		readyqueues_push_back(dest, task);
+		readyqueues[dest].nr_tasks++;
+		readyqueues[dest].migrated_in++;
+		if (readyqueues[dest].nr_tasks == 1)
+			wakeup_core(dest);
+		time_slice_start(dest);
+		spinlock_irqsave_unlock(&readyqueues[dest].lock);
+	} while (dest != core_id);
+
+	// the blocked tasks are woken up on other cores => move their timers,
+	// so that the isolated core only handles the timers of its owner
+	do {
+		timer_wheel_t* wheel = &readyqueues[core_id].timers;
+		int hr = 0;
+
+		spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+		task = timer_wheel_foreign(wheel, readyqueues[core_id].isolated);
+		dest = task ? get_next_core_id(task) : MAX_CORES;
+		if (task && (dest < MAX_CORES) && (dest != core_id)) {
+			hr = (task->timer_slot == &wheel->hrtimers);
+			if (!hr)
+				wheel->count--;
+			timer_wheel_remove(wheel, task);
+			task->last_core = dest;
+		} else task = NULL;
+
+		if (!task && (core_id == CORE_ID))
+			update_timer(wheel);
+
+		spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+		if (task) {
+			LOG_DEBUG("move timer of task %u from isolated core %u to core %u\n", task->id, core_id, dest);
+			isolate_move_timer(dest, task, hr);
+		}
+	} while (task);
+}
+
+
+int isolate_task(uint32_t core_id)
+{
+	task_t* curr_task = per_core(current_task);
+	uint32_t i, free_cores = 0;
+	uint8_t flags;
+	int ret = 0;
+
+	if (BUILTIN_EXPECT((core_id >= MAX_CORES) || !readyqueues[core_id].idle, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!task_affinity_isset(curr_task, core_id), 0))
+		return -EINVAL;
+	// the bandwidth of a deadline task is reserved on its core
+	if (BUILTIN_EXPECT((curr_task->policy == SCHED_DEADLINE) && (core_id != CORE_ID), 0))
+		return -EINVAL;
+
+	// at least one core has to run the remaining tasks
+	for(i=0; i<MAX_CORES; i++) {
+		if ((i != core_id) && readyqueues[i].idle && !readyqueues[i].isolated)
+			free_cores++;
+	}
+	if (BUILTIN_EXPECT(!free_cores, 0))
+		return -EBUSY;
+
+	flags = irq_nested_disable();
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	if (readyqueues[core_id].isolated && (readyqueues[core_id].isolated != curr_task))
+		ret = -EBUSY;
+	else
+		readyqueues[core_id].isolated = curr_task;
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	// release the previous core of the task
+	if (!ret && (core_id != CORE_ID) && (readyqueues[CORE_ID].isolated == curr_task))
+		readyqueues[CORE_ID].isolated = NULL;
+
+	irq_nested_enable(flags);
+
+	if (ret)
+		return ret;
+
+	migrate_current_task(core_id);
+	isolate_drain(core_id);
+
+	LOG_INFO("Task %u owns core %u exclusively\n", curr_task->id, core_id);
+#ifndef DYNAMIC_TICKS
+	LOG_WARNING("Core %u still receives the periodic timer interrupt\n", core_id);
+#endif
+
+	return 0;
+}
+
+
+int unisolate_task(void)
+{
+	task_t* curr_task = per_core(current_task);
+	const uint32_t core_id = CORE_ID;
+	int ret = -EINVAL;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	if (readyqueues[core_id].isolated == curr_task) {
+		readyqueues[core_id].isolated = NULL;
+		ret = 0;
+	}
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	return ret;
+}
+
+
+int set_task_affinity(tid_t id, const void* mask, size_t size)
+{
+	uint64_t affinity[AFFINITY_WORDS];
+	task_t* task;
+	uint32_t i, core_id = MAX_CORES;
+	uint8_t flags;
+	int ret = 0;
+
+	if (BUILTIN_EXPECT(!mask || (id >= max_tasks), 0))
+		return -EINVAL;
+
+	memset(affinity, 0x00, sizeof(affinity));
+	memcpy(affinity, mask, size < sizeof(affinity) ? size : sizeof(affinity));
+
+	// at least one online core has to be part of the mask
+	for(i=0; i<MAX_CORES; i++) {
+		if (readyqueues[i].idle && ((affinity[i / 64] >> (i % 64)) & 1))
+			break;
+	}
+	if (BUILTIN_EXPECT(i >= MAX_CORES, 0))
+		return -EINVAL;
+
+	flags = irq_nested_disable();
+
+	task = task_table + id;
+	if ((task->status == TASK_INVALID) || (task->status == TASK_IDLE) || (task->status == TASK_FINISHED)) {
+		ret = -EINVAL;
+	} else if ((task->policy == SCHED_DEADLINE) || (readyqueues[task->last_core].isolated == task)) {
+		// deadline tasks and owners of an isolated core stay on their core
+		if (!((affinity[task->last_core / 64] >> (task->last_core % 64)) & 1))
+			ret = -EBUSY;
+	}
+
+	if (!ret) {
+		memcpy(task->affinity, affinity, sizeof(affinity));
+
+		// other tasks move, when they are woken up the next time
+		if ((task == per_core(current_task)) && !task_affinity_isset(task, CORE_ID))
+			core_id = get_next_core_id(task);
+	}
+
+	irq_nested_enable(flags);
+
+	if (core_id < MAX_CORES)
+		migrate_current_task(core_id);
+
+	return ret;
+}
+
+
+int get_task_affinity(tid_t id, void* mask, size_t size)
+{
+	uint64_t affinity[AFFINITY_WORDS];
+	task_t* task;
+	uint32_t i;
+
+	if (BUILTIN_EXPECT(!mask || (id >= max_tasks), 0))
+		return -EINVAL;
+
+	task = task_table + id;
+	if (BUILTIN_EXPECT(task->status == TASK_INVALID, 0))
+		return -EINVAL;
+
+	// report only cores, which are online
+	for(i=0; i<AFFINITY_WORDS; i++)
+		affinity[i] = 0;
+	for(i=0; i<MAX_CORES; i++) {
+		if (readyqueues[i].idle && task_affinity_isset(task, i))
+			affinity[i / 64] |= 1ULL << (i % 64);
+	}
+
+	memset(mask, 0x00, size);
+	memcpy(mask, affinity, size < sizeof(affinity) ? size : sizeof(affinity));
+
+	return 0;
+}
+
+
+int set_task_prio(tid_t id, uint8_t prio)
+{
+	task_t* task;
+	uint8_t flags;
+	int ret = 0;
+
+	if (BUILTIN_EXPECT((prio == IDLE_PRIO) || (prio > MAX_PRIO), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(id >= max_tasks, 0))
+		return -EINVAL;
+
+	flags = irq_nested_disable();
+
+	task = task_table + id;
+	if ((task->status == TASK_INVALID) || (task->status == TASK_IDLE)
+	    || (task->status == TASK_FINISHED) || (task->policy != SCHED_NORMAL)) {
+		ret = -EINVAL;
+	} else if (task == per_core(current_task)) {
+		// the running task isn't part of a ready queue
+		task->prio = prio;
+		task->new_prio = 0;
+	} else {
+		// the task may be queued on another core => change it with the next push
+		task->new_prio = prio;
+	}
+
+	irq_nested_enable(flags);
+
+	// a task with a higher priority may be ready now
+	if (!ret)
+		check_scheduling();
+
+	return ret;
+}
+
+
+int set_task_deadline(uint64_t runtime_ns, uint64_t period_ns)
+{
+	task_t* curr_task = per_core(current_task);
+	const uint32_t core_id = CORE_ID;
+	const uint64_t mhz = (uint64_t) get_cpu_frequency();
+	const uint64_t runtime = (runtime_ns * mhz) / 1000ULL;
+	const uint64_t period = (period_ns * mhz) / 1000ULL;
+	uint64_t bw = 0, old_bw = 0;
+	uint8_t flags;
+	int ret = 0;
+
+	if (runtime_ns) {
+		if (BUILTIN_EXPECT(!period || (runtime_ns > period_ns), 0))
+			return -EINVAL;
+		bw = (runtime << DL_BW_SHIFT) / period;
+	}
+
+	flags = irq_nested_disable();
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+	if (curr_task->policy == SCHED_DEADLINE)
+		old_bw = dl_bandwidth(curr_task);
+
+	if (readyqueues[core_id].dl_bandwidth - old_bw + bw > DL_BW_MAX) {
+		// admission control: the core is already reserved by other deadline tasks
+		ret = -EBUSY;
+	} else if (bw) {
+		readyqueues[core_id].dl_bandwidth += bw - old_bw;
+		curr_task->policy = SCHED_DEADLINE;
+		curr_task->prio = REALTIME_PRIO;
+		curr_task->new_prio = 0;
+		curr_task->dl_runtime = runtime;
+		curr_task->dl_period = period;
+		curr_task->dl_deadline = get_rdtsc() + period;
+		curr_task->dl_misses = 0;
+	} else if (old_bw) {
+		readyqueues[core_id].dl_bandwidth -= old_bw;
+		curr_task->policy = SCHED_NORMAL;
+		curr_task->prio = NORMAL_PRIO;
+	}
+
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+	irq_nested_enable(flags);
+
+	if (!ret)
+		check_scheduling();
+
+	return ret;
+}
+
+
+int wait_next_period(void)
+{
+	task_t* curr_task = per_core(current_task);
+	const uint64_t now = get_rdtsc();
+	uint64_t release = curr_task->dl_deadline;
+
+	if (BUILTIN_EXPECT(curr_task->policy != SCHED_DEADLINE, 0))
+		return -EINVAL;
+
+	if (now > release) {
+		curr_task->dl_misses++;
+		// skip the periods, which are already gone
+		release += ((now - release + curr_task->dl_period - 1) / curr_task->dl_period) * curr_task->dl_period;
+	}
+
+	// the new deadline orders the task in the ready queue after its release
+	curr_task->dl_deadline = release + curr_task->dl_period;
+	timer_nanosleep_until(release);
+
+	return (int) curr_task->dl_misses;
+}
+
+
+static int block_on_timer(uint64_t deadline, int hr)
 {
 	task_t* curr_task;
 	uint32_t core_id;
@@ -755,7 +1935,7 @@ int set_timer(uint64_t deadline)
 		curr_task->flags |= TASK_TIMER;
 		curr_task->timeout = deadline;
 
-		timer_queue_push(core_id, curr_task);
+		timer_queue_push(core_id, curr_task, hr);
 
 		ret = 0;
 	} else {
@@ -767,23 +1947,77 @@ int set_timer(uint64_t deadline)
 	return ret;
 }
 
+int set_timer(uint64_t deadline)
+{
+	return block_on_timer(deadline, 0);
+}
+
+int set_hrtimer(uint64_t tsc)
+{
+	const uint64_t cycles = cycles_per_tick();
+	const uint64_t now = get_rdtsc();
+
+	// long sleeps are handled by the wheel, only the remainder needs a precise timer
+	if ((tsc > now) && (tsc - now >= HRTIMER_MAX_TICKS * cycles))
+		return block_on_timer(get_clock_tick() + (tsc - now) / cycles, 0);
+
+	return block_on_timer(tsc, 1);
+}
+
 
 void check_timers(void)
 {
 	readyqueues_t* readyqueue = &readyqueues[CORE_ID];
+	timer_wheel_t* wheel = &readyqueue->timers;
+	uint64_t next;
+	uint32_t lvl;
+	task_t* task;
+
 	spinlock_irqsave_lock(&readyqueue->lock);
 
 	// since IRQs are disabled, get_clock_tick() won't increase here
 	const uint64_t current_tick = get_clock_tick();
 
-	// wakeup tasks whose deadline has expired
-	task_t* task;
-	while ((task = readyqueue->timers.first) && (task->timeout <= current_tick))
-	{
-		// pops task from timer queue, so next iteration has new first element
-		wakeup_task(task->id);
+	while (wheel->tick < current_tick) {
+		// skip the ticks without any work
+		next = timer_wheel_next(wheel);
+		if (!next || (next > current_tick)) {
+			wheel->tick = current_tick;
+			break;
+		}
+		wheel->tick = next;
+
+		// move timers from the higher levels down, starting at the top
+		if (!(next & ((1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1))) {
+			task_t* list = wheel->overflow;
+
+			// the overflow list isn't sorted => check all timers
+			wheel->overflow = NULL;
+			while ((task = list) != NULL) {
+				list = task->next;
+				timer_wheel_insert(wheel, task);
+			}
+		}
+		for(lvl=TIMER_WHEEL_LEVELS-1; lvl>0; lvl--) {
+			if (!(next & ((1ULL << (lvl * TIMER_WHEEL_BITS)) - 1)))
+				timer_wheel_cascade(wheel, &wheel->slots[lvl][(next >> (lvl * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK]);
+		}
+
+		// wakeup tasks whose deadline has expired
+		// => wakeup_task pops the task from its slot
+		while ((task = wheel->slots[0][next & TIMER_WHEEL_MASK]) != NULL)
+			wakeup_task(task->id);
+	}
+
+	if (wheel->hrtimers) {
+		const uint64_t now = get_rdtsc();
+
+		while ((task = wheel->hrtimers) && (task->timeout <= now))
+			wakeup_task(task->id);
 	}
 
+	update_timer(wheel);
+
 	spinlock_irqsave_unlock(&readyqueue->lock);
 }
 
@@ -793,15 +2027,18 @@ size_t** scheduler(void)
 	task_t* orig_task;
 	task_t* curr_task;
 	const uint32_t core_id = CORE_ID;
+	const uint64_t now = get_rdtsc();
 	uint64_t prio;
 
 	orig_task = curr_task = per_core(current_task);
-	curr_task->last_core = core_id;
+	// a migrating task already knows its new core
+	if (!(curr_task->flags & TASK_MIGRATE))
+		curr_task->last_core = core_id;
 
 	spinlock_irqsave_lock(&readyqueues[core_id].lock);
 
-	/* signalizes that this task could be realized */
-	if (curr_task->status == TASK_FINISHED)
+	/* signalizes that this task could be realized or handed over to another core */
+	if ((curr_task->status == TASK_FINISHED) || (curr_task->flags & TASK_MIGRATE))
 		readyqueues[core_id].old_task = curr_task;
 	else readyqueues[core_id].old_task = NULL; // reset old task
 
@@ -828,6 +2065,18 @@ size_t** scheduler(void)
 		if ((curr_task->prio > prio) && (curr_task->status == TASK_RUNNING))
 			goto get_task_out;
 
+		// a deadline task keeps the core until a task with an earlier deadline is ready
+		if ((curr_task->prio == prio) && (curr_task->status == TASK_RUNNING)
+		    && (curr_task->policy == SCHED_DEADLINE)
+		    && !dl_before(readyqueues[core_id].queue[prio-1].first, curr_task))
+			goto get_task_out;
+
+		// round robin: the current task keeps the core until its time slice expires
+		if ((curr_task->prio == prio) && (curr_task->status == TASK_RUNNING)
+		    && (curr_task->policy == SCHED_NORMAL)
+		    && (!readyqueues[core_id].timers.slice_end || (now < readyqueues[core_id].timers.slice_end)))
+			goto get_task_out;
+
 		// mark current task for later cleanup by finish_task_switch()
 		if (curr_task->status == TASK_RUNNING) {
 			curr_task->status = TASK_READY;
@@ -854,13 +2103,26 @@ size_t** scheduler(void)
 
 		// finally make it the new current task
 		curr_task->status = TASK_RUNNING;
-#ifdef DYNAMIC_TICKS
-		curr_task->last_tsc = get_rdtsc();
-#endif
 		set_per_core(current_task, curr_task);
 	}
 
 get_task_out:
+	if (curr_task != orig_task) {
+		// accounting of the previous task
+		if (orig_task->last_tsc)
+			orig_task->run_cycles += now - orig_task->last_tsc;
+		if (orig_task->status == TASK_READY)
+			orig_task->nivcsw++;
+		else if (orig_task->status == TASK_BLOCKED)
+			orig_task->nvcsw++;
+
+		if (curr_task->status == TASK_RUNNING)
+			curr_task->wait_cycles += now - curr_task->ready_tsc;
+		curr_task->last_tsc = now;
+	}
+
+	time_slice_update(core_id, curr_task, curr_task != orig_task, now);
+
 	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
 
 	if (curr_task != orig_task) {
@@ -879,7 +2141,7 @@ int get_task(tid_t id, task_t** task)
 		return -ENOMEM;
 	}
 
-	if (BUILTIN_EXPECT(id >= MAX_TASKS, 0)) {
+	if (BUILTIN_EXPECT(id >= max_tasks, 0)) {
 		return -ENOENT;
 	}
 
@@ -31,30 +31,117 @@
 
 #include <hermit/stdio.h>
 #include <hermit/malloc.h>
+#include <hermit/string.h>
 #include <hermit/spinlock.h>
 #include <hermit/memory.h>
 #include <hermit/logging.h>
 #include <asm/page.h>
 
-/// A linked list for each binary size exponent
-static buddy_t* buddy_lists[BUDDY_LISTS] = { [0 ... BUDDY_LISTS-1] = NULL };
+/// Size of an arena, which is split into buddies
+#define ARENA_SIZE		(1ULL << BUDDY_ALLOC)
+/// Number of bits to describe all potential buddies of an arena
+#define ARENA_BITS		(2 * (ARENA_SIZE >> BUDDY_MIN))
+/// Number of buckets to find an arena by its address
+#define ARENA_HASH_SIZE		256
+/// Number of completely free arenas, which are not returned to the system
+#define ARENA_RESERVE		2
 
-extern spinlock_irqsave_t hermit_mm_lock;
+/** @brief Free buddy
+ *
+ * A free buddy is at least 2^BUDDY_MIN bytes large. Beside the link to the
+ * next buddy (see buddy_t), we are able to store a backward link. This
+ * allows us to remove a buddy in O(1) from its list, when it is merged
+ * with its neighbour.
+ */
+typedef struct free_buddy {
+	/// Pointer to the next buddy in the linked list
+	struct free_buddy* next;
+	/// Pointer to the previous buddy in the linked list
+	struct free_buddy* prev;
+} free_buddy_t;
+
+/** @brief Arena
+ *
+ * The buddy system splits arenas of 2^BUDDY_ALLOC bytes, which are aligned
+ * to their size. Consequently, the neighbour of a buddy is found by flipping
+ * the bit of its address, which represents the buddy size. For each potential
+ * buddy of the arena, the bitmap signalizes if the buddy is currently free.
+ */
+typedef struct arena {
+	/// Start address of the arena
+	size_t start;
+	/// Start address of the reserved virtual address space
+	size_t vstart;
+	/// Number of free bytes in this arena
+	size_t free;
+	/// Next arena in the same hash bucket or in the list of unused descriptors
+	struct arena* next;
+	/// One bit for each potential buddy
+	uint64_t bitmap[ARENA_BITS / 64];
+} arena_t;
 
-/** @brief Check if larger free buddies are available */
-static inline int buddy_large_avail(uint8_t exp)
-{
-	while ((exp<BUDDY_MAX) && !buddy_lists[exp-BUDDY_MIN])
-		exp++;
+/// A linked list for each binary size exponent
+static free_buddy_t* buddy_lists[BUDDY_LISTS] = { [0 ... BUDDY_LISTS-1] = NULL };
+/// Number of free buddies for each binary size exponent
+static uint32_t buddy_count[BUDDY_LISTS] = { [0 ... BUDDY_LISTS-1] = 0 };
+
+/// All arenas, hashed by their start address
+static arena_t* arena_hash[ARENA_HASH_SIZE] = { [0 ... ARENA_HASH_SIZE-1] = NULL };
+/// Unused arena descriptors
+static arena_t* arena_unused = NULL;
+/// Number of arenas
+static uint32_t nr_arenas = 0;
+/// Number of blocks, which are larger than an arena
+static uint32_t nr_large = 0;
+/// Total size of all blocks, which are larger than an arena
+static size_t large_size = 0;
+
+/** @brief Per core cache of one size class */
+typedef struct {
+	/// magazine, which is currently used
+	magazine_t* loaded;
+	/// previously used magazine (either full or empty)
+	magazine_t* previous;
+	/// number of kmalloc() calls
+	uint64_t allocs;
+	/// number of kfree() calls
+	uint64_t frees;
+	/// number of magazine exchanges with the depot
+	uint64_t exchanges;
+	/// number of requests, which are forwarded to the buddy system
+	uint64_t misses;
+} magazine_cache_t;
+
+/** @brief Caches of all size classes, which belong to one core */
+typedef struct {
+	magazine_cache_t classes[BUDDY_CACHE_LISTS] __attribute__ ((aligned (CACHE_LINE)));
+} percore_cache_t;
+
+/** @brief Depot of full and empty magazines for one size class */
+typedef struct {
+	/// list of full magazines
+	magazine_t* full;
+	/// list of empty magazines
+	magazine_t* empty;
+	/// number of full magazines
+	uint32_t nr_full;
+	/// number of empty magazines
+	uint32_t nr_empty;
+	/// lock for this depot
+	spinlock_irqsave_t lock;
+} depot_t;
+
+static percore_cache_t caches[MAX_CORES];
+static depot_t depots[BUDDY_CACHE_LISTS] = { \
+		[0 ... BUDDY_CACHE_LISTS-1] = {NULL, NULL, 0, 0, SPINLOCK_IRQSAVE_INIT}};
 
-	return exp != BUDDY_MAX;
-}
+extern spinlock_irqsave_t hermit_mm_lock;
 
 /** @brief Calculate the required buddy size */
 static inline int buddy_exp(size_t sz)
 {
 	int exp;
-	for (exp=0; sz>(1<<exp); exp++);
+	for (exp=0; sz>(1ULL<<exp); exp++);
 
 	if (exp > BUDDY_MAX)
 		exp = 0;
@@ -64,71 +151,488 @@ static inline int buddy_exp(size_t sz)
 	return exp;
 }
 
-/** @brief Get a free buddy by potentially splitting a larger one */
+/** @brief Find the arena, which contains the address */
+static inline arena_t* arena_lookup(size_t addr)
+{
+	arena_t* arena = arena_hash[(addr >> BUDDY_ALLOC) % ARENA_HASH_SIZE];
+
+	addr &= ~(ARENA_SIZE-1);
+	while (arena && (arena->start != addr))
+		arena = arena->next;
+
+	return arena;
+}
+
+/** @brief Position of a buddy in the bitmap of its arena */
+static inline size_t arena_bit(arena_t* arena, size_t addr, int exp)
+{
+	return (ARENA_SIZE >> exp) - 1 + ((addr - arena->start) >> exp);
+}
+
+/** @brief Check if the buddy at this address is free */
+static inline int arena_test(arena_t* arena, size_t addr, int exp)
+{
+	size_t bit = arena_bit(arena, addr, exp);
+
+	return (arena->bitmap[bit / 64] >> (bit % 64)) & 1;
+}
+
+/** @brief Add a buddy to its free list */
+static void buddy_list_push(arena_t* arena, free_buddy_t* buddy, int exp)
+{
+	free_buddy_t** list = &buddy_lists[exp-BUDDY_MIN];
+	size_t bit = arena_bit(arena, (size_t) buddy, exp);
+
+	buddy->prev = NULL;
+	buddy->next = *list;
+	if (*list)
+		(*list)->prev = buddy;
+	*list = buddy;
+
+	buddy_count[exp-BUDDY_MIN]++;
+	arena->bitmap[bit / 64] |= (1ULL << (bit % 64));
+	arena->free += 1ULL << exp;
+}
+
+/** @brief Remove a buddy from its free list */
+static void buddy_list_remove(arena_t* arena, free_buddy_t* buddy, int exp)
+{
+	free_buddy_t** list = &buddy_lists[exp-BUDDY_MIN];
+	size_t bit = arena_bit(arena, (size_t) buddy, exp);
+
+	if (buddy->prev)
+		buddy->prev->next = buddy->next;
+	else
+		*list = buddy->next;
+	if (buddy->next)
+		buddy->next->prev = buddy->prev;
+
+	buddy_count[exp-BUDDY_MIN]--;
+	arena->bitmap[bit / 64] &= ~(1ULL << (bit % 64));
+	arena->free -= 1ULL << exp;
+}
+
+/** @brief Get an unused arena descriptor
+ *
+ * The descriptors are carved out of whole pages, which are never released.
+ */
+static arena_t* arena_desc_alloc(void)
+{
+	arena_t* arena;
+	size_t i;
+
+	if (!arena_unused) {
+		arena = (arena_t*) palloc(PAGE_SIZE, VMA_HEAP);
+		if (BUILTIN_EXPECT(!arena, 0))
+			return NULL;
+
+		for(i=1; i<PAGE_SIZE/sizeof(arena_t); i++) {
+			arena[i].next = arena_unused;
+			arena_unused = arena+i;
+		}
+	} else {
+		arena = arena_unused;
+		arena_unused = arena->next;
+	}
+
+	memset(arena, 0x00, sizeof(arena_t));
+
+	return arena;
+}
+
+/** @brief Allocate a new arena and add it as one free buddy */
+static int arena_create(void)
+{
+	size_t phyaddr, viraddr;
+	arena_t* arena;
+	uint32_t h;
+
+	arena = arena_desc_alloc();
+	if (BUILTIN_EXPECT(!arena, 0))
+		return -ENOMEM;
+
+	// reserve twice the size => we are able to align the arena
+	viraddr = vma_alloc(2*ARENA_SIZE, VMA_HEAP);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		goto out_desc;
+
+	phyaddr = get_pages(ARENA_SIZE >> PAGE_BITS);
+	if (BUILTIN_EXPECT(!phyaddr, 0))
+		goto out_vma;
+
+	arena->vstart = viraddr;
+	arena->start = (viraddr + ARENA_SIZE - 1) & ~(ARENA_SIZE - 1);
+
+	if (BUILTIN_EXPECT(page_map(arena->start, phyaddr, ARENA_SIZE >> PAGE_BITS, PG_RW|PG_GLOBAL|PG_NX), 0))
+		goto out_pages;
+
+	h = (arena->start >> BUDDY_ALLOC) % ARENA_HASH_SIZE;
+	arena->next = arena_hash[h];
+	arena_hash[h] = arena;
+	nr_arenas++;
+
+	buddy_list_push(arena, (free_buddy_t*) arena->start, BUDDY_ALLOC);
+
+	return 0;
+
+out_pages:
+	put_pages(phyaddr, ARENA_SIZE >> PAGE_BITS);
+out_vma:
+	vma_free(viraddr, viraddr+2*ARENA_SIZE);
+out_desc:
+	arena->next = arena_unused;
+	arena_unused = arena;
+
+	return -ENOMEM;
+}
+
+/** @brief Return a completely free arena to the system */
+static void arena_destroy(arena_t* arena)
+{
+	arena_t** prev = &arena_hash[(arena->start >> BUDDY_ALLOC) % ARENA_HASH_SIZE];
+	size_t phyaddr = virt_to_phys(arena->start);
+
+	while (*prev != arena)
+		prev = &(*prev)->next;
+	*prev = arena->next;
+	nr_arenas--;
+
+	page_unmap(arena->start, ARENA_SIZE >> PAGE_BITS);
+	put_pages(phyaddr, ARENA_SIZE >> PAGE_BITS);
+	vma_free(arena->vstart, arena->vstart+2*ARENA_SIZE);
+
+	arena->next = arena_unused;
+	arena_unused = arena;
+}
+
+/** @brief Get a free buddy by potentially splitting a larger one
+ *
+ * Buddies, which are larger than an arena, are directly allocated
+ * by palloc().
+ */
 static buddy_t* buddy_get(int exp)
 {
 	spinlock_irqsave_lock(&hermit_mm_lock);
-	buddy_t** list = &buddy_lists[exp-BUDDY_MIN];
-	buddy_t* buddy = *list;
-	buddy_t* split;
-
-	if (buddy)
+	free_buddy_t** list = &buddy_lists[exp-BUDDY_MIN];
+	free_buddy_t* buddy = NULL;
+	free_buddy_t* split;
+
+	if (exp > BUDDY_ALLOC) {
+		buddy = (free_buddy_t*) palloc(1ULL << exp, VMA_HEAP|VMA_CACHEABLE);
+		if (buddy) {
+			nr_large++;
+			large_size += 1ULL << exp;
+		}
+	} else if (*list || ((exp == BUDDY_ALLOC) && !arena_create())) {
 		// there is already a free buddy =>
 		// we remove it from the list
-		*list = buddy->next;
-	else if ((exp >= BUDDY_ALLOC) && !buddy_large_avail(exp))
-		// theres no free buddy larger than exp =>
-		// we can allocate new memory
-		buddy = (buddy_t*) palloc(1<<exp, VMA_HEAP|VMA_CACHEABLE);
-	else {
+		buddy = *list;
+		buddy_list_remove(arena_lookup((size_t) buddy), buddy, exp);
+	} else if (exp < BUDDY_ALLOC) {
 		// we recursivly request a larger buddy...
-		buddy = buddy_get(exp+1);
+		buddy = (free_buddy_t*) buddy_get(exp+1);
 		if (BUILTIN_EXPECT(!buddy, 0))
 			goto out;
 
 		// ... and split it, by putting the second half back to the list
-		split = (buddy_t*) ((size_t) buddy + (1<<exp));
-		split->next = *list;
-		*list = split;
+		split = (free_buddy_t*) ((size_t) buddy + (1ULL<<exp));
+		buddy_list_push(arena_lookup((size_t) split), split, exp);
 	}
 
 out:
 	spinlock_irqsave_unlock(&hermit_mm_lock);
 
-	return buddy;
+	return (buddy_t*) buddy;
 }
 
 /** @brief Put a buddy back to its free list
  *
- * TODO: merge adjacent buddies (memory compaction)
+ * The buddy is merged with its neighbours as long as they are free.
+ * If the whole arena is free and enough arenas are in reserve, the
+ * arena is returned to the system.
  */
 static void buddy_put(buddy_t* buddy)
 {
+	int exp = buddy->prefix.exponent;
+	size_t addr = (size_t) buddy;
+	size_t neighbour;
+	arena_t* arena;
+
 	spinlock_irqsave_lock(&hermit_mm_lock);
-	buddy_t** list = &buddy_lists[buddy->prefix.exponent-BUDDY_MIN];
-	buddy->next = *list;
-	*list = buddy;
+
+	if (exp > BUDDY_ALLOC) {
+		nr_large--;
+		large_size -= 1ULL << exp;
+		pfree(buddy, 1ULL << exp);
+		goto out;
+	}
+
+	arena = arena_lookup(addr);
+	if (BUILTIN_EXPECT(!arena, 0)) {
+		LOG_ERROR("buddy_put: buddy %p isn't part of an arena\n", buddy);
+		goto out;
+	}
+
+	while (exp < BUDDY_ALLOC) {
+		neighbour = arena->start + ((addr - arena->start) ^ (1ULL << exp));
+		if (!arena_test(arena, neighbour, exp))
+			break;
+
+		buddy_list_remove(arena, (free_buddy_t*) neighbour, exp);
+		if (neighbour < addr)
+			addr = neighbour;
+		exp++;
+	}
+
+	if ((exp == BUDDY_ALLOC) && (buddy_count[BUDDY_ALLOC-BUDDY_MIN] >= ARENA_RESERVE))
+		arena_destroy(arena);
+	else
+		buddy_list_push(arena, (free_buddy_t*) addr, exp);
+
+out:
 	spinlock_irqsave_unlock(&hermit_mm_lock);
 }
 
+/** @brief Number of buddies, which a magazine of this size class holds
+ *
+ * Every cached buddy prevents that its arena is returned to the system.
+ * Therefore, we limit the number of cached bytes per magazine.
+ */
+static inline size_t magazine_capacity(int exp)
+{
+	size_t rounds = MAGAZINE_BYTES >> exp;
+
+	return (rounds < MAGAZINE_SIZE) ? rounds : MAGAZINE_SIZE;
+}
+
+/** @brief Allocate an empty magazine from the buddy system */
+static magazine_t* magazine_alloc(void)
+{
+	magazine_t* mag = (magazine_t*) buddy_get(MAGAZINE_EXP);
+
+	if (BUILTIN_EXPECT(!mag, 0))
+		return NULL;
+
+	mag->next = NULL;
+	mag->rounds = 0;
+
+	return mag;
+}
+
+/** @brief Return all buddies of a magazine and the magazine itself
+ * to the buddy system */
+static void magazine_destroy(magazine_t* mag)
+{
+	buddy_t* buddy = (buddy_t*) mag;
+
+	while (mag->rounds)
+		buddy_put(mag->buddies[--mag->rounds]);
+
+	buddy->prefix.exponent = MAGAZINE_EXP;
+	buddy_put(buddy);
+}
+
+/** @brief Get a free buddy from the cache of the current core
+ *
+ * Only if both magazines of the current core are empty, the depot has to
+ * be locked. If the depot has no full magazine, the buddy system is used.
+ */
+static buddy_t* cache_get(int exp)
+{
+	magazine_cache_t* cache;
+	depot_t* depot = &depots[exp-BUDDY_MIN];
+	magazine_t* mag, *spare = NULL;
+	buddy_t* buddy;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+	cache = &caches[CORE_ID].classes[exp-BUDDY_MIN];
+	cache->allocs++;
+
+	if (cache->loaded && cache->loaded->rounds)
+		goto hit;
+
+	if (cache->previous && cache->previous->rounds) {
+		mag = cache->loaded;
+		cache->loaded = cache->previous;
+		cache->previous = mag;
+		goto hit;
+	}
+
+	// both magazines are empty => exchange an empty one with a full one
+	spinlock_irqsave_lock(&depot->lock);
+	mag = depot->full;
+	if (mag) {
+		depot->full = mag->next;
+		depot->nr_full--;
+
+		if (cache->previous) {
+			if (depot->nr_empty < DEPOT_MAX) {
+				cache->previous->next = depot->empty;
+				depot->empty = cache->previous;
+				depot->nr_empty++;
+			} else spare = cache->previous;
+		}
+
+		cache->previous = cache->loaded;
+		cache->loaded = mag;
+	}
+	spinlock_irqsave_unlock(&depot->lock);
+
+	if (mag) {
+		cache->exchanges++;
+		goto hit;
+	}
+
+	// depot is also empty => use the buddy system
+	cache->misses++;
+	irq_nested_enable(flags);
+
+	return buddy_get(exp);
+
+hit:
+	buddy = cache->loaded->buddies[--cache->loaded->rounds];
+	irq_nested_enable(flags);
+
+	if (spare)
+		magazine_destroy(spare);
+
+	return buddy;
+}
+
+/** @brief Put a buddy into the cache of the current core
+ *
+ * Only if both magazines of the current core are full, the depot has to
+ * be locked. If no empty magazine is available, the buddy is returned
+ * to the buddy system.
+ */
+static void cache_put(buddy_t* buddy)
+{
+	int exp = buddy->prefix.exponent;
+	magazine_cache_t* cache;
+	depot_t* depot = &depots[exp-BUDDY_MIN];
+	magazine_t* mag, *spare = NULL;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+	cache = &caches[CORE_ID].classes[exp-BUDDY_MIN];
+	cache->frees++;
+
+	if (cache->loaded && (cache->loaded->rounds < magazine_capacity(exp)))
+		goto hit;
+
+	if (cache->previous && !cache->previous->rounds) {
+		mag = cache->loaded;
+		cache->loaded = cache->previous;
+		cache->previous = mag;
+		goto hit;
+	}
+
+	// both magazines are full => exchange a full one with an empty one
+	spinlock_irqsave_lock(&depot->lock);
+	mag = depot->empty;
+	if (mag) {
+		depot->empty = mag->next;
+		depot->nr_empty--;
+	}
+	spinlock_irqsave_unlock(&depot->lock);
+
+	if (!mag)
+		mag = magazine_alloc();
+	if (BUILTIN_EXPECT(!mag, 0)) {
+		cache->misses++;
+		irq_nested_enable(flags);
+		buddy_put(buddy);
+		return;
+	}
+
+	if (cache->previous) {
+		spinlock_irqsave_lock(&depot->lock);
+		if (depot->nr_full < DEPOT_MAX) {
+			cache->previous->next = depot->full;
+			depot->full = cache->previous;
+			depot->nr_full++;
+		} else spare = cache->previous;
+		spinlock_irqsave_unlock(&depot->lock);
+	}
+
+	cache->previous = cache->loaded;
+	cache->loaded = mag;
+	cache->exchanges++;
+
+hit:
+	cache->loaded->buddies[cache->loaded->rounds++] = buddy;
+	irq_nested_enable(flags);
+
+	// the depot is already filled => release surplus buddies
+	if (spare)
+		magazine_destroy(spare);
+}
+
+void print_kmalloc_stats(void)
+{
+	uint64_t allocs, frees, exchanges, misses;
+	uint32_t i, j;
+
+	for(j=0; j<BUDDY_CACHE_LISTS; j++)
+	{
+		allocs = frees = exchanges = misses = 0;
+
+		for(i=0; i<MAX_CORES; i++)
+		{
+			allocs += caches[i].classes[j].allocs;
+			frees += caches[i].classes[j].frees;
+			exchanges += caches[i].classes[j].exchanges;
+			misses += caches[i].classes[j].misses;
+		}
+
+		if (allocs || frees)
+			LOG_INFO("kmalloc cache (size %lu bytes): %llu allocs, %llu frees, %llu exchanges, %llu misses, %u full / %u empty magazines in depot\n",
+				1UL << (j+BUDDY_MIN), allocs, frees, exchanges, misses, depots[j].nr_full, depots[j].nr_empty);
+	}
+}
+
 void buddy_dump(void)
 {
-	size_t free = 0;
-	int i;
+	size_t free = 0, largest = 0;
+	uint32_t i, empty = 0, full = 0;
+	arena_t* arena;
+
+	spinlock_irqsave_lock(&hermit_mm_lock);
 
 	for (i=0; i<BUDDY_LISTS; i++) {
-		buddy_t* buddy;
+		free_buddy_t* buddy;
 		int exp = i+BUDDY_MIN;
 
-		if (buddy_lists[i])
-			LOG_INFO("buddy_list[%u] (exp=%u, size=%lu bytes):\n", i, exp, 1<<exp);
+		if (buddy_lists[i]) {
+			LOG_INFO("buddy_list[%u] (exp=%u, size=%lu bytes): %u buddies\n", i, exp, 1UL<<exp, buddy_count[i]);
+			largest = 1UL << exp;
+		}
 
 		for (buddy=buddy_lists[i]; buddy; buddy=buddy->next) {
-			LOG_INFO("  %p -> %p \n", buddy, buddy->next);
-			free += 1<<exp;
+			LOG_DEBUG("  %p -> %p \n", buddy, buddy->next);
+			free += 1UL<<exp;
 		}
 	}
+
+	for (i=0; i<ARENA_HASH_SIZE; i++) {
+		for (arena=arena_hash[i]; arena; arena=arena->next) {
+			if (arena->free == ARENA_SIZE)
+				empty++;
+			else if (!arena->free)
+				full++;
+		}
+	}
+
 	LOG_INFO("free buddies: %lu bytes\n", free);
+	LOG_INFO("arenas: %u (%lu KiB), %u completely free, %u completely used\n",
+		nr_arenas, (nr_arenas * ARENA_SIZE) >> 10, empty, full);
+	LOG_INFO("large blocks: %u (%lu KiB)\n", nr_large, large_size >> 10);
+	if (nr_arenas)
+		LOG_INFO("fragmentation: %lu%% of the arenas are free, largest free buddy is %lu bytes (%lu%% of free memory)\n",
+			(free * 100) / (nr_arenas * ARENA_SIZE), largest, free ? (largest * 100) / free : 0);
+
+	spinlock_irqsave_unlock(&hermit_mm_lock);
 }
 
 void* palloc(size_t sz, uint32_t flags)
@@ -165,6 +669,24 @@ void* palloc(size_t sz, uint32_t flags)
 	return (void*) viraddr;
 }
 
+void pfree(void* addr, size_t sz)
+{
+	size_t viraddr = (size_t) addr;
+	size_t phyaddr;
+	uint32_t npages = PAGE_CEIL(sz) >> PAGE_BITS;
+
+	LOG_DEBUG("pfree(%p, %zd) (%u pages)\n", addr, sz, npages);
+
+	if (BUILTIN_EXPECT(!addr || !sz, 0))
+		return;
+
+	phyaddr = virt_to_phys(viraddr);
+
+	page_unmap(viraddr, npages);
+	put_pages(phyaddr, npages);
+	vma_free(viraddr, viraddr+npages*PAGE_SIZE);
+}
+
 void* create_stack(size_t sz)
 {
 	size_t phyaddr, viraddr, bits;
@@ -225,6 +747,63 @@ int destroy_stack(void* viraddr, size_t sz)
 	return 0;
 }
 
+void* create_lazy_stack(size_t sz, size_t mapped)
+{
+	size_t phyaddr, viraddr;
+	uint32_t npages = PAGE_CEIL(sz) >> PAGE_BITS;
+	uint32_t nmapped = PAGE_CEIL(mapped) >> PAGE_BITS;
+	int err;
+
+	LOG_DEBUG("create_lazy_stack(0x%zx) (%u of %u pages)\n", sz, nmapped, npages);
+
+	if (BUILTIN_EXPECT(!sz, 0))
+		return NULL;
+	if (nmapped > npages)
+		nmapped = npages;
+
+	// get free virtual address space
+	viraddr = vma_alloc((npages+2)*PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return NULL;
+
+	if (!nmapped)
+		return (void*) (viraddr+PAGE_SIZE);
+
+	// back the top of the stack, the stack grows downwards
+	phyaddr = get_pages(nmapped);
+	if (BUILTIN_EXPECT(!phyaddr, 0)) {
+		vma_free(viraddr, viraddr+(npages+2)*PAGE_SIZE);
+		return NULL;
+	}
+
+	err = page_map(viraddr+(npages-nmapped+1)*PAGE_SIZE, phyaddr, nmapped, PG_RW|PG_GLOBAL|PG_NX);
+	if (BUILTIN_EXPECT(err, 0)) {
+		vma_free(viraddr, viraddr+(npages+2)*PAGE_SIZE);
+		put_pages(phyaddr, nmapped);
+		return NULL;
+	}
+
+	return (void*) (viraddr+PAGE_SIZE);
+}
+
+int destroy_lazy_stack(void* viraddr, size_t sz)
+{
+	uint32_t npages = PAGE_CEIL(sz) >> PAGE_BITS;
+
+	LOG_DEBUG("destroy_lazy_stack(0x%zx) (size 0x%zx)\n", viraddr, sz);
+
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!sz, 0))
+		return -EINVAL;
+
+	// the frames aren't contiguous => release them page by page
+	page_unmap_free((size_t)viraddr, npages);
+	vma_free((size_t)viraddr-PAGE_SIZE, (size_t)viraddr+(npages+1)*PAGE_SIZE);
+
+	return 0;
+}
+
 void* kmalloc(size_t sz)
 {
 	if (BUILTIN_EXPECT(!sz, 0))
@@ -237,7 +816,7 @@ void* kmalloc(size_t sz)
 	if (BUILTIN_EXPECT(!exp, 0))
 		return NULL;
 
-	buddy_t* buddy = buddy_get(exp);
+	buddy_t* buddy = (exp <= BUDDY_CACHE_MAX) ? cache_get(exp) : buddy_get(exp);
 	if (BUILTIN_EXPECT(!buddy, 0))
 		return NULL;
 
@@ -264,5 +843,8 @@ void kfree(void *addr)
 	if (BUILTIN_EXPECT(buddy->prefix.magic != BUDDY_MAGIC, 0))
 		return;
 
-	buddy_put(buddy);
+	if (buddy->prefix.exponent <= BUDDY_CACHE_MAX)
+		cache_put(buddy);
+	else
+		buddy_put(buddy);
 }
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/spinlock.h>
+#include <hermit/page_zone.h>
+#include <hermit/logging.h>
+#include <asm/processor.h>
+
+/// Marks the end of a free list
+#define ZONE_NIL	((uint32_t) -1)
+/// Alignment of the first frame of a zone
+#define ZONE_ALIGN	(1ULL << (ZONE_MAX_ORDER + PAGE_BITS))
+
+static inline void zone_push(page_zone_t* zone, size_t idx, uint32_t order)
+{
+	uint32_t head = zone->free_lists[order];
+
+	zone->frames[idx].prev = ZONE_NIL;
+	zone->frames[idx].next = head;
+	if (head != ZONE_NIL)
+		zone->frames[head].prev = idx;
+	zone->free_lists[order] = idx;
+	zone->orders[idx] = order + 1;
+	zone->nr_free += 1ULL << order;
+}
+
+static inline void zone_remove(page_zone_t* zone, size_t idx, uint32_t order)
+{
+	uint32_t next = zone->frames[idx].next;
+	uint32_t prev = zone->frames[idx].prev;
+
+	if (prev != ZONE_NIL)
+		zone->frames[prev].next = next;
+	else
+		zone->free_lists[order] = next;
+	if (next != ZONE_NIL)
+		zone->frames[next].prev = prev;
+	zone->orders[idx] = 0;
+	zone->nr_free -= 1ULL << order;
+}
+
+/** @brief Release a naturally aligned block and merge it with its buddies */
+static void zone_free_block(page_zone_t* zone, size_t idx, uint32_t order)
+{
+	while (order < ZONE_MAX_ORDER) {
+		size_t buddy = idx ^ (1ULL << order);
+
+		if ((buddy >= zone->nframes) || (zone->orders[buddy] != order + 1))
+			break;
+
+		zone_remove(zone, buddy, order);
+		idx &= ~(1ULL << order);
+		order++;
+	}
+
+	zone_push(zone, idx, order);
+}
+
+/** @brief Release a range of frames, which isn't necessarily aligned */
+static void zone_free_range(page_zone_t* zone, size_t idx, size_t npages)
+{
+	while (npages) {
+		uint32_t order = lsb(idx);
+
+		if (order > ZONE_MAX_ORDER)
+			order = ZONE_MAX_ORDER;
+		if (order > msb(npages))
+			order = msb(npages);
+
+		zone_free_block(zone, idx, order);
+		idx += 1ULL << order;
+		npages -= 1ULL << order;
+	}
+}
+
+/** @brief Take a block of 2^order frames from the free lists
+ *
+ * Larger blocks are split and their upper halves are kept in the lists.
+ */
+static size_t zone_alloc_block(page_zone_t* zone, uint32_t order)
+{
+	uint32_t i, idx;
+
+	for(i=order; (i <= ZONE_MAX_ORDER) && (zone->free_lists[i] == ZONE_NIL); i++)
+		;
+	if (BUILTIN_EXPECT(i > ZONE_MAX_ORDER, 0))
+		return ZONE_NIL;
+
+	idx = zone->free_lists[i];
+	zone_remove(zone, idx, i);
+
+	while (i > order) {
+		i--;
+		zone_push(zone, idx + (1ULL << i), i);
+	}
+
+	return idx;
+}
+
+size_t page_zone_meta_size(size_t start, size_t end)
+{
+	size_t nframes = (end - (start & ~(ZONE_ALIGN-1))) >> PAGE_BITS;
+
+	return nframes * (sizeof(page_frame_t) + sizeof(uint8_t));
+}
+
+void page_zone_init(page_zone_t* zone, size_t start, size_t end, void* meta)
+{
+	uint32_t i;
+
+	zone->base = start & ~(ZONE_ALIGN-1);
+	zone->nframes = (end - zone->base) >> PAGE_BITS;
+	zone->nr_free = 0;
+	zone->frames = (page_frame_t*) meta;
+	zone->orders = (uint8_t*) (zone->frames + zone->nframes);
+	for(i=0; i<ZONE_ORDERS; i++)
+		zone->free_lists[i] = ZONE_NIL;
+	spinlock_irqsave_init(&zone->lock);
+
+	// all frames are in use
+	memset(zone->orders, 0x00, zone->nframes);
+}
+
+size_t page_zone_alloc(page_zone_t* zone, size_t npages)
+{
+	uint32_t order;
+	size_t idx;
+
+	if (BUILTIN_EXPECT(!npages || !zone->nframes, 0))
+		return 0;
+
+	order = msb(npages);
+	if (npages & ((1ULL << order) - 1))
+		order++;
+	if (BUILTIN_EXPECT(order > ZONE_MAX_ORDER, 0))
+		return 0;
+
+	spinlock_irqsave_lock(&zone->lock);
+
+	idx = zone_alloc_block(zone, order);
+	// return the unused tail of the block
+	if ((idx != ZONE_NIL) && ((1ULL << order) > npages))
+		zone_free_range(zone, idx + npages, (1ULL << order) - npages);
+
+	spinlock_irqsave_unlock(&zone->lock);
+
+	if (BUILTIN_EXPECT(idx == ZONE_NIL, 0))
+		return 0;
+
+	return zone->base + (idx << PAGE_BITS);
+}
+
+int page_zone_free(page_zone_t* zone, size_t phyaddr, size_t npages)
+{
+	if (BUILTIN_EXPECT(!npages || (phyaddr & (PAGE_SIZE-1)), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!page_zone_contains(zone, phyaddr), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(((phyaddr - zone->base) >> PAGE_BITS) + npages > zone->nframes, 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&zone->lock);
+	zone_free_range(zone, (phyaddr - zone->base) >> PAGE_BITS, npages);
+	spinlock_irqsave_unlock(&zone->lock);
+
+	return 0;
+}
+
+size_t page_zone_alloc_frames(page_zone_t* zone, size_t* frames, size_t n)
+{
+	size_t i, idx;
+
+	if (BUILTIN_EXPECT(!zone->nframes, 0))
+		return 0;
+
+	spinlock_irqsave_lock(&zone->lock);
+
+	for(i=0; i<n; i++) {
+		idx = zone_alloc_block(zone, 0);
+		if (BUILTIN_EXPECT(idx == ZONE_NIL, 0))
+			break;
+		frames[i] = zone->base + (idx << PAGE_BITS);
+	}
+
+	spinlock_irqsave_unlock(&zone->lock);
+
+	return i;
+}
+
+void page_zone_free_frames(page_zone_t* zone, size_t* frames, size_t n)
+{
+	size_t i;
+
+	spinlock_irqsave_lock(&zone->lock);
+
+	for(i=0; i<n; i++)
+		zone_free_block(zone, (frames[i] - zone->base) >> PAGE_BITS, 0);
+
+	spinlock_irqsave_unlock(&zone->lock);
+}
@@ -45,9 +45,242 @@ extern const void kernel_start;
  * For bootstrapping we initialize the VMA list with one empty VMA
  * (start == end) and expand this VMA by calls to vma_alloc()
  */
-static vma_t vma_boot = { VMA_MIN, VMA_MIN, VMA_HEAP };
+static vma_t vma_boot = { VMA_MIN, VMA_MIN, VMA_HEAP, NULL, NULL, NULL, NULL, NULL, 0, 1 };
 static vma_t* vma_list = &vma_boot;
-spinlock_irqsave_t hermit_mm_lock = SPINLOCK_IRQSAVE_INIT;
+static vma_t* vma_root = &vma_boot;
+static lock_stats_t hermit_mm_stats = LOCK_STATS_INIT("hermit_mm_lock");
+spinlock_irqsave_t hermit_mm_lock = SPINLOCK_IRQSAVE_QUEUED_INIT(&hermit_mm_stats);
+
+/** @brief Size of the hole between a VMA and its predecessor
+ *
+ * Only the part between VMA_MIN and VMA_MAX is taken into account.
+ */
+static inline size_t vma_gap(vma_t* vma)
+{
+	size_t lo = (vma->prev && (vma->prev->end > VMA_MIN)) ? vma->prev->end : VMA_MIN;
+	size_t hi = (vma->start < VMA_MAX) ? vma->start : VMA_MAX;
+
+	return (hi > lo) ? hi - lo : 0;
+}
+
+static inline int vma_height(vma_t* vma)
+{
+	return vma ? vma->height : 0;
+}
+
+/** @brief Recalculate height and largest hole of a node */
+static void vma_fix(vma_t* vma)
+{
+	int hl = vma_height(vma->left);
+	int hr = vma_height(vma->right);
+
+	vma->height = 1 + ((hl > hr) ? hl : hr);
+	vma->max_gap = vma_gap(vma);
+	if (vma->left && (vma->left->max_gap > vma->max_gap))
+		vma->max_gap = vma->left->max_gap;
+	if (vma->right && (vma->right->max_gap > vma->max_gap))
+		vma->max_gap = vma->right->max_gap;
+}
+
+/** @brief Replace the child old of parent by new */
+static inline void vma_replace_child(vma_t* parent, vma_t* old, vma_t* new)
+{
+	if (!parent)
+		vma_root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+
+	if (new)
+		new->parent = parent;
+}
+
+static vma_t* vma_rotate_left(vma_t* vma)
+{
+	vma_t* r = vma->right;
+
+	vma_replace_child(vma->parent, vma, r);
+	vma->right = r->left;
+	if (r->left)
+		r->left->parent = vma;
+	r->left = vma;
+	vma->parent = r;
+
+	vma_fix(vma);
+	vma_fix(r);
+
+	return r;
+}
+
+static vma_t* vma_rotate_right(vma_t* vma)
+{
+	vma_t* l = vma->left;
+
+	vma_replace_child(vma->parent, vma, l);
+	vma->left = l->right;
+	if (l->right)
+		l->right->parent = vma;
+	l->right = vma;
+	vma->parent = l;
+
+	vma_fix(vma);
+	vma_fix(l);
+
+	return l;
+}
+
+/** @brief Restore the AVL property and the holes on the path to the root */
+static void vma_rebalance(vma_t* vma)
+{
+	while (vma) {
+		int balance;
+
+		vma_fix(vma);
+		balance = vma_height(vma->left) - vma_height(vma->right);
+
+		if (balance > 1) {
+			if (vma_height(vma->left->left) < vma_height(vma->left->right))
+				vma_rotate_left(vma->left);
+			vma = vma_rotate_right(vma);
+		} else if (balance < -1) {
+			if (vma_height(vma->right->right) < vma_height(vma->right->left))
+				vma_rotate_right(vma->right);
+			vma = vma_rotate_left(vma);
+		}
+
+		vma = vma->parent;
+	}
+}
+
+/** @brief Insert a new VMA behind pred (or as first VMA, if pred is NULL) */
+static void vma_insert(vma_t* new, vma_t* pred)
+{
+	vma_t* succ = pred ? pred->next : vma_list;
+
+	new->left = new->right = NULL;
+	new->height = 1;
+
+	// the new node is the rightmost node of pred's right subtree or
+	// the leftmost node of succ's left subtree
+	if (pred && !pred->right) {
+		pred->right = new;
+		new->parent = pred;
+	} else if (succ) {
+		succ->left = new;
+		new->parent = succ;
+	} else {
+		new->parent = NULL;
+		vma_root = new;
+	}
+
+	new->prev = pred;
+	new->next = succ;
+	if (succ)
+		succ->prev = new;
+	if (pred)
+		pred->next = new;
+	else
+		vma_list = new;
+
+	vma_rebalance(new);
+	// the hole in front of the successor is shrunk
+	if (succ)
+		vma_rebalance(succ);
+}
+
+/** @brief Remove a VMA from the tree and the list */
+static void vma_remove(vma_t* vma)
+{
+	vma_t* succ = vma->next;
+	vma_t* start;
+
+	if (vma->prev)
+		vma->prev->next = vma->next;
+	else
+		vma_list = vma->next;
+	if (vma->next)
+		vma->next->prev = vma->prev;
+
+	if (vma->left && vma->right) {
+		// the successor is the leftmost node of the right subtree
+		// and takes over the position of the removed node
+		if (succ->parent != vma) {
+			start = succ->parent;
+			start->left = succ->right;
+			if (succ->right)
+				succ->right->parent = start;
+			succ->right = vma->right;
+			vma->right->parent = succ;
+		} else start = succ;
+
+		succ->left = vma->left;
+		vma->left->parent = succ;
+		vma_replace_child(vma->parent, vma, succ);
+	} else {
+		start = vma->parent;
+		vma_replace_child(start, vma, vma->left ? vma->left : vma->right);
+	}
+
+	vma_rebalance(start);
+	// the hole in front of the successor is grown
+	if (succ)
+		vma_rebalance(succ);
+}
+
+/** @brief Update the holes after a VMA is resized */
+static inline void vma_resized(vma_t* vma)
+{
+	vma_rebalance(vma);
+	if (vma->next)
+		vma_rebalance(vma->next);
+}
+
+/** @brief Find the VMA with the largest start address, which is <= addr */
+static vma_t* vma_lookup(size_t addr)
+{
+	vma_t* vma = vma_root;
+	vma_t* ret = NULL;
+
+	while (vma) {
+		if (vma->start <= addr) {
+			ret = vma;
+			vma = vma->right;
+		} else vma = vma->left;
+	}
+
+	return ret;
+}
+
+/** @brief Find the first VMA, which has a hole larger than size in front of it */
+static vma_t* vma_first_fit(size_t size)
+{
+	vma_t* vma = vma_root;
+
+	while (vma) {
+		if (vma->left && (vma->left->max_gap > size))
+			vma = vma->left;
+		else if (vma_gap(vma) > size)
+			return vma;
+		else if (vma->right && (vma->right->max_gap > size))
+			vma = vma->right;
+		else
+			return NULL;
+	}
+
+	return NULL;
+}
+
+/** @brief Last VMA in the address space */
+static vma_t* vma_last(void)
+{
+	vma_t* vma = vma_root;
+
+	while (vma && vma->right)
+		vma = vma->right;
+
+	return vma;
+}
 
 int vma_init(void)
 {
@@ -80,34 +313,25 @@ out:
 size_t vma_alloc(size_t size, uint32_t flags)
 {
 	spinlock_irqsave_t* lock = &hermit_mm_lock;
-	vma_t** list = &vma_list;
 
 	LOG_DEBUG("vma_alloc: size = %#lx, flags = %#x\n", size, flags);
 
 	// boundaries of free gaps
 	size_t start, end;
 
-	// boundaries for search
-	size_t base = VMA_MIN;
-	size_t limit = VMA_MAX;
-
 	size = PAGE_CEIL(size);
 
 	spinlock_irqsave_lock(lock);
 
 	// first fit search for free memory area
-	vma_t* pred = NULL;  // vma before current gap
-	vma_t* succ = *list; // vma after current gap
-	do {
-		start = (pred) ? pred->end : base;
-		end = (succ) ? succ->start : limit;
+	vma_t* succ = vma_first_fit(size);	// vma after current gap
+	vma_t* pred = succ ? succ->prev : vma_last();	// vma before current gap
 
-		if (start + size < end && start >= base && start + size < limit)
-			goto found; // we found a gap which is large enough and in the bounds
+	start = (pred && (pred->end > VMA_MIN)) ? pred->end : VMA_MIN;
+	end = (succ && (succ->start < VMA_MAX)) ? succ->start : VMA_MAX;
 
-		pred = succ;
-		succ = (pred) ? pred->next : NULL;
-	} while (pred || succ);
+	if (start + size < end)
+		goto found; // we found a gap which is large enough and in the bounds
 
 fail:
 	spinlock_irqsave_unlock(lock);	// we were unlucky to find a free gap
@@ -115,8 +339,9 @@ fail:
 	return 0;
 
 found:
-	if (pred && pred->flags == flags) {
+	if (pred && (pred->end == start) && (pred->flags == flags)) {
 		pred->end += size; // resize VMA
+		vma_resized(pred);
 		LOG_DEBUG("vma_alloc: resize vma, start 0x%zx, pred->start 0x%zx, pred->end 0x%zx\n", start, pred->start, pred->end);
 	} else {
 		// insert new VMA
@@ -127,16 +352,9 @@ found:
 		new->start = start;
 		new->end = start + size;
 		new->flags = flags;
-		new->next = succ;
-		new->prev = pred;
 		LOG_DEBUG("vma_alloc: create new vma, new->start 0x%zx, new->end 0x%zx\n", new->start, new->end);
 
-		if (succ)
-			succ->prev = new;
-		if (pred)
-			pred->next = new;
-		else
-			*list = new;
+		vma_insert(new, pred);
 	}
 
 	spinlock_irqsave_unlock(lock);
@@ -148,7 +366,6 @@ int vma_free(size_t start, size_t end)
 {
 	spinlock_irqsave_t* lock = &hermit_mm_lock;
 	vma_t* vma;
-	vma_t** list = &vma_list;
 
 	LOG_DEBUG("vma_free: start = %#lx, end = %#lx\n", start, end);
 
@@ -158,32 +375,24 @@ int vma_free(size_t start, size_t end)
 	spinlock_irqsave_lock(lock);
 
 	// search vma
-	vma = *list;
-	while (vma) {
-		if (start >= vma->start && end <= vma->end) break;
-		vma = vma->next;
-	}
+	vma = vma_lookup(start);
 
-	if (BUILTIN_EXPECT(!vma, 0)) {
+	if (BUILTIN_EXPECT(!vma || (end > vma->end), 0)) {
 		spinlock_irqsave_unlock(lock);
 		return -EINVAL;
 	}
 
 	// free/resize vma
 	if (start == vma->start && end == vma->end) {
-		if (vma == *list)
-			*list = vma->next; // update list head
-		if (vma->prev)
-			vma->prev->next = vma->next;
-		if (vma->next)
-			vma->next->prev = vma->prev;
+		vma_remove(vma);
 		kfree(vma);
-	}
-	else if (start == vma->start)
+	} else if (start == vma->start) {
 		vma->start = end;
-	else if (end == vma->end)
+		vma_resized(vma);
+	} else if (end == vma->end) {
 		vma->end = start;
-	else {
+		vma_resized(vma);
+	} else {
 		vma_t* new = kmalloc(sizeof(vma_t));
 		if (BUILTIN_EXPECT(!new, 0)) {
 			spinlock_irqsave_unlock(lock);
@@ -196,9 +405,7 @@ int vma_free(size_t start, size_t end)
 		vma->end = start;
 		new->start = end;
 
-		new->next = vma->next;
-		vma->next = new;
-		new->prev = vma;
+		vma_insert(new, vma);
 	}
 
 	spinlock_irqsave_unlock(lock);
@@ -209,7 +416,6 @@ int vma_free(size_t start, size_t end)
 int vma_add(size_t start, size_t end, uint32_t flags)
 {
 	spinlock_irqsave_t* lock = &hermit_mm_lock;
-	vma_t** list = &vma_list;
 	int ret = 0;
 
 	if (BUILTIN_EXPECT(start >= end, 0))
@@ -220,25 +426,17 @@ int vma_add(size_t start, size_t end, uint32_t flags)
 	spinlock_irqsave_lock(lock);
 
 	// search gap
-	vma_t* pred = NULL;
-	vma_t* succ = *list;
+	vma_t* pred = vma_lookup(start);
+	vma_t* succ = pred ? pred->next : vma_list;
 
-	while (pred || succ) {
-		if ((!pred || pred->end <= start) &&
-		    (!succ || succ->start >= end))
-			break;
-
-		pred = succ;
-		succ = (succ) ? succ->next : NULL;
-	}
-
-	if (BUILTIN_EXPECT(*list && !pred && !succ, 0)) {
+	if (BUILTIN_EXPECT((pred && (pred->end > start)) || (succ && (succ->start < end)), 0)) {
 		ret = -EINVAL;
 		goto fail;
 	}
 
 	if (pred && (pred->end == start) && (pred->flags == flags)) {
 		pred->end = end; // resize VMA
+		vma_resized(pred);
 		LOG_DEBUG("vma_add: resize vma, start 0x%zx, pred->start 0x%zx, pred->end 0x%zx\n", start, pred->start, pred->end);
 	} else {
 		// insert new VMA
@@ -251,17 +449,9 @@ int vma_add(size_t start, size_t end, uint32_t flags)
 		new->start = start;
 		new->end = end;
 		new->flags = flags;
-		new->next = succ;
-		new->prev = pred;
 		LOG_DEBUG("vma_add: create new vma, new->start 0x%zx, new->end 0x%zx\n", new->start, new->end);
 
-		if (succ)
-			succ->prev = new;
-
-		if (pred)
-			pred->next = new;
-		else
-			*list = new;
+		vma_insert(new, pred);
 	}
 
 fail:
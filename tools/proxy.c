@@ -130,10 +130,39 @@ static void exit_handler(int sig)
 static char* get_append_string(void)
 {
 	uint32_t freq = get_cpufreq();
-	if (freq == 0)
-		return "-freq0 -proxy";
+	const char* huge = getenv("HERMIT_HUGEPAGES") ? " -hugepages" : "";
+	const char* lazy = getenv("HERMIT_LAZYSTACK") ? " -lazystack" : "";
+	const char* populate = getenv("HERMIT_POPULATE");
+	const char* zeropool = getenv("HERMIT_ZEROPOOL");
+	const char* idle = getenv("HERMIT_IDLE");
+	const char* timeslice = getenv("HERMIT_TIMESLICE");
+	char pool[32] = "";
+	char slice[32] = "";
+
+	if (!populate)
+		populate = "";
+	else if (strcmp(populate, "zero") == 0)
+		populate = " -populate-zero";
+	else
+		populate = " -populate";
+
+	if (zeropool)
+		snprintf(pool, sizeof(pool), " -zeropool=%d", atoi(zeropool));
+
+	if (timeslice)
+		snprintf(slice, sizeof(slice), " -timeslice=%d", atoi(timeslice));
 
-	snprintf(cmdline, MAX_PATH, "\"-freq%u -proxy\"", freq);
+	if (idle && (strcmp(idle, "poll") == 0))
+		idle = " -idle=poll";
+	else if (idle && (strcmp(idle, "deep") == 0))
+		idle = " -idle=deep";
+	else
+		idle = "";
+
+	if (freq == 0)
+		snprintf(cmdline, MAX_PATH, "-freq0 -proxy%s%s%s%s%s%s", huge, populate, pool, lazy, idle, slice);
+	else
+		snprintf(cmdline, MAX_PATH, "\"-freq%u -proxy%s%s%s%s%s%s\"", freq, huge, populate, pool, lazy, idle, slice);
 
 	return cmdline;
 }
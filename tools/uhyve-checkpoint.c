@@ -0,0 +1,207 @@
+/* Copyright (c) 2017, RWTH Aachen University
+ * Author(s): Stefan Lankes <slankes@eonerc.rwth-aachen.de>
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Write-out of checkpoints.
+ *
+ * While the vCPUs are stopped, the dirty pages are only copied into a
+ * staging buffer, which has the layout of the checkpoint file. After
+ * the vCPUs are resumed, a group of threads writes the buffer in large
+ * chunks at their final offsets into the file. The configuration file
+ * is updated only after the write-out, hence it always describes a
+ * complete checkpoint.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include "uhyve-checkpoint.h"
+
+/// Initial size of the staging buffer
+#define STAGING_SIZE	(64UL << 20)
+
+static uint8_t* staging = NULL;
+static size_t staging_size = 0;
+static size_t staged = 0;
+
+static bool writing = false;
+static pthread_t writer;
+
+static int chk_fd = -1;
+static uint32_t chk_no = 0;
+static bool chk_verbose = false;
+static checkpoint_done_t chk_done = NULL;
+/// next chunk, which has to be written
+static size_t next_chunk = 0;
+
+static void block_signals(void)
+{
+	sigset_t set;
+
+	// checkpointing signals are handled by the vCPU threads
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigaddset(&set, SIGRTMIN);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+static void* write_chunks(void* arg)
+{
+	size_t chunk, off, len;
+	ssize_t ret;
+
+	block_signals();
+
+	while ((chunk = __sync_fetch_and_add(&next_chunk, 1)) * CHECKPOINT_CHUNK < staged) {
+		off = chunk * CHECKPOINT_CHUNK;
+		len = staged - off < CHECKPOINT_CHUNK ? staged - off : CHECKPOINT_CHUNK;
+
+		while (len > 0) {
+			ret = pwrite(chk_fd, staging + off, len, off);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+				err(1, "unable to write checkpoint %u", chk_no);
+			}
+
+			off += ret;
+			len -= ret;
+		}
+	}
+
+	return NULL;
+}
+
+static void* write_checkpoint(void* arg)
+{
+	const char* str = getenv("HERMIT_CHECKPOINT_THREADS");
+	int i, nthreads = CHECKPOINT_THREADS;
+	struct timeval begin, end;
+	pthread_t* threads;
+
+	block_signals();
+
+	if (str && (atoi(str) > 0))
+		nthreads = atoi(str);
+
+	if (chk_verbose)
+		gettimeofday(&begin, NULL);
+
+	threads = (pthread_t*) calloc(nthreads, sizeof(pthread_t));
+	if (!threads)
+		err(1, "Not enough memory");
+
+	// this thread is the first writer
+	next_chunk = 0;
+	for(i=1; i<nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, write_chunks, NULL))
+			err(1, "unable to create a writer of the checkpoint");
+	}
+	write_chunks(NULL);
+	for(i=1; i<nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	close(chk_fd);
+	chk_fd = -1;
+
+	if (chk_done)
+		chk_done(chk_no);
+
+	if (chk_verbose) {
+		gettimeofday(&end, NULL);
+		size_t usec = (end.tv_sec - begin.tv_sec) * 1000000;
+		usec += end.tv_usec - begin.tv_usec;
+		fprintf(stderr, "Write checkpoint %u (%zu KiB) in %zu ms with %d threads (%zu MiB/s)\n",
+			chk_no, staged >> 10, usec / 1000, nthreads,
+			usec ? (staged * 1000000 / usec) >> 20 : 0);
+	}
+
+	return NULL;
+}
+
+void checkpoint_wait(void)
+{
+	if (writing) {
+		pthread_join(writer, NULL);
+		writing = false;
+	}
+}
+
+void checkpoint_begin(uint32_t no, bool verbose)
+{
+	checkpoint_wait();
+
+	if (!staging) {
+		staging_size = STAGING_SIZE;
+		staging = mmap(NULL, staging_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+		if (staging == MAP_FAILED)
+			err(1, "unable to allocate the staging buffer of the checkpoints");
+	}
+
+	staged = 0;
+	chk_no = no;
+	chk_verbose = verbose;
+}
+
+void checkpoint_stage(const void* hdr, size_t hdr_len, const void* data, size_t len)
+{
+	// grow the staging buffer. Its pages are populated on first use and
+	// stay populated, so later checkpoints don't fault them in again.
+	if (staged + hdr_len + len > staging_size) {
+		size_t size = staging_size;
+
+		while (staged + hdr_len + len > size)
+			size *= 2;
+
+		staging = mremap(staging, staging_size, size, MREMAP_MAYMOVE);
+		if (staging == MAP_FAILED)
+			err(1, "unable to extend the staging buffer of the checkpoints");
+		staging_size = size;
+	}
+
+	memcpy(staging + staged, hdr, hdr_len);
+	staged += hdr_len;
+	if (len) {
+		memcpy(staging + staged, data, len);
+		staged += len;
+	}
+}
+
+void checkpoint_commit(const char* fname, checkpoint_done_t done)
+{
+	chk_fd = open(fname, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+	if (chk_fd < 0)
+		err(1, "open: unable to open file %s", fname);
+
+	chk_done = done;
+	if (pthread_create(&writer, NULL, write_checkpoint, NULL))
+		err(1, "unable to create the writer of the checkpoint");
+	writing = true;
+}
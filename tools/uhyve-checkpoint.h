@@ -0,0 +1,47 @@
+/* Copyright (c) 2017, RWTH Aachen University
+ * Author(s): Stefan Lankes <slankes@eonerc.rwth-aachen.de>
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __UHYVE_CHECKPOINT_H__
+#define __UHYVE_CHECKPOINT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Default number of threads, which write a checkpoint (HERMIT_CHECKPOINT_THREADS)
+#define CHECKPOINT_THREADS	4
+/// Size of a single write, the offsets of the writes are multiples of this size
+#define CHECKPOINT_CHUNK	(4UL << 20)
+
+/// Called after a checkpoint is completely written
+typedef void (*checkpoint_done_t)(uint32_t no);
+
+/** Start the staging of a new checkpoint.
+ *  Waits until the previous checkpoint is written. */
+void checkpoint_begin(uint32_t no, bool verbose);
+
+/** Append a header and the data of a memory region to the staging buffer */
+void checkpoint_stage(const void* hdr, size_t hdr_len, const void* data, size_t len);
+
+/** Write the staged checkpoint in the background to fname and call done afterwards */
+void checkpoint_commit(const char* fname, checkpoint_done_t done);
+
+/** Wait until the last checkpoint is written */
+void checkpoint_wait(void);
+
+#endif
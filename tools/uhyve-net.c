@@ -29,14 +29,36 @@
  *            for HermitCore
  */
 
+#define _GNU_SOURCE
+
 #include "uhyve-net.h"
 #include <ctype.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+/// Maximum number of packets, which are moved before the counters are published
+#define UHYVE_NET_BATCH	64
 
 /* TODO: create an array or equal for more then one netif */
 static uhyve_netinfo_t netinfo;
 
+/// A queue pair and the TAP queue, which serves it
+typedef struct {
+	uhyve_netring_t* ring;
+	int fd;
+	int kickfd;
+} net_queue_t;
+
+static net_queue_t net_queues[UHYVE_NET_MAX_QUEUES];
+static uint32_t net_nqueues = 1;
+static uint8_t* net_mem = NULL;
+static int net_efd = -1;
+static int net_attached = 0;
+
 //-------------------------------------- ATTACH LINUX TAP -----------------------------------------//
-int attach_linux_tap(const char *dev)
+int attach_linux_tap(const char *dev, int multi_queue)
 {
 	struct ifreq ifr;
 	int fd, err;
@@ -56,6 +78,9 @@ int attach_linux_tap(const char *dev)
 	memset(&ifr, 0x00, sizeof(ifr));
 
 	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	// each call attaches a further queue of the device
+	if (multi_queue)
+		ifr.ifr_flags |= IFF_MULTI_QUEUE;
 	if (strlen(dev) > IFNAMSIZ) {
 		errno = EINVAL;
 		return -1;
@@ -171,19 +196,224 @@ int uhyve_set_mac(void)
 //-------------------------------------- SETUP NETWORK ---------------------------------------------//
 int uhyve_net_init(const char *netif)
 {
+	const char* str = getenv("HERMIT_NETIF_QUEUES");
+	uint32_t i;
+
 	if (netif == NULL) {
 		err(1, "ERROR: no netif defined\n");
 		return -1;
 	}
 
-	// attaching netif
-	netfd = attach_linux_tap(netif);
-	if (netfd < 0) {
-		err(1, "Could not attach interface: %s\n", netif);
-		exit(1);
+	if (str && (atoi(str) > 0))
+		net_nqueues = atoi(str);
+	if (net_nqueues > UHYVE_NET_MAX_QUEUES)
+		net_nqueues = UHYVE_NET_MAX_QUEUES;
+	// a pre-existing fd provides only one queue
+	if (netif[0] == '@')
+		net_nqueues = 1;
+
+	// attaching netif, one fd per queue
+	for(i=0; i<net_nqueues; i++) {
+		net_queues[i].fd = attach_linux_tap(netif, net_nqueues > 1);
+		if (net_queues[i].fd < 0) {
+			err(1, "Could not attach interface: %s\n", netif);
+			exit(1);
+		}
+		net_queues[i].kickfd = -1;
 	}
+	netfd = net_queues[0].fd;
 
 	uhyve_set_mac();
 
 	return netfd;
 }
+
+uint32_t uhyve_net_queues(void)
+{
+	return net_nqueues;
+}
+
+//-------------------------------------- RINGS ---------------------------------------------//
+
+/*
+ * Each network thread moves the packets between a queue of the TAP
+ * device and a queue pair in guest memory. Received packets are
+ * published in batches and signaled by one interrupt, as long as the
+ * guest doesn't poll the rings. The guest kicks a thread only if it
+ * sleeps. A TAP device delivers one frame per read or write, hence the
+ * batching happens at the level of the notifications.
+ *
+ * The guest selects the transmit queue by a hash of the flow. The TAP
+ * device steers the received packets of a flow to the queue, which has
+ * sent its last packet.
+ */
+
+static int net_rx(net_queue_t* queue)
+{
+	const uint64_t event_counter = 1;
+	uhyve_netq_t* rx = &queue->ring->rx;
+	uint32_t used = rx->used;
+	uhyve_netdesc_t* desc;
+	ssize_t ret;
+	int n = 0;
+
+	while ((used != rx->avail) && (n < UHYVE_NET_BATCH)) {
+		__sync_synchronize();
+		desc = &rx->desc[used & UHYVE_NET_RING_MASK];
+
+		ret = read(queue->fd, net_mem + desc->addr, desc->len);
+		if (ret < 0) {
+			if ((errno != EAGAIN) && (errno != EINTR))
+				warn("uhyve: unable to receive a packet");
+			break;
+		}
+
+		desc->len = ret;
+		used++;
+		n++;
+	}
+
+	if (n) {
+		__sync_synchronize();
+		rx->used = used;
+
+		// pairs with the barrier of the guest after enabling the interrupt
+		__sync_synchronize();
+		if (!rx->no_irq && (write(net_efd, &event_counter, sizeof(event_counter)) < 0))
+			warn("uhyve: unable to signal received packets");
+	}
+
+	return n;
+}
+
+static int net_tx(net_queue_t* queue)
+{
+	uhyve_netq_t* tx = &queue->ring->tx;
+	uint32_t used = tx->used;
+	uhyve_netdesc_t* desc;
+	int n = 0;
+
+	while ((used != tx->avail) && (n < UHYVE_NET_BATCH)) {
+		__sync_synchronize();
+		desc = &tx->desc[used & UHYVE_NET_RING_MASK];
+
+		// a full TAP device drops the packet like a congested link
+		if ((write(queue->fd, net_mem + desc->addr, desc->len) < 0) && (errno != EAGAIN))
+			warn("uhyve: unable to send a packet");
+
+		used++;
+		n++;
+	}
+
+	if (n) {
+		__sync_synchronize();
+		tx->used = used;
+	}
+
+	return n;
+}
+
+static void* net_thread(void* arg)
+{
+	net_queue_t* queue = (net_queue_t*) arg;
+	uhyve_netring_t* ring = queue->ring;
+	struct pollfd fds[2];
+	uint64_t event_counter;
+	sigset_t set;
+
+	// checkpointing signals are handled by the vCPU threads
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigaddset(&set, SIGRTMIN);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	fds[0].fd = queue->fd;
+	fds[1].fd = queue->kickfd;
+	fds[1].events = POLLIN;
+
+	while (1) {
+		if (net_tx(queue) + net_rx(queue))
+			continue;
+
+		ring->host_idle = 1;
+
+		// pairs with the barrier of the guest after a publication
+		__sync_synchronize();
+		if (ring->tx.used != ring->tx.avail) {
+			ring->host_idle = 0;
+			continue;
+		}
+
+		// without free receive buffers, only a kick wakes up the thread
+		fds[0].events = (ring->rx.used != ring->rx.avail) ? POLLIN : 0;
+		fds[0].revents = fds[1].revents = 0;
+
+		if ((poll(fds, 2, -1) < 0) && (errno != EINTR))
+			warn("uhyve: poll of the network thread failed");
+
+		if (fds[1].revents & POLLIN)
+			read(queue->kickfd, &event_counter, sizeof(event_counter));
+
+		ring->host_idle = 0;
+	}
+
+	return NULL;
+}
+
+void uhyve_net_ring_init(uint8_t* mem, uint64_t args, int vmfd, int efd)
+{
+	uhyve_netrings_t* rings = (uhyve_netrings_t*) (mem + args);
+	struct kvm_ioeventfd ioeventfd = {};
+	pthread_t thread;
+	uint32_t i;
+
+	// already attached
+	if (net_attached)
+		return;
+
+	if (efd < 0) {
+		warnx("uhyve: network isn't initialized, ignore the rings of the guest");
+		return;
+	}
+
+	if ((rings->num < 1) || (rings->num > net_nqueues)) {
+		warnx("uhyve: guest registers %u queue pairs, but %u are offered", rings->num, net_nqueues);
+		return;
+	}
+
+	net_mem = mem;
+	net_efd = efd;
+	net_attached = 1;
+
+	for(i=0; i<rings->num; i++) {
+		net_queue_t* queue = &net_queues[i];
+
+		queue->ring = ((uhyve_netring_t*) (mem + rings->rings)) + i;
+		queue->kickfd = eventfd(0, EFD_NONBLOCK);
+		if (queue->kickfd < 0)
+			err(1, "unable to create the eventfd of the network thread");
+
+		// deliver the kicks directly to the eventfd, without an exit to user space
+		memset(&ioeventfd, 0x00, sizeof(ioeventfd));
+		ioeventfd.datamatch = i;
+		ioeventfd.addr = UHYVE_PORT_NETKICK;
+		ioeventfd.len = 4;
+		ioeventfd.fd = queue->kickfd;
+		ioeventfd.flags = KVM_IOEVENTFD_FLAG_PIO | KVM_IOEVENTFD_FLAG_DATAMATCH;
+		if (ioctl(vmfd, KVM_IOEVENTFD, &ioeventfd) < 0)
+			warn("KVM: unable to assign an ioeventfd, the vCPUs forward the kicks");
+
+		if (pthread_create(&thread, NULL, net_thread, queue))
+			err(1, "unable to create the network thread");
+		pthread_detach(thread);
+	}
+}
+
+void uhyve_net_kick(uint32_t queue)
+{
+	const uint64_t event_counter = 1;
+
+	if ((queue < net_nqueues) && (net_queues[queue].kickfd >= 0)
+	    && (write(net_queues[queue].kickfd, &event_counter, sizeof(event_counter)) < 0))
+		warn("uhyve: unable to kick the network thread");
+}
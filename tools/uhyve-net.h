@@ -30,26 +30,45 @@ static int netfd;
 typedef struct {
 	/* OUT */
 	char mac_str[18];
+	uint32_t queues;
 } __attribute__((packed)) uhyve_netinfo_t;
 
-// UHYVE_PORT_NETWRITE
+#define UHYVE_PORT_NETRING	0x50D
+#define UHYVE_PORT_NETKICK	0x50E
+
+/// Number of descriptors of the receive and the transmit queue (power of two)
+#define UHYVE_NET_RING_SIZE	256
+#define UHYVE_NET_RING_MASK	(UHYVE_NET_RING_SIZE - 1)
+/// Maximum number of queue pairs (HERMIT_NETIF_QUEUES)
+#define UHYVE_NET_MAX_QUEUES	8
+
+// the layout of the rings has to match with drivers/net/uhyve-net.h of the kernel
 typedef struct {
-	/* IN */
-	const void* data;
-	size_t len;
-	/* OUT */
-	int ret;
-} __attribute__((packed)) uhyve_netwrite_t;
+	uint64_t addr;
+	uint32_t len;
+	uint32_t flags;
+} uhyve_netdesc_t;
 
-// UHYVE_PORT_NETREAD
 typedef struct {
-        /* IN */
-	void* data;
-        /* IN / OUT */
-	size_t len;
-	/* OUT */
-	int ret;
-} __attribute__((packed)) uhyve_netread_t;
+	volatile uint32_t avail __attribute__ ((aligned (64)));
+	volatile uint32_t no_irq;
+	volatile uint32_t used __attribute__ ((aligned (64)));
+	uhyve_netdesc_t desc[UHYVE_NET_RING_SIZE] __attribute__ ((aligned (64)));
+} uhyve_netq_t;
+
+// one pair of queues
+typedef struct {
+	volatile uint32_t host_idle __attribute__ ((aligned (64)));
+	uhyve_netq_t rx;
+	uhyve_netq_t tx;
+} uhyve_netring_t;
+
+// UHYVE_PORT_NETRING
+typedef struct {
+	/* IN */
+	uint64_t rings;
+	uint32_t num;
+} __attribute__((packed)) uhyve_netrings_t;
 
 // UHYVE_PORT_NETSTAT
 typedef struct {
@@ -60,4 +79,15 @@ typedef struct {
 int uhyve_net_init(const char *hermit_netif);
 char* uhyve_get_mac(void);
 
+/** Number of queue pairs, which are offered to the guest */
+uint32_t uhyve_net_queues(void);
+
+/** Attach the rings, which are described by the uhyve_netrings_t at the guest
+ *  physical address args, and start one network thread per queue pair.
+ *  Received packets are signaled via the eventfd efd. */
+void uhyve_net_ring_init(uint8_t* mem, uint64_t args, int vmfd, int efd);
+
+/** Wake up the network thread of a queue pair (UHYVE_PORT_NETKICK) */
+void uhyve_net_kick(uint32_t queue);
+
 #endif
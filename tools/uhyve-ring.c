@@ -0,0 +1,216 @@
+/* Copyright (c) 2017, RWTH Aachen University
+ * Author(s): Stefan Lankes <slankes@eonerc.rwth-aachen.de>
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Worker threads, which execute the requests of the shared request ring.
+ *
+ * The guest queues its I/O requests in a ring in guest memory. The
+ * workers take the requests, execute them with the same handlers as
+ * the synchronous port I/O and post the completions to the guest,
+ * which is notified by an interrupt. A blocking read or write delays
+ * only the waiting guest task, not the vCPU. The guest rings the
+ * doorbell only if a worker sleeps.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <err.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <linux/kvm.h>
+
+#include "uhyve-ring.h"
+
+static uhyve_ring_t* ring = NULL;
+static uhyve_io_handler_t io_handler = NULL;
+static int ring_efd = -1;
+
+/// protects the consumption of the submission queue and the sleeping workers
+static pthread_mutex_t sq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sq_cond = PTHREAD_COND_INITIALIZER;
+/// protects the production of completions
+static pthread_mutex_t cq_lock = PTHREAD_MUTEX_INITIALIZER;
+/// number of workers, which wait for requests
+static uint32_t sleeping = 0;
+/// number of consumed requests, which aren't completed yet
+static uint32_t in_flight = 0;
+/// the workers don't consume requests during a checkpoint
+static int paused = 0;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+
+static inline int sq_empty(void)
+{
+	return ring->sq_head == ring->sq_tail;
+}
+
+static void* ring_worker(void* arg)
+{
+	const uint64_t event_counter = 1;
+	uhyve_sqe_t sqe;
+	uint32_t head;
+	sigset_t set;
+
+	// checkpointing signals are handled by the vCPU threads
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigaddset(&set, SIGRTMIN);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	while (1) {
+		pthread_mutex_lock(&sq_lock);
+
+		while (paused || sq_empty()) {
+			sleeping++;
+			ring->host_idle = 1;
+
+			// pairs with the barrier of the guest after a submission
+			__sync_synchronize();
+			if (paused || sq_empty())
+				pthread_cond_wait(&sq_cond, &sq_lock);
+
+			sleeping--;
+			// further sleeping workers have to be woken by the doorbell
+			ring->host_idle = (sleeping != 0);
+		}
+
+		__sync_synchronize();
+		head = ring->sq_head;
+		sqe = ring->sq[head & UHYVE_RING_MASK];
+		ring->sq_head = head + 1;
+		in_flight++;
+
+		// further requests => execute them in parallel
+		if (!sq_empty() && sleeping)
+			pthread_cond_signal(&sq_cond);
+
+		pthread_mutex_unlock(&sq_lock);
+
+		if (io_handler(sqe.port, sqe.args))
+			warnx("uhyve: unsupported request at port 0x%x in the request ring", sqe.port);
+
+		pthread_mutex_lock(&cq_lock);
+		ring->cq[ring->cq_tail & UHYVE_RING_MASK].user_data = sqe.user_data;
+		__sync_synchronize();
+		ring->cq_tail++;
+		pthread_mutex_unlock(&cq_lock);
+
+		if (write(ring_efd, &event_counter, sizeof(event_counter)) < 0)
+			warn("uhyve: unable to signal the completion");
+
+		pthread_mutex_lock(&sq_lock);
+		in_flight--;
+		if (paused && !in_flight)
+			pthread_cond_signal(&idle_cond);
+		pthread_mutex_unlock(&sq_lock);
+	}
+
+	return NULL;
+}
+
+void uhyve_ring_init(uint8_t* mem, uint64_t ring_addr, int vmfd, uhyve_io_handler_t handler)
+{
+	struct kvm_irqfd irqfd = {};
+	const char* str = getenv("HERMIT_RING_WORKERS");
+	int i, nworkers = UHYVE_RING_WORKERS;
+	pthread_t thread;
+
+	// already attached
+	if (ring)
+		return;
+
+	if (str && (atoi(str) > 0))
+		nworkers = atoi(str);
+
+	ring = (uhyve_ring_t*) (mem + ring_addr);
+	io_handler = handler;
+
+	ring_efd = eventfd(0, 0);
+	if (ring_efd < 0)
+		err(1, "unable to create the eventfd of the request ring");
+
+	irqfd.fd = ring_efd;
+	irqfd.gsi = UHYVE_RING_IRQ;
+	if (ioctl(vmfd, KVM_IRQFD, &irqfd) < 0)
+		err(1, "KVM: unable to assign the irq of the request ring");
+
+	// the interrupt of completions, which are posted before a checkpoint,
+	// isn't part of the checkpoint => signal them again after a restart
+	if (ring->cq_head != ring->cq_tail) {
+		const uint64_t event_counter = 1;
+
+		if (write(ring_efd, &event_counter, sizeof(event_counter)) < 0)
+			warn("uhyve: unable to signal the completions");
+	}
+
+	for(i=0; i<nworkers; i++) {
+		if (pthread_create(&thread, NULL, ring_worker, NULL))
+			err(1, "unable to create a worker of the request ring");
+		pthread_detach(thread);
+	}
+}
+
+void uhyve_ring_doorbell(void)
+{
+	sigset_t set, old;
+
+	if (!ring)
+		return;
+
+	// the checkpoint handler runs on a vCPU thread and takes sq_lock as well
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigaddset(&set, SIGRTMIN);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+
+	pthread_mutex_lock(&sq_lock);
+	// the woken worker wakes up further workers, if required
+	pthread_cond_signal(&sq_cond);
+	pthread_mutex_unlock(&sq_lock);
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+void uhyve_ring_quiesce(void)
+{
+	if (!ring)
+		return;
+
+	pthread_mutex_lock(&sq_lock);
+	paused = 1;
+	while (in_flight)
+		pthread_cond_wait(&idle_cond, &sq_lock);
+	pthread_mutex_unlock(&sq_lock);
+}
+
+void uhyve_ring_resume(void)
+{
+	if (!ring)
+		return;
+
+	pthread_mutex_lock(&sq_lock);
+	paused = 0;
+	pthread_cond_broadcast(&sq_cond);
+	pthread_mutex_unlock(&sq_lock);
+}
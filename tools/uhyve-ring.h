@@ -0,0 +1,69 @@
+/* Copyright (c) 2017, RWTH Aachen University
+ * Author(s): Stefan Lankes <slankes@eonerc.rwth-aachen.de>
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __UHYVE_RING_H__
+#define __UHYVE_RING_H__
+
+#include <stdint.h>
+
+/// IRQ, which signals new completions to the guest
+#define UHYVE_RING_IRQ		10
+/// Number of entries of the submission and the completion queue (power of two)
+#define UHYVE_RING_SIZE		256
+#define UHYVE_RING_MASK		(UHYVE_RING_SIZE - 1)
+
+/// Default number of worker threads (HERMIT_RING_WORKERS)
+#define UHYVE_RING_WORKERS	2
+
+// the layout has to match with arch/x86/include/asm/uhyve.h of the kernel
+typedef struct {
+	uint32_t port;
+	uint32_t args;
+	uint64_t user_data;
+} uhyve_sqe_t;
+
+typedef struct {
+	uint64_t user_data;
+} uhyve_cqe_t;
+
+typedef struct {
+	volatile uint32_t sq_tail __attribute__ ((aligned (64)));
+	volatile uint32_t cq_head;
+	volatile uint32_t sq_head __attribute__ ((aligned (64)));
+	volatile uint32_t cq_tail;
+	volatile uint32_t host_idle;
+	uhyve_sqe_t sq[UHYVE_RING_SIZE] __attribute__ ((aligned (64)));
+	uhyve_cqe_t cq[UHYVE_RING_SIZE];
+} uhyve_ring_t;
+
+/// Executes the request of a port, returns non-zero for unknown ports
+typedef int (*uhyve_io_handler_t)(uint16_t port, unsigned data);
+
+/** Attach the ring at the guest physical address ring_addr and start the workers */
+void uhyve_ring_init(uint8_t* mem, uint64_t ring_addr, int vmfd, uhyve_io_handler_t handler);
+
+/** Wake up a sleeping worker (UHYVE_PORT_DOORBELL) */
+void uhyve_ring_doorbell(void);
+
+/** Stop the consumption of requests and wait for the completion of the running ones */
+void uhyve_ring_quiesce(void);
+
+/** Continue the consumption of requests after a checkpoint */
+void uhyve_ring_resume(void);
+
+#endif
@@ -27,7 +27,11 @@ typedef enum {
 	UHYVE_PORT_CLOSE	= 0x501,
 	UHYVE_PORT_READ		= 0x502,
 	UHYVE_PORT_EXIT		= 0x503,
-	UHYVE_PORT_LSEEK	= 0x504
+	UHYVE_PORT_LSEEK	= 0x504,
+	UHYVE_PORT_RINGINIT	= 0x509,
+	UHYVE_PORT_DOORBELL	= 0x50A,
+	UHYVE_PORT_READV	= 0x50B,
+	UHYVE_PORT_WRITEV	= 0x50C
 } uhyve_syscall_t;
 
 typedef struct {
@@ -61,4 +65,20 @@ typedef struct {
 	int whence;
 } __attribute__((packed)) uhyve_lseek_t;
 
+/// Maximal number of segments of a vectored request
+#define UHYVE_IOV_MAX	64
+
+typedef struct {
+	size_t addr;
+	size_t len;
+} uhyve_seg_t;
+
+typedef struct {
+	int fd;
+	int cnt;
+	uhyve_seg_t* segs;
+	off_t offset;
+	ssize_t ret;
+} __attribute__((packed)) uhyve_rw_t;
+
 #endif // UHYVE_SYSCALLS_H
@@ -48,7 +48,6 @@
 #include <pthread.h>
 #include <elf.h>
 #include <err.h>
-#include <poll.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -57,6 +56,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/eventfd.h>
 #include <linux/const.h>
 #include <linux/kvm.h>
@@ -66,6 +66,8 @@
 #include "uhyve-cpu.h"
 #include "uhyve-syscalls.h"
 #include "uhyve-net.h"
+#include "uhyve-ring.h"
+#include "uhyve-checkpoint.h"
 #include "proxy.h"
 
 // define this macro to create checkpoints with KVM's dirty log
@@ -155,8 +157,6 @@
 
 // Networkports
 #define UHYVE_PORT_NETINFO		0x505
-#define UHYVE_PORT_NETWRITE		0x506
-#define UHYVE_PORT_NETREAD		0x507
 #define UHYVE_PORT_NETSTAT		0x508
 
 #define UHYVE_IRQ	11
@@ -180,7 +180,6 @@ static uint8_t* mboot = NULL;
 static size_t guest_size = 0x20000000ULL;
 static uint64_t elf_entry;
 static pthread_t* vcpu_threads = NULL;
-static pthread_t net_thread;
 static int* vcpu_fds = NULL;
 static int kvm = -1, vmfd = -1, netfd = -1, efd = -1;
 static uint32_t no_checkpoint = 0;
@@ -251,9 +250,6 @@ static void uhyve_exit(void* arg)
 
 			pthread_kill(vcpu_threads[i], SIGTERM);
 		}
-
-		if (netfd > 0)
-			pthread_kill(net_thread, SIGTERM);
 	}
 
 	close_fd(&vcpufd);
@@ -261,6 +257,9 @@ static void uhyve_exit(void* arg)
 
 static void uhyve_atexit(void)
 {
+	// complete the write-out of the last checkpoint
+	checkpoint_wait();
+
 	uhyve_exit(NULL);
 
 	if (vcpu_threads) {
@@ -401,6 +400,28 @@ static int load_kernel(uint8_t* mem, char* path)
 				*((uint8_t*) (mem+paddr-GUEST_OFFSET + 0xBB)) = (uint8_t) ip[3];
 			}
 
+			if (getenv("HERMIT_HUGEPAGES"))
+				*((uint32_t*) (mem+paddr-GUEST_OFFSET + 0xBC)) = 1; // back the heap by 2 MiB pages
+
+			str = getenv("HERMIT_POPULATE");
+			if (str) // map (1) or map and zero (2) new heap pages at sbrk
+				*((uint32_t*) (mem+paddr-GUEST_OFFSET + 0xC0)) = (strcmp(str, "zero") == 0) ? 2 : 1;
+
+			str = getenv("HERMIT_ZEROPOOL");
+			if (str) // number of zeroed pages, which are kept in reserve
+				*((uint32_t*) (mem+paddr-GUEST_OFFSET + 0xC4)) = (uint32_t) atoi(str);
+
+			if (getenv("HERMIT_LAZYSTACK"))
+				*((uint32_t*) (mem+paddr-GUEST_OFFSET + 0xC8)) = 1; // populate thread stacks on demand
+
+			str = getenv("HERMIT_IDLE");
+			if (str) // poll the ready queue (1) or sleep immediately (2) on idle cores
+				*((uint32_t*) (mem+paddr-GUEST_OFFSET + 0xCC)) = (strcmp(str, "poll") == 0) ? 1 : ((strcmp(str, "deep") == 0) ? 2 : 0);
+
+			str = getenv("HERMIT_TIMESLICE");
+			if (str) // length of a round robin time slice in microseconds
+				*((uint32_t*) (mem+paddr-GUEST_OFFSET + 0xD0)) = (uint32_t) atoi(str);
+
 		}
 		*((uint64_t*) (mem+paddr-GUEST_OFFSET + 0x38)) += memsz; // total kernel size
 	}
@@ -710,36 +731,9 @@ static void setup_cpuid(int kvm, int vcpufd)
 	free(kvm_cpuid);
 }
 
-static void* wait_for_packet(void* arg)
-{
-	int ret;
-	struct pollfd fds = {	.fd = netfd,
-							.events = POLLIN,
-							.revents  = 0};
-
-	while(1)
-	{
-		fds.revents = 0;
-
-		ret = poll(&fds, 1, -1000);
-
-		if (ret < 0 && errno == EINTR)
-			continue;
-
-		if (ret < 0)
-			perror("poll()");
-		else if (ret) {
-			uint64_t event_counter = 1;
-			write(efd, &event_counter, sizeof(event_counter));
-		}
-	}
-
-	return NULL;
-}
-
 static inline void check_network(void)
 {
-	// should we start the network thread?
+	// should we create the interrupt of the network device?
 	if ((efd < 0) && (getenv("HERMIT_NETIF"))) {
 		struct kvm_irqfd irqfd = {};
 
@@ -747,10 +741,88 @@ static inline void check_network(void)
 		irqfd.fd = efd;
 		irqfd.gsi = UHYVE_IRQ;
 		kvm_ioctl(vmfd, KVM_IRQFD, &irqfd);
+	}
+}
+
+/*
+ * Requests, which are also executed by the workers of the request ring.
+ * data is the guest physical address of the argument structure.
+ */
+static int uhyve_io(uint16_t port, unsigned data)
+{
+	ssize_t ret;
+
+	switch (port) {
+	case UHYVE_PORT_WRITE: {
+			uhyve_write_t* uhyve_write = (uhyve_write_t*) (guest_mem+data);
+
+			uhyve_write->len = write(uhyve_write->fd, guest_mem+(size_t)uhyve_write->buf, uhyve_write->len);
+			break;
+		}
+
+	case UHYVE_PORT_READ: {
+			uhyve_read_t* uhyve_read = (uhyve_read_t*) (guest_mem+data);
+
+			uhyve_read->ret = read(uhyve_read->fd, guest_mem+(size_t)uhyve_read->buf, uhyve_read->len);
+			break;
+		}
+
+	case UHYVE_PORT_OPEN: {
+			uhyve_open_t* uhyve_open = (uhyve_open_t*) (guest_mem+data);
+
+			uhyve_open->ret = open((const char*)guest_mem+(size_t)uhyve_open->name, uhyve_open->flags, uhyve_open->mode);
+			break;
+		}
+
+	case UHYVE_PORT_CLOSE: {
+			uhyve_close_t* uhyve_close = (uhyve_close_t*) (guest_mem+data);
+
+			if (uhyve_close->fd > 2)
+				uhyve_close->ret = close(uhyve_close->fd);
+			else
+				uhyve_close->ret = 0;
+			break;
+		}
+
+	case UHYVE_PORT_READV:
+	case UHYVE_PORT_WRITEV: {
+			uhyve_rw_t* uhyve_rw = (uhyve_rw_t*) (guest_mem+data);
+			uhyve_seg_t* segs = (uhyve_seg_t*) (guest_mem+(size_t)uhyve_rw->segs);
+			struct iovec iov[UHYVE_IOV_MAX];
+			int i, cnt = uhyve_rw->cnt;
+
+			if ((cnt < 0) || (cnt > UHYVE_IOV_MAX)) {
+				uhyve_rw->ret = -EINVAL;
+				break;
+			}
+
+			for(i=0; i<cnt; i++) {
+				iov[i].iov_base = guest_mem + segs[i].addr;
+				iov[i].iov_len = segs[i].len;
+			}
+
+			// a negative offset uses the file position
+			if (port == UHYVE_PORT_READV)
+				ret = uhyve_rw->offset < 0 ? readv(uhyve_rw->fd, iov, cnt) : preadv(uhyve_rw->fd, iov, cnt, uhyve_rw->offset);
+			else
+				ret = uhyve_rw->offset < 0 ? writev(uhyve_rw->fd, iov, cnt) : pwritev(uhyve_rw->fd, iov, cnt, uhyve_rw->offset);
+
+			uhyve_rw->ret = ret < 0 ? -errno : ret;
+			break;
+		}
+
+	case UHYVE_PORT_LSEEK: {
+			uhyve_lseek_t* uhyve_lseek = (uhyve_lseek_t*) (guest_mem+data);
 
-		if (pthread_create(&net_thread, NULL, wait_for_packet, NULL))
-			err(1, "unable to create thread");
+			uhyve_lseek->offset = lseek(uhyve_lseek->fd, uhyve_lseek->offset, uhyve_lseek->whence);
+			break;
+		}
+
+	default:
+		return -1;
 	}
+
+	return 0;
 }
 
 static int vcpu_loop(void)
@@ -796,22 +868,6 @@ static int vcpu_loop(void)
 		case KVM_EXIT_IO:
 			//printf("port 0x%x\n", run->io.port);
 			switch (run->io.port) {
-			case UHYVE_PORT_WRITE: {
-					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
-					uhyve_write_t* uhyve_write = (uhyve_write_t*) (guest_mem+data);
-
-					uhyve_write->len = write(uhyve_write->fd, guest_mem+(size_t)uhyve_write->buf, uhyve_write->len);
-					break;
-				}
-
-			case UHYVE_PORT_READ: {
-					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
-					uhyve_read_t* uhyve_read = (uhyve_read_t*) (guest_mem+data);
-
-					uhyve_read->ret = read(uhyve_read->fd, guest_mem+(size_t)uhyve_read->buf, uhyve_read->len);
-					break;
-				}
-
 			case UHYVE_PORT_EXIT: {
 					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
 
@@ -822,59 +878,16 @@ static int vcpu_loop(void)
 					break;
 				}
 
-			case UHYVE_PORT_OPEN: {
-					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
-					uhyve_open_t* uhyve_open = (uhyve_open_t*) (guest_mem+data);
-
-					uhyve_open->ret = open((const char*)guest_mem+(size_t)uhyve_open->name, uhyve_open->flags, uhyve_open->mode);
-					break;
-				}
-
-			case UHYVE_PORT_CLOSE: {
-					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
-					uhyve_close_t* uhyve_close = (uhyve_close_t*) (guest_mem+data);
-
-					if (uhyve_close->fd > 2)
-						uhyve_close->ret = close(uhyve_close->fd);
-					else
-						uhyve_close->ret = 0;
-					break;
-				}
-
 			case UHYVE_PORT_NETINFO: {
 					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
 					uhyve_netinfo_t* uhyve_netinfo = (uhyve_netinfo_t*)(guest_mem+data);
 					memcpy(uhyve_netinfo->mac_str, uhyve_get_mac(), 18);
-					// guest configure the ethernet device => start network thread
+					uhyve_netinfo->queues = uhyve_net_queues();
+					// guest configure the ethernet device => create the interrupt
 					check_network();
 					break;
 				}
 
-			case UHYVE_PORT_NETWRITE: {
-					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
-					uhyve_netwrite_t* uhyve_netwrite = (uhyve_netwrite_t*)(guest_mem + data);
-					uhyve_netwrite->ret = 0;
-					ret = write(netfd, guest_mem + (size_t)uhyve_netwrite->data, uhyve_netwrite->len);
-					if (ret >= 0) {
-						uhyve_netwrite->ret = 0;
-						uhyve_netwrite->len = ret;
-					} else {
-						uhyve_netwrite->ret = -1;
-					}
-					break;
-				}
-
-			case UHYVE_PORT_NETREAD: {
-					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
-					uhyve_netread_t* uhyve_netread = (uhyve_netread_t*)(guest_mem + data);
-					ret = read(netfd, guest_mem + (size_t)uhyve_netread->data, uhyve_netread->len);
-					if (ret > 0) {
-						uhyve_netread->len = ret;
-						uhyve_netread->ret = 0;
-					} else uhyve_netread->ret = -1;
-					break;
-				}
-
 			case UHYVE_PORT_NETSTAT: {
 					unsigned status = *((unsigned*)((size_t)run+run->io.data_offset));
 					uhyve_netstat_t* uhyve_netstat = (uhyve_netstat_t*)(guest_mem + status);
@@ -886,16 +899,32 @@ static int vcpu_loop(void)
 					break;
 				}
 
-			case UHYVE_PORT_LSEEK: {
+			case UHYVE_PORT_NETRING: {
+					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
+
+					uhyve_net_ring_init(guest_mem, data, vmfd, efd);
+					break;
+				}
+
+			case UHYVE_PORT_NETKICK:
+				// only used, if KVM doesn't support an ioeventfd
+				uhyve_net_kick(*((unsigned*)((size_t)run+run->io.data_offset)));
+				break;
+
+			case UHYVE_PORT_RINGINIT: {
 					unsigned data = *((unsigned*)((size_t)run+run->io.data_offset));
-					uhyve_lseek_t* uhyve_lseek = (uhyve_lseek_t*) (guest_mem+data);
 
-					uhyve_lseek->offset = lseek(uhyve_lseek->fd, uhyve_lseek->offset, uhyve_lseek->whence);
+					uhyve_ring_init(guest_mem, data, vmfd, uhyve_io);
 					break;
 				}
 
+			case UHYVE_PORT_DOORBELL:
+				uhyve_ring_doorbell();
+				break;
+
 			default:
-				err(1, "KVM: unhandled KVM_EXIT_IO at port 0x%x, direction %d\n", run->io.port, run->io.direction);
+				if (uhyve_io(run->io.port, *((unsigned*)((size_t)run+run->io.data_offset))))
+					err(1, "KVM: unhandled KVM_EXIT_IO at port 0x%x, direction %d\n", run->io.port, run->io.direction);
 				break;
 			}
 			break;
@@ -1315,6 +1344,12 @@ int uhyve_init(char *path)
 	if (restart) {
 		if (load_checkpoint(guest_mem, path) != 0)
 			exit(EXIT_FAILURE);
+
+		// the guest has registered its request ring before the checkpoint
+		// => pending requests are executed by the new workers
+		uint64_t ring_addr = *((uint64_t*) (mboot + 0xD4));
+		if (ring_addr)
+			uhyve_ring_init(guest_mem, ring_addr, vmfd, uhyve_io);
 	} else {
 		if (load_kernel(guest_mem, path) != 0)
 			exit(EXIT_FAILURE);
@@ -1339,6 +1374,26 @@ int uhyve_init(char *path)
 	return ret;
 }
 
+// update the configuration file, after the checkpoint is written
+static void save_checkpoint_config(uint32_t no)
+{
+	FILE* f = fopen("checkpoint/chk_config.txt", "w");
+	if (f == NULL) {
+		err(1, "fopen: unable to open file");
+	}
+
+	fprintf(f, "number of cores: %u\n", ncores);
+	fprintf(f, "memory size: 0x%zx\n", guest_size);
+	fprintf(f, "checkpoint number: %u\n", no);
+	fprintf(f, "entry point: 0x%zx", elf_entry);
+	if (full_checkpoint)
+		fprintf(f, "full checkpoint: 1");
+	else
+		fprintf(f, "full checkpoint: 0");
+
+	fclose(f);
+}
+
 static void timer_handler(int signum)
 {
 	struct stat st = {0};
@@ -1346,12 +1401,20 @@ static void timer_handler(int signum)
 	char fname[MAX_FNAME];
 	struct timeval begin, end;
 
-	if (verbose)
-		gettimeofday(&begin, NULL);
-
 	if (stat("checkpoint", &st) == -1)
 		mkdir("checkpoint", 0700);
 
+	// wait for the previous checkpoint, before the vCPUs are stopped
+	checkpoint_begin(no_checkpoint, verbose);
+
+	// a request, which is consumed but not completed, would be lost
+	// after a restart => complete the running requests, while the vCPUs
+	// are still running, and keep the new ones in the submission queue
+	uhyve_ring_quiesce();
+
+	if (verbose)
+		gettimeofday(&begin, NULL);
+
 	for(size_t i = 0; i < ncores; i++)
 		if (vcpu_threads[i] != pthread_self())
 			pthread_kill(vcpu_threads[i], SIGRTMIN);
@@ -1360,13 +1423,6 @@ static void timer_handler(int signum)
 
 	save_cpu_state();
 
-	snprintf(fname, MAX_FNAME, "checkpoint/chk%u_mem.dat", no_checkpoint);
-
-	FILE* f = fopen(fname, "w");
-	if (f == NULL) {
-		err(1, "fopen: unable to open file");
-	}
-
 	/*struct kvm_irqchip irqchip = {};
 	if (cap_irqchip)
 		kvm_ioctl(vmfd, KVM_GET_IRQCHIP, &irqchip);
@@ -1377,12 +1433,11 @@ static void timer_handler(int signum)
 
 	struct kvm_clock_data clock = {};
 	kvm_ioctl(vmfd, KVM_GET_CLOCK, &clock);
-	if (fwrite(&clock, sizeof(clock), 1, f) != 1)
-		err(1, "fwrite failed");
+	checkpoint_stage(&clock, sizeof(clock), NULL, 0);
 
+	// the dirty pages are only copied, they are written after the vCPUs are resumed
 #if 0
-	if (fwrite(guest_mem, guest_size, 1, f) != 1)
-		err(1, "fwrite failed");
+	checkpoint_stage(guest_mem, guest_size, NULL, 0);
 #elif defined(USE_DIRTY_LOG)
 	static struct kvm_dirty_log dlog = {
 		.slot = 0,
@@ -1420,10 +1475,7 @@ nextslot:
 				{
 					size_t addr = (i*sizeof(size_t)*8+j)*PAGE_SIZE;
 
-					if (fwrite(&addr, sizeof(size_t), 1, f) != 1)
-						err(1, "fwrite failed");
-					if (fwrite((size_t*) (guest_mem + addr), PAGE_SIZE, 1, f) != 1)
-						err(1, "fwrite failed");
+					checkpoint_stage(&addr, sizeof(size_t), guest_mem + addr, PAGE_SIZE);
 				}
 			}
 		}
@@ -1459,54 +1511,34 @@ nextslot:
 							if (!full_checkpoint)
 								pgt[l] = pgt[l] & ~(PG_DIRTY|PG_ACCESSED);
 							size_t pgt_entry = pgt[l] & ~PG_PSE; // because PAT use the same bit as PSE
-							if (fwrite(&pgt_entry, sizeof(size_t), 1, f) != 1)
-								err(1, "fwrite failed");
-							if (fwrite((size_t*) (guest_mem + (pgt[l] & PAGE_MASK)), (1UL << PAGE_BITS), 1, f) != 1)
-								err(1, "fwrite failed");
+							checkpoint_stage(&pgt_entry, sizeof(size_t), guest_mem + (pgt[l] & PAGE_MASK), (1UL << PAGE_BITS));
 						}
 					}
 				} else if ((pgd[k] & flag) == flag) {
 					//printf("\t\t*pgd[%zd] 0x%zx, 2MB\n", k, pgd[k] & ~PG_XD);
 					if (!full_checkpoint)
 						pgd[k] = pgd[k] & ~(PG_DIRTY|PG_ACCESSED);
-					if (fwrite(pgd+k, sizeof(size_t), 1, f) != 1)
-						err(1, "fwrite failed");
-					if (fwrite((size_t*) (guest_mem + (pgd[k] & PAGE_2M_MASK)), (1UL << PAGE_2M_BITS), 1, f) != 1)
-						err(1, "fwrite failed");
+					checkpoint_stage(pgd+k, sizeof(size_t), guest_mem + (pgd[k] & PAGE_2M_MASK), (1UL << PAGE_2M_BITS));
 				}
 			}
 		}
 	}
 #endif
 
-	fclose(f);
+	uhyve_ring_resume();
 
 	pthread_barrier_wait(&barrier);
 
-	// update configuration file
-	f = fopen("checkpoint/chk_config.txt", "w");
-	if (f == NULL) {
-		err(1, "fopen: unable to open file");
-	}
-
-	fprintf(f, "number of cores: %u\n", ncores);
-	fprintf(f, "memory size: 0x%zx\n", guest_size);
-	fprintf(f, "checkpoint number: %u\n", no_checkpoint);
-	fprintf(f, "entry point: 0x%zx", elf_entry);
-	if (full_checkpoint)
-		fprintf(f, "full checkpoint: 1");
-	else
-		fprintf(f, "full checkpoint: 0");
-
-	fclose(f);
-
 	if (verbose) {
 		gettimeofday(&end, NULL);
 		size_t msec = (end.tv_sec - begin.tv_sec) * 1000;
 		msec += (end.tv_usec - begin.tv_usec) / 1000;
-		fprintf(stderr, "Create checkpoint %u in %zd ms\n", no_checkpoint, msec);
+		fprintf(stderr, "Create checkpoint %u, vCPUs stopped for %zd ms\n", no_checkpoint, msec);
 	}
 
+	snprintf(fname, MAX_FNAME, "checkpoint/chk%u_mem.dat", no_checkpoint);
+	checkpoint_commit(fname, save_checkpoint_config);
+
 	no_checkpoint++;
 }
 
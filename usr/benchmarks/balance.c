@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures the benefit of the load balancer for an unbalanced pthread
+ * workload. HermitCore places new threads round robin on the cores.
+ * 2*N threads are started, but only every second thread has work to
+ * do. If N is even, all busy threads pile up on half of the cores. Without
+ * migration, the runtime is twice the optimum.
+ *
+ * usage: balance [number of cores]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define WORK		(1ULL << 30)
+#define MAX_THREADS	256
+#define MAX_CORES	512
+
+extern int sys_sched_stats(unsigned int core_id, size_t* migrated_in, size_t* migrated_out);
+
+static pthread_t threads[MAX_THREADS];
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static void* worker(void* arg)
+{
+	volatile unsigned long long i, sum = 0;
+
+	if ((size_t) arg % 2)
+		return NULL;
+
+	for(i=0; i<WORK/16; i++)
+		sum += i;
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long start, single, total;
+	size_t in, out, moved = 0;
+	long i, ncores = 4;
+
+	if (argc > 1)
+		ncores = atol(argv[1]);
+	if ((ncores < 1) || (2*ncores > MAX_THREADS))
+		ncores = 4;
+
+	printf("Load balancing of unbalanced threads\n");
+	printf("====================================\n");
+
+	// reference: one busy thread without any competition
+	start = rdtsc();
+	pthread_create(threads, NULL, worker, (void*) 0);
+	pthread_join(threads[0], NULL);
+	single = rdtsc() - start;
+
+	start = rdtsc();
+	for(i=0; i<2*ncores; i++)
+		pthread_create(threads+i, NULL, worker, (void*) i);
+	for(i=0; i<2*ncores; i++)
+		pthread_join(threads[i], NULL);
+	total = rdtsc() - start;
+
+	printf("One busy thread: %llu cycles\n", single);
+	printf("%ld busy threads on %ld cores: %llu cycles (%.2f x optimum)\n",
+		ncores, ncores, total, (double) total / (double) single);
+
+	for(i=0; i<MAX_CORES; i++) {
+		if (sys_sched_stats(i, &in, &out))
+			continue;
+		if (in || out)
+			printf("Core %ld: %zu tasks pulled, %zu tasks handed over\n", i, in, out);
+		moved += in;
+	}
+	printf("Migrated tasks: %zu\n", moved);
+
+	return 0;
+}
@@ -35,13 +35,23 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sched.h>
+#include <pthread.h>
+#include <stdint.h>
 #ifndef __hermit__
 #include <sys/syscall.h>
+#include <time.h>
 
 static inline long mygetpid(void)
 {
 	return syscall(__NR_getpid);
 }
+
+static inline int mynanosleep(uint64_t ns)
+{
+	struct timespec ts = { ns / 1000000000ULL, ns % 1000000000ULL };
+
+	return nanosleep(&ts, NULL);
+}
 #else
 static inline long mygetpid(void)
 {
@@ -49,14 +59,28 @@ static inline long mygetpid(void)
 }
 
 int sched_yield(void);
+int sys_nanosleep(uint64_t ns);
+
+static inline int mynanosleep(uint64_t ns)
+{
+	return sys_nanosleep(ns);
+}
 #endif
 
 #define N		10000
 #define M		(256+1)
 #define BUFFSZ		(1ULL*1024ULL*1024ULL)
+#define T		1000
+#define S		100
+#define SLEEP_NS	20000
 
 static char* buff[M];
 
+static void* thread_func(void* arg)
+{
+	return arg;
+}
+
 #if 1
 inline static unsigned long long rdtsc(void)
 {
@@ -80,6 +104,7 @@ int main(int argc, char** argv)
 {
 	long i, j, ret;
 	unsigned long long start, end;
+	pthread_t thread;
 	const char str[] = "H";
 	size_t len = strlen(str);
 
@@ -130,6 +155,27 @@ int main(int argc, char** argv)
 
 	printf("Average time for the first page access: %lld cycles\n", (end - start) / ((M-1)*BUFFSZ/4096));
 
+	// cache warm-up
+	pthread_create(&thread, NULL, thread_func, NULL);
+	pthread_join(thread, NULL);
+
+	start = rdtsc();
+	for(i=0; i<T; i++) {
+		pthread_create(&thread, NULL, thread_func, NULL);
+		pthread_join(thread, NULL);
+	}
+	end = rdtsc();
+
+	printf("Average time for thread create/join: %lld cycles\n", (end - start) / T);
+
+	mynanosleep(SLEEP_NS);
+	start = rdtsc();
+	for(i=0; i<S; i++)
+		mynanosleep(SLEEP_NS);
+	end = rdtsc();
+
+	printf("Average time for a sleep of %d ns: %lld cycles\n", SLEEP_NS, (end - start) / S);
+
 #if 0
 	write(2, (const void *)str, len);
 	write(2, (const void *)str, len);
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Shows how tasks with the same priority share a core. All threads are
+ * bound to core 0 and spin for the same amount of work. The round robin
+ * time slices (HERMIT_TIMESLICE in microseconds) should give each thread
+ * a similar share of the core.
+ *
+ * usage: fairness [number of threads]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define WORK		(1ULL << 28)
+#define MAX_THREADS	64
+
+extern int sys_sched_setaffinity(unsigned int* id, size_t size, const void* mask);
+extern int sys_sched_usage(unsigned int* id, uint64_t* run_ns, uint64_t* wait_ns, uint64_t* nvcsw, uint64_t* nivcsw);
+extern int sys_getrusage(int who, void* usage);
+
+typedef struct {
+	uint64_t run_ns;
+	uint64_t wait_ns;
+	uint64_t nvcsw;
+	uint64_t nivcsw;
+} usage_t;
+
+static pthread_t threads[MAX_THREADS];
+static usage_t usage[MAX_THREADS];
+
+static void* worker(void* arg)
+{
+	usage_t* u = (usage_t*) arg;
+	volatile unsigned long long i, sum = 0;
+	uint64_t mask = 1;
+
+	sys_sched_setaffinity(NULL, sizeof(mask), &mask);
+
+	for(i=0; i<WORK; i++)
+		sum += i;
+
+	sys_sched_usage(NULL, &u->run_ns, &u->wait_ns, &u->nvcsw, &u->nivcsw);
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	struct { int64_t sec, usec; } ru[2];
+	double sum = 0.0, sum2 = 0.0;
+	long i, n = 4;
+
+	if (argc > 1)
+		n = atol(argv[1]);
+	if ((n < 1) || (n > MAX_THREADS))
+		n = 4;
+
+	printf("Time sharing of %ld threads on one core\n", n);
+	printf("=======================================\n");
+
+	for(i=0; i<n; i++)
+		pthread_create(threads+i, NULL, worker, usage+i);
+	for(i=0; i<n; i++)
+		pthread_join(threads[i], NULL);
+
+	for(i=0; i<n; i++) {
+		printf("Thread %ld: run %llu ms, wait %llu ms, %llu preempted, %llu blocked\n", i,
+			(unsigned long long) usage[i].run_ns / 1000000ULL,
+			(unsigned long long) usage[i].wait_ns / 1000000ULL,
+			(unsigned long long) usage[i].nivcsw, (unsigned long long) usage[i].nvcsw);
+		sum += (double) usage[i].run_ns;
+		sum2 += (double) usage[i].run_ns * (double) usage[i].run_ns;
+	}
+
+	// Jain's fairness index: 1.0 means all threads got the same CPU time
+	if (sum2 > 0.0)
+		printf("Fairness index: %.3f\n", (sum * sum) / ((double) n * sum2));
+
+	if (!sys_getrusage(0, ru))
+		printf("CPU time of the application: %lld.%06lld s\n",
+			(long long) ru[0].sec, (long long) ru[0].usec);
+
+	return 0;
+}
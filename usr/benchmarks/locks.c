@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Compares the kernel semaphores (sys_sem_*), which are used by the
+ * pthread library, with a futex based mutex. 1..N threads increment a
+ * shared counter, which is protected by the lock. The futex based mutex
+ * enters the kernel only, if the lock is contended.
+ *
+ * usage: locks [maximum number of threads]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define ITERATIONS	100000
+#define MAX_THREADS	64
+
+typedef struct sem sem_t;
+
+extern int sys_sem_init(sem_t** sem, unsigned int value);
+extern int sys_sem_destroy(sem_t* sem);
+extern int sys_sem_wait(sem_t* sem);
+extern int sys_sem_post(sem_t* sem);
+extern int sys_futex_wait(int32_t* addr, int32_t val, uint64_t ns);
+extern int sys_futex_wake(int32_t* addr, int32_t count);
+
+static pthread_t threads[MAX_THREADS];
+static pthread_barrier_t barrier;
+static volatile unsigned long long counter;
+static sem_t* sem;
+/// 0 = unlocked, 1 = locked, -1 = locked with waiters
+static int32_t futex;
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static inline void futex_lock(int32_t* f)
+{
+	int32_t val = 0;
+
+	if (__atomic_compare_exchange_n(f, &val, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	if (val == 1)
+		val = __atomic_exchange_n(f, -1, __ATOMIC_ACQUIRE);
+	while (val != 0) {
+		sys_futex_wait(f, -1, 0);
+		val = __atomic_exchange_n(f, -1, __ATOMIC_ACQUIRE);
+	}
+}
+
+static inline void futex_unlock(int32_t* f)
+{
+	if (__atomic_exchange_n(f, 0, __ATOMIC_RELEASE) < 0)
+		sys_futex_wake(f, 1);
+}
+
+static void* sem_worker(void* arg)
+{
+	long i;
+
+	pthread_barrier_wait(&barrier);
+
+	for(i=0; i<ITERATIONS; i++) {
+		sys_sem_wait(sem);
+		counter++;
+		sys_sem_post(sem);
+	}
+
+	return NULL;
+}
+
+static void* futex_worker(void* arg)
+{
+	long i;
+
+	pthread_barrier_wait(&barrier);
+
+	for(i=0; i<ITERATIONS; i++) {
+		futex_lock(&futex);
+		counter++;
+		futex_unlock(&futex);
+	}
+
+	return NULL;
+}
+
+static unsigned long long run(void* (*worker)(void*), long nthreads)
+{
+	unsigned long long start, end;
+	long i;
+
+	counter = 0;
+	pthread_barrier_init(&barrier, NULL, nthreads+1);
+
+	for(i=0; i<nthreads; i++)
+		pthread_create(threads+i, NULL, worker, NULL);
+
+	pthread_barrier_wait(&barrier);
+	start = rdtsc();
+	for(i=0; i<nthreads; i++)
+		pthread_join(threads[i], NULL);
+	end = rdtsc();
+
+	pthread_barrier_destroy(&barrier);
+
+	if (counter != (unsigned long long) nthreads * ITERATIONS)
+		fprintf(stderr, "Lost updates: counter %llu, expected %llu\n",
+			counter, (unsigned long long) nthreads * ITERATIONS);
+
+	return (end - start) / ((unsigned long long) nthreads * ITERATIONS);
+}
+
+int main(int argc, char** argv)
+{
+	long nthreads, max_threads = 4;
+
+	if (argc > 1)
+		max_threads = atol(argv[1]);
+	if ((max_threads < 1) || (max_threads > MAX_THREADS))
+		max_threads = 4;
+
+	if (sys_sem_init(&sem, 1)) {
+		fprintf(stderr, "Unable to initialize the semaphore\n");
+		return 1;
+	}
+
+	printf("Lock/unlock latency\n");
+	printf("===================\n");
+	printf("threads   sem_t (cycles)   futex (cycles)\n");
+
+	for(nthreads=1; nthreads<=max_threads; nthreads++) {
+		unsigned long long t_sem = run(sem_worker, nthreads);
+		unsigned long long t_futex = run(futex_worker, nthreads);
+
+		printf("%7ld   %14llu   %14llu\n", nthreads, t_sem, t_futex);
+	}
+
+	sys_sem_destroy(sem);
+
+	return 0;
+}
@@ -57,12 +57,15 @@ int opt(int argc, char *argv[], struct opt *opt)
 
     opt->list_cnt = 1000;
 
+    opt->isolate = -1;
+    opt->prio = 0;
+
 
     /*
      * read command line arguments and store them in opt
      */
 
-    while ((c = getopt(argc, argv, "b:c:d:hr:t:")) != -1) {
+    while ((c = getopt(argc, argv, "b:c:d:hi:p:r:t:")) != -1) {
         switch (c) {
             case 'h' :
                 printf("usage: %s <options>\n", basename(argv[0]));
@@ -72,6 +75,8 @@ int opt(int argc, char *argv[], struct opt *opt)
                 printf("   -c N     count (hist or list)\n");
                 printf("   -b N     hist bin width (in ticks)\n");
                 printf("   -t N     threshold (in ticks)\n");
+                printf("   -i N     run exclusively on core N\n");
+                printf("   -p N     task priority\n");
                 exit(1);
                 break;
             case 'd' :
@@ -103,6 +108,12 @@ int opt(int argc, char *argv[], struct opt *opt)
             case 't' :
                 opt->threshold = (unsigned)strtoul(optarg, &p, 0);
                 break;
+            case 'i' :
+                opt->isolate = (int)strtol(optarg, &p, 0);
+                break;
+            case 'p' :
+                opt->prio = (int)strtol(optarg, &p, 0);
+                break;
         }
     }
 
@@ -31,6 +31,9 @@ struct opt {
     unsigned hist_width;
 
     unsigned list_cnt;
+
+    int isolate;    /* core, which the benchmark owns exclusively (-1: none) */
+    int prio;       /* task priority (0: default) */
 };
 
 int opt(int argc, char *argv[], struct opt *opt);
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2017, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures the latency of heap faults and of requests for zeroed pages.
+ * Start the benchmark with HERMIT_ZEROPOOL=0 to disable the pool of
+ * pre-zeroed pages and compare it with a run using the default pool.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define PAGE_SIZE	4096
+#define FAULTS		(16*1024)
+#define BATCH		128
+#define ROUNDS		64
+
+extern size_t get_zeroed_page(void);
+extern int put_pages(size_t phyaddr, size_t npages);
+extern void sys_msleep(unsigned int ms);
+extern void sys_zero_pool_stats(size_t* depth, size_t* hits, size_t* misses, size_t* refills);
+
+static size_t pages[BATCH];
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long start, end, diff, sum = 0, min = ~0ULL, max = 0;
+	size_t depth, hits, misses, refills;
+	char* buf;
+	long i, j;
+
+	printf("Page fault latency\n");
+	printf("==================\n");
+
+	buf = (char*) malloc(FAULTS * PAGE_SIZE);
+	if (!buf) {
+		fprintf(stderr, "Unable to allocate the buffer\n");
+		return 1;
+	}
+
+	// align to the next page
+	buf = (char*) (((size_t) buf + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+
+	for(i=0; i<FAULTS-1; i++) {
+		start = rdtsc();
+		buf[i*PAGE_SIZE] = 1;
+		diff = rdtsc() - start;
+
+		sum += diff;
+		if (diff < min)
+			min = diff;
+		if (diff > max)
+			max = diff;
+	}
+
+	printf("First access of a heap page: avg %llu, min %llu, max %llu cycles\n",
+		sum / (FAULTS-1), min, max);
+
+	// give the idle loop the chance to refill the pool
+	sys_msleep(100);
+
+	sum = 0; min = ~0ULL; max = 0;
+	for(i=0; i<ROUNDS; i++) {
+		for(j=0; j<BATCH; j++) {
+			start = rdtsc();
+			pages[j] = get_zeroed_page();
+			end = rdtsc();
+
+			diff = end - start;
+			sum += diff;
+			if (diff < min)
+				min = diff;
+			if (diff > max)
+				max = diff;
+		}
+
+		for(j=0; j<BATCH; j++) {
+			if (pages[j])
+				put_pages(pages[j], 1);
+		}
+
+		sys_msleep(10);
+	}
+
+	printf("Request of a zeroed page: avg %llu, min %llu, max %llu cycles\n",
+		sum / (ROUNDS*BATCH), min, max);
+
+	sys_zero_pool_stats(&depth, &hits, &misses, &refills);
+	printf("Zeroed page pool: depth %zu, hits %zu, misses %zu, refilled %zu\n",
+		depth, hits, misses, refills);
+
+	return 0;
+}
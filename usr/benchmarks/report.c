@@ -27,6 +27,12 @@ int report_params(const struct opt *opt)
     printf("init: tps = %llu\n", (unsigned long long)opt->tps);
     printf("secs      : %u\n", opt->secs);
     printf("threshold : %llu\n", (unsigned long long)opt->threshold);
+    if (opt->isolate >= 0) {
+        printf("isolate   : core %d\n", opt->isolate);
+    }
+    if (opt->prio > 0) {
+        printf("priority  : %d\n", opt->prio);
+    }
     if (opt->mode == hist) {
         printf("mode      : histogram (cnt: %u, width: %u)\n", opt->hist_cnt, opt->hist_width);
     } else if (opt->mode == list) {
@@ -18,6 +18,13 @@
 
 #include "setup.h"
 
+#include <stdio.h>
+
+#ifdef __hermit__
+extern int sys_setprio(int* id, int prio);
+extern int sys_sched_isolate(int core_id);
+extern int sys_sched_unisolate(void);
+#endif
 
 int setup(struct opt *opt)
 {
@@ -26,6 +33,25 @@ int setup(struct opt *opt)
      * depending on opt
      * e.g. create cpu-set, move IRQs, etc.
      */
+#ifdef __hermit__
+    int ret;
+
+    if (opt->prio > 0) {
+        ret = sys_setprio(NULL, opt->prio);
+        if (ret < 0) {
+            printf("ERROR: unable to set priority %d (%d)\n", opt->prio, ret);
+            return ret;
+        }
+    }
+
+    if (opt->isolate >= 0) {
+        ret = sys_sched_isolate(opt->isolate);
+        if (ret < 0) {
+            printf("ERROR: unable to isolate core %d (%d)\n", opt->isolate, ret);
+            return ret;
+        }
+    }
+#endif
 
 
     return 0;
@@ -36,5 +62,10 @@ int setdown(struct opt *opt)
     /*
      * undo things from setup()
      */
+#ifdef __hermit__
+    if (opt->isolate >= 0) {
+        sys_sched_unisolate();
+    }
+#endif
     return 0;
 }
@@ -204,6 +204,9 @@ extern void tuned_STREAM_Triad(STREAM_TYPE scalar);
 #ifdef _OPENMP
 extern int omp_get_num_threads();
 #endif
+#ifdef __hermit__
+extern void sys_heap_stats(size_t* faults, size_t* huge_faults);
+#endif
 int
 main()
     {
@@ -374,6 +377,16 @@ main()
     checkSTREAMresults();
     printf(HLINE);
 
+#ifdef __hermit__
+    {
+    size_t faults = 0, huge_faults = 0;
+
+    sys_heap_stats(&faults, &huge_faults);
+    printf("Heap faults = %zu, backed by 2 MiB pages = %zu\n", faults, huge_faults);
+    printf(HLINE);
+    }
+#endif
+
     return 0;
 }
 
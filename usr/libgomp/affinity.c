@@ -23,10 +23,317 @@
    see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
    <http://www.gnu.org/licenses/>.  */
 
-/* This is a generic stub implementation of a CPU affinity setting.  */
+/* CPU affinity on HermitCore uses the sched_setaffinity system call.
+   Without HermitCore, this is a generic stub implementation.  */
 
 #include "libgomp.h"
 
+#ifdef __hermit__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+
+/* Largest number of cores, which a place may contain.  */
+#define GOMP_CPUSET_BITS	512
+#define GOMP_CPUSET_WORD	(8 * sizeof (unsigned long))
+
+typedef struct
+{
+  unsigned long bits[GOMP_CPUSET_BITS / GOMP_CPUSET_WORD];
+} gomp_cpuset_t;
+
+extern int sys_sched_setaffinity (unsigned int *id, size_t size,
+				  const void *mask);
+extern int sys_sched_getaffinity (unsigned int *id, size_t size, void *mask);
+
+/* Cores, which are available to the process.  */
+static gomp_cpuset_t gomp_cpuset;
+static bool gomp_cpuset_valid;
+
+static inline bool
+gomp_cpuset_isset (unsigned long num, const gomp_cpuset_t *set)
+{
+  return (set->bits[num / GOMP_CPUSET_WORD] >> (num % GOMP_CPUSET_WORD)) & 1;
+}
+
+static inline void
+gomp_cpuset_set (unsigned long num, gomp_cpuset_t *set)
+{
+  set->bits[num / GOMP_CPUSET_WORD] |= 1UL << (num % GOMP_CPUSET_WORD);
+}
+
+static inline void
+gomp_cpuset_clr (unsigned long num, gomp_cpuset_t *set)
+{
+  set->bits[num / GOMP_CPUSET_WORD] &= ~(1UL << (num % GOMP_CPUSET_WORD));
+}
+
+static unsigned long
+gomp_cpuset_popcount (const gomp_cpuset_t *set)
+{
+  unsigned long i, ret = 0;
+
+  for (i = 0; i < GOMP_CPUSET_BITS / GOMP_CPUSET_WORD; i++)
+    ret += __builtin_popcountl (set->bits[i]);
+  return ret;
+}
+
+static bool
+gomp_cpuset_init (void)
+{
+  if (!gomp_cpuset_valid)
+    gomp_cpuset_valid = sys_sched_getaffinity (NULL, sizeof (gomp_cpuset),
+					       &gomp_cpuset) == 0;
+  return gomp_cpuset_valid;
+}
+
+void
+gomp_init_affinity (void)
+{
+  if (gomp_places_list == NULL)
+    {
+      if (!gomp_affinity_init_level (1, ULONG_MAX, true))
+	return;
+    }
+
+  struct gomp_thread *thr = gomp_thread ();
+  sys_sched_setaffinity (NULL, sizeof (gomp_cpuset_t), gomp_places_list[0]);
+  thr->place = 1;
+  thr->ts.place_partition_off = 0;
+  thr->ts.place_partition_len = gomp_places_list_len;
+}
+
+/* The pthread attributes don't carry an affinity mask.  Instead,
+   gomp_thread_start calls this function with ATTR == NULL and the new
+   thread binds itself to its place.  */
+
+void
+gomp_init_thread_affinity (pthread_attr_t *attr, unsigned int place)
+{
+  if (attr == NULL)
+    sys_sched_setaffinity (NULL, sizeof (gomp_cpuset_t),
+			   gomp_places_list[place]);
+}
+
+void **
+gomp_affinity_alloc (unsigned long count, bool quiet)
+{
+  unsigned long i;
+  void **ret;
+  char *p;
+
+  if (!gomp_cpuset_init ())
+    {
+      if (!quiet)
+	gomp_error ("Could not get CPU affinity set");
+      return NULL;
+    }
+
+  ret = malloc (count * sizeof (void *) + count * sizeof (gomp_cpuset_t));
+  if (ret == NULL)
+    {
+      if (!quiet)
+	gomp_error ("Out of memory trying to allocate places list");
+      return NULL;
+    }
+
+  p = (char *) (ret + count);
+  for (i = 0; i < count; i++, p += sizeof (gomp_cpuset_t))
+    ret[i] = p;
+  return ret;
+}
+
+void
+gomp_affinity_init_place (void *p)
+{
+  memset (p, 0, sizeof (gomp_cpuset_t));
+}
+
+bool
+gomp_affinity_add_cpus (void *p, unsigned long num,
+			unsigned long len, long stride, bool quiet)
+{
+  gomp_cpuset_t *cpusetp = (gomp_cpuset_t *) p;
+
+  for (;;)
+    {
+      if (num >= GOMP_CPUSET_BITS)
+	{
+	  if (!quiet)
+	    gomp_error ("Logical CPU number %lu out of range", num);
+	  return false;
+	}
+      gomp_cpuset_set (num, cpusetp);
+      if (--len == 0)
+	return true;
+      if ((stride < 0 && num + stride > num)
+	  || (stride > 0 && num + stride < num))
+	{
+	  if (!quiet)
+	    gomp_error ("Logical CPU number %lu+%ld out of range",
+			num, stride);
+	  return false;
+	}
+      num += stride;
+    }
+}
+
+bool
+gomp_affinity_remove_cpu (void *p, unsigned long num)
+{
+  gomp_cpuset_t *cpusetp = (gomp_cpuset_t *) p;
+
+  if (num >= GOMP_CPUSET_BITS)
+    {
+      gomp_error ("Logical CPU number %lu out of range", num);
+      return false;
+    }
+  if (!gomp_cpuset_isset (num, cpusetp))
+    {
+      gomp_error ("Logical CPU %lu to be removed is not in the set", num);
+      return false;
+    }
+  gomp_cpuset_clr (num, cpusetp);
+  return true;
+}
+
+bool
+gomp_affinity_copy_place (void *p, void *q, long stride)
+{
+  unsigned long i;
+  gomp_cpuset_t *destp = (gomp_cpuset_t *) p;
+  gomp_cpuset_t *srcp = (gomp_cpuset_t *) q;
+
+  memset (destp, 0, sizeof (gomp_cpuset_t));
+  for (i = 0; i < GOMP_CPUSET_BITS; i++)
+    if (gomp_cpuset_isset (i, srcp))
+      {
+	if ((stride < 0 && i + stride > i)
+	    || (stride > 0 && (i + stride < i
+			       || i + stride >= GOMP_CPUSET_BITS)))
+	  {
+	    gomp_error ("Logical CPU number %lu+%ld out of range", i, stride);
+	    return false;
+	  }
+	gomp_cpuset_set (i + stride, destp);
+      }
+  return true;
+}
+
+bool
+gomp_affinity_same_place (void *p, void *q)
+{
+  return memcmp (p, q, sizeof (gomp_cpuset_t)) == 0;
+}
+
+bool
+gomp_affinity_finalize_place_list (bool quiet)
+{
+  unsigned long i, j, k;
+
+  for (i = 0, j = 0; i < gomp_places_list_len; i++)
+    {
+      gomp_cpuset_t *cpusetp = (gomp_cpuset_t *) gomp_places_list[i];
+
+      /* Remove the cores, which aren't available.  */
+      for (k = 0; k < GOMP_CPUSET_BITS / GOMP_CPUSET_WORD; k++)
+	cpusetp->bits[k] &= gomp_cpuset.bits[k];
+      if (gomp_cpuset_popcount (cpusetp) != 0)
+	gomp_places_list[j++] = gomp_places_list[i];
+    }
+
+  if (j == 0)
+    {
+      if (!quiet)
+	gomp_error ("None of the places contain usable logical CPUs");
+      return false;
+    }
+  else if (j < gomp_places_list_len)
+    {
+      if (!quiet)
+	gomp_error ("Number of places reduced from %ld to %ld because some "
+		    "places didn't contain any usable logical CPUs",
+		    gomp_places_list_len, j);
+      gomp_places_list_len = j;
+    }
+  return true;
+}
+
+/* HermitCore doesn't know the topology of the cores.  Threads and cores
+   are handled as one place per core, sockets as one place with all
+   available cores.  */
+
+bool
+gomp_affinity_init_level (int level, unsigned long count, bool quiet)
+{
+  unsigned long i, maxcount;
+
+  if (!gomp_cpuset_init ())
+    {
+      if (!quiet)
+	gomp_error ("Could not get CPU affinity set");
+      return false;
+    }
+
+  maxcount = level == 3 ? 1 : gomp_cpuset_popcount (&gomp_cpuset);
+  if (count > maxcount)
+    count = maxcount;
+  gomp_places_list = gomp_affinity_alloc (count, quiet);
+  gomp_places_list_len = 0;
+  if (gomp_places_list == NULL)
+    return false;
+
+  if (level == 3)
+    {
+      memcpy (gomp_places_list[0], &gomp_cpuset, sizeof (gomp_cpuset_t));
+      gomp_places_list_len = 1;
+      return true;
+    }
+
+  for (i = 0; i < GOMP_CPUSET_BITS && gomp_places_list_len < count; i++)
+    if (gomp_cpuset_isset (i, &gomp_cpuset))
+      {
+	gomp_affinity_init_place (gomp_places_list[gomp_places_list_len]);
+	gomp_affinity_add_cpus (gomp_places_list[gomp_places_list_len],
+				i, 1, 0, true);
+	++gomp_places_list_len;
+      }
+  return true;
+}
+
+void
+gomp_affinity_print_place (void *p)
+{
+  unsigned long i, len;
+  gomp_cpuset_t *cpusetp = (gomp_cpuset_t *) p;
+  bool notfirst = false;
+
+  for (i = 0, len = 0; i < GOMP_CPUSET_BITS; i++)
+    if (gomp_cpuset_isset (i, cpusetp))
+      {
+	if (len == 0)
+	  {
+	    if (notfirst)
+	      fputc (',', stderr);
+	    notfirst = true;
+	    fprintf (stderr, "%lu", i);
+	  }
+	++len;
+      }
+    else
+      {
+	if (len > 1)
+	  fprintf (stderr, ":%lu", len);
+	len = 0;
+      }
+  if (len > 1)
+    fprintf (stderr, ":%lu", len);
+}
+
+#else
+
 void
 gomp_init_affinity (void)
 {
@@ -114,3 +421,5 @@ gomp_affinity_print_place (void *p)
 {
   (void) p;
 }
+
+#endif
@@ -1 +1,28 @@
-/* Everything is in the header.  */
+/* Everything is in the header, except of the contended path of the
+   futex based mutex on HermitCore.  */
+
+#ifdef __hermit__
+#include "libgomp.h"
+
+extern int sys_futex_wait (int *addr, int val, unsigned long long ns);
+extern int sys_futex_wake (int *addr, int count);
+
+void
+gomp_mutex_lock_slow (gomp_mutex_t *mutex, int oldval)
+{
+  /* Mark the mutex as contended, before we go to sleep.  */
+  if (oldval == 1)
+    oldval = __atomic_exchange_n (mutex, -1, __ATOMIC_ACQUIRE);
+  while (oldval != 0)
+    {
+      sys_futex_wait (mutex, -1, 0);
+      oldval = __atomic_exchange_n (mutex, -1, __ATOMIC_ACQUIRE);
+    }
+}
+
+void
+gomp_mutex_unlock_slow (gomp_mutex_t *mutex)
+{
+  sys_futex_wake (mutex, 1);
+}
+#endif
@@ -29,6 +29,44 @@
 #ifndef GOMP_MUTEX_H
 #define GOMP_MUTEX_H 1
 
+#ifdef __hermit__
+
+/* On HermitCore, the mutex is a futex word: 0 = unlocked, 1 = locked,
+   -1 = locked with waiters.  Only the contended path enters the kernel.  */
+
+typedef int gomp_mutex_t;
+
+#define GOMP_MUTEX_INIT_0 1
+
+extern void gomp_mutex_lock_slow (gomp_mutex_t *mutex, int oldval);
+extern void gomp_mutex_unlock_slow (gomp_mutex_t *mutex);
+
+static inline void gomp_mutex_init (gomp_mutex_t *mutex)
+{
+  *mutex = 0;
+}
+
+static inline void gomp_mutex_lock (gomp_mutex_t *mutex)
+{
+  int oldval = 0;
+  if (!__atomic_compare_exchange_n (mutex, &oldval, 1, false,
+				    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    gomp_mutex_lock_slow (mutex, oldval);
+}
+
+static inline void gomp_mutex_unlock (gomp_mutex_t *mutex)
+{
+  int val = __atomic_exchange_n (mutex, 0, __ATOMIC_RELEASE);
+  if (__builtin_expect (val < 0, 0))
+    gomp_mutex_unlock_slow (mutex);
+}
+
+static inline void gomp_mutex_destroy (gomp_mutex_t *mutex)
+{
+}
+
+#else /* __hermit__  */
+
 #include <pthread.h>
 
 typedef pthread_mutex_t gomp_mutex_t;
@@ -55,4 +93,6 @@ static inline void gomp_mutex_destroy (gomp_mutex_t *mutex)
   pthread_mutex_destroy (mutex);
 }
 
+#endif /* __hermit__  */
+
 #endif /* GOMP_MUTEX_H */
@@ -33,7 +33,49 @@
 
 #include "libgomp.h"
 
-#ifdef HAVE_BROKEN_POSIX_SEMAPHORES
+#ifdef __hermit__
+extern int sys_futex_wait (int *addr, int val, unsigned long long ns);
+extern int sys_futex_wake (int *addr, int count);
+
+void
+gomp_sem_wait_slow (gomp_sem_t *sem, int count)
+{
+  for (;;)
+    {
+      /* We have been waiting => other waiters may still sleep, so keep
+	 SEM_WAIT set to let the next post wake up one of them.  */
+      if ((count & ~SEM_WAIT) != 0)
+	{
+	  if (__atomic_compare_exchange_n (sem, &count,
+					   (count - SEM_INC) | SEM_WAIT, true,
+					   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	    {
+	      /* Several posts may have been consumed by a single wakeup,
+		 so pass the remaining units on to the next waiter.  */
+	      if ((count & ~SEM_WAIT) > SEM_INC)
+		gomp_sem_post_slow (sem);
+	      return;
+	    }
+	  continue;
+	}
+
+      if (!(count & SEM_WAIT)
+	  && !__atomic_compare_exchange_n (sem, &count, count | SEM_WAIT,
+					   true, __ATOMIC_RELAXED,
+					   __ATOMIC_RELAXED))
+	continue;
+
+      sys_futex_wait (sem, count | SEM_WAIT, 0);
+      count = __atomic_load_n (sem, __ATOMIC_RELAXED);
+    }
+}
+
+void
+gomp_sem_post_slow (gomp_sem_t *sem)
+{
+  sys_futex_wake (sem, 1);
+}
+#elif defined(HAVE_BROKEN_POSIX_SEMAPHORES)
 #include <stdlib.h>
 
 void gomp_sem_init (gomp_sem_t *sem, int value)
@@ -34,6 +34,55 @@
 #ifndef GOMP_SEM_H
 #define GOMP_SEM_H 1
 
+#ifdef __hermit__
+
+/* On HermitCore, the semaphore is a futex word.  The count is stored
+   in multiples of SEM_INC and SEM_WAIT indicates sleeping waiters.  */
+
+typedef int gomp_sem_t;
+
+#define SEM_WAIT 1
+#define SEM_INC 2
+
+extern void gomp_sem_wait_slow (gomp_sem_t *sem, int count);
+extern void gomp_sem_post_slow (gomp_sem_t *sem);
+
+static inline void gomp_sem_init (gomp_sem_t *sem, int value)
+{
+  *sem = value * SEM_INC;
+}
+
+static inline void gomp_sem_wait (gomp_sem_t *sem)
+{
+  int count = __atomic_load_n (sem, __ATOMIC_RELAXED);
+
+  while ((count & ~SEM_WAIT) != 0)
+    if (__atomic_compare_exchange_n (sem, &count, count - SEM_INC, true,
+				     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      return;
+  gomp_sem_wait_slow (sem, count);
+}
+
+static inline void gomp_sem_post (gomp_sem_t *sem)
+{
+  int count = __atomic_load_n (sem, __ATOMIC_RELAXED);
+
+  /* Clear SEM_WAIT, the woken waiter sets it again if necessary.  */
+  while (!__atomic_compare_exchange_n (sem, &count,
+				       (count + SEM_INC) & ~SEM_WAIT, true,
+				       __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    continue;
+
+  if (__builtin_expect (count & SEM_WAIT, 0))
+    gomp_sem_post_slow (sem);
+}
+
+static inline void gomp_sem_destroy (gomp_sem_t *sem)
+{
+}
+
+#else /* __hermit__  */
+
 #ifdef HAVE_ATTRIBUTE_VISIBILITY
 # pragma GCC visibility push(default)
 #endif
@@ -85,4 +134,5 @@ static inline void gomp_sem_destroy (gomp_sem_t *sem)
   sem_destroy (sem);
 }
 #endif /* doesn't HAVE_BROKEN_POSIX_SEMAPHORES  */
+#endif /* __hermit__  */
 #endif /* GOMP_SEM_H  */
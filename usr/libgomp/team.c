@@ -88,6 +88,12 @@ gomp_thread_start (void *xdata)
   thr->task = data->task;
   thr->place = data->place;
 
+#ifdef __hermit__
+  /* Bind the thread to its place, pthread attributes can't do this.  */
+  if (thr->place)
+    gomp_init_thread_affinity (NULL, thr->place - 1);
+#endif
+
   thr->ts.team->ordered_release[thr->ts.team_id] = &thr->release;
 
   /* Make thread pool local. */
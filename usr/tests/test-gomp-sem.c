@@ -0,0 +1,100 @@
+/*
+ * Stress test of libgomp's futex based semaphore. N waiters sleep on
+ * the same semaphore and receive N posts back to back. Each waiter has
+ * to return, even if a single wakeup observes several posts.
+ *
+ * usage: test-gomp-sem [number of waiters]
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <pthread.h>
+
+// gomp_sem_t is private to libgomp => use its implementation directly
+#include "../libgomp/sem.h"
+
+#ifndef MAX_WAITERS
+#define MAX_WAITERS	16
+#endif
+
+#ifndef NUM_ROUNDS
+#define NUM_ROUNDS	1000
+#endif
+
+// timeout of a round in microseconds
+#ifndef TIMEOUT
+#define TIMEOUT		1000000
+#endif
+
+static gomp_sem_t sem;
+static volatile int started = 0;
+static volatile int finished = 0;
+
+static void* waiter(void* arg)
+{
+	__atomic_add_fetch(&started, 1, __ATOMIC_RELAXED);
+	gomp_sem_wait(&sem);
+	__atomic_add_fetch(&finished, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	pthread_t threads[MAX_WAITERS];
+	int n = MAX_WAITERS;
+	int round, i, ret;
+	unsigned waited;
+
+	if (argc > 1)
+		n = atoi(argv[1]);
+	if ((n < 1) || (n > MAX_WAITERS))
+		n = MAX_WAITERS;
+
+	for(round=0; round<NUM_ROUNDS; round++)
+	{
+		gomp_sem_init(&sem, 0);
+		started = finished = 0;
+
+		for(i=0; i<n; i++)
+		{
+			ret = pthread_create(threads+i, NULL, waiter, NULL);
+			assert(!ret);
+		}
+
+		// wait until the waiters block in the kernel
+		while (__atomic_load_n(&started, __ATOMIC_RELAXED) < n)
+			sched_yield();
+		usleep(1000);
+
+		// back to back => a waiter may observe several posts
+		for(i=0; i<n; i++)
+			gomp_sem_post(&sem);
+
+		for(waited=0; __atomic_load_n(&finished, __ATOMIC_ACQUIRE) < n; waited+=100)
+		{
+			if (waited >= TIMEOUT) {
+				fprintf(stderr, "Round %d: only %d of %d waiters are woken up\n",
+					round, finished, n);
+				exit(EXIT_FAILURE);
+			}
+			usleep(100);
+		}
+
+		for(i=0; i<n; i++)
+		{
+			ret = pthread_join(threads[i], NULL);
+			assert(!ret);
+		}
+
+		gomp_sem_destroy(&sem);
+	}
+
+	printf("%d rounds with %d waiters passed\n", NUM_ROUNDS, n);
+
+	return EXIT_SUCCESS;
+}
@@ -17,8 +17,94 @@
 #define SIZE    16384
 #endif
 
+#ifndef NUM_OPS
+#define NUM_OPS     100000
+#endif
+
+#ifndef BATCH
+#define BATCH       32
+#endif
+
 __thread void* buf;
 
+// HermitCore is a library OS => the kernel allocator is directly accessible
+extern void* kmalloc(size_t sz);
+extern void kfree(void* addr);
+extern unsigned int get_cpufreq();
+
+static pthread_barrier_t barrier;
+static unsigned long long cycles[NUM_THREADS];
+
+inline static unsigned long long rdtsc(void)
+{
+    unsigned long lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+    return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static void* kmalloc_work( void* argument )
+{
+    int id = *( ( int* )argument );
+    void* objs[BATCH];
+    unsigned long long start;
+
+    pthread_barrier_wait(&barrier);
+
+    start = rdtsc();
+    for(int i=0; i<NUM_OPS/BATCH; i++)
+    {
+        // sizes between 16 and 2048 byte => typical for kernel objects
+        for(int j=0; j<BATCH; j++)
+            objs[j] = kmalloc(16 << ((i+j) % 8));
+        for(int j=0; j<BATCH; j++)
+            kfree(objs[j]);
+    }
+    cycles[id] = rdtsc() - start;
+
+    return NULL;
+}
+
+/*
+ * Measure the throughput of kmalloc / kfree pairs for an increasing
+ * number of threads. HermitCore distributes the threads round robin
+ * over the cores => the number of threads is (up to the number of
+ * cores) equal to the number of used cores.
+ */
+static void kmalloc_bench(void)
+{
+    pthread_t threads[ NUM_THREADS ];
+    int thread_args[ NUM_THREADS ];
+    unsigned long long max;
+    int result_code;
+    unsigned index, n;
+
+    for( n = 1; n <= NUM_THREADS; ++n )
+    {
+        pthread_barrier_init(&barrier, NULL, n);
+
+        for( index = 0; index < n; ++index )
+        {
+            thread_args[ index ] = index;
+            result_code = pthread_create( threads + index, NULL, kmalloc_work, &thread_args[index] );
+            assert( !result_code );
+        }
+
+        max = 0;
+        for( index = 0; index < n; ++index )
+        {
+            result_code = pthread_join( threads[ index ], NULL );
+            assert( !result_code );
+            if (cycles[ index ] > max)
+                max = cycles[ index ];
+        }
+
+        pthread_barrier_destroy(&barrier);
+
+        printf( "kmalloc/kfree with %u threads: %.0f ops/sec\n", n,
+            (double) n * NUM_OPS * get_cpufreq() * 1000000.0 / (double) max );
+    }
+}
+
 static void* perform_work( void* argument )
 {
     int passed_in_value;
@@ -63,5 +149,8 @@ int main( int argc, char** argv )
     }
 
     printf( "In main: All threads completed successfully\n" );
+
+    kmalloc_bench();
+
     exit( EXIT_SUCCESS );
 }
@@ -0,0 +1,131 @@
+/*
+ * Stress test for the kernel's virtual memory areas. Stacks are created
+ * and destroyed in random order, which fragments the address space, and
+ * afterwards many threads are started and joined in waves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define NUM_STACKS	512
+#define NUM_ROUNDS	64
+#define STACK_SIZE	(16*1024)
+#define NUM_THREADS	64
+#define NUM_WAVES	32
+
+// HermitCore is a library OS => the kernel functions are directly accessible
+extern void* create_stack(size_t sz);
+extern int destroy_stack(void* addr, size_t sz);
+extern void vma_dump(void);
+
+static char* stacks[NUM_STACKS];
+static size_t sizes[NUM_STACKS];
+
+static int check_overlap(int n)
+{
+	int i;
+
+	// each stack is surrounded by guard pages, which belong to the same VMA
+	for(i=0; i<NUM_STACKS; i++) {
+		if (!stacks[i] || (i == n))
+			continue;
+		if ((stacks[n] < stacks[i] + sizes[i] + 4096) && (stacks[i] < stacks[n] + sizes[n] + 4096)) {
+			printf("Stack %d (%p) overlaps stack %d (%p)\n", n, stacks[n], i, stacks[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int stack_test(void)
+{
+	int i, j, errors = 0;
+
+	srand(42);
+
+	for(i=0; i<NUM_ROUNDS; i++) {
+		for(j=0; j<NUM_STACKS; j++) {
+			int n = rand() % NUM_STACKS;
+
+			if (stacks[n]) {
+				if (destroy_stack(stacks[n], sizes[n])) {
+					printf("Unable to destroy stack %p\n", stacks[n]);
+					errors++;
+				}
+				stacks[n] = NULL;
+			} else {
+				sizes[n] = STACK_SIZE << (rand() % 4);
+				stacks[n] = create_stack(sizes[n]);
+				if (!stacks[n]) {
+					printf("Unable to create stack of %zu bytes\n", sizes[n]);
+					errors++;
+					continue;
+				}
+
+				// touch the whole stack
+				memset(stacks[n], 0xAB, sizes[n]);
+				errors += check_overlap(n);
+			}
+		}
+	}
+
+	for(i=0; i<NUM_STACKS; i++) {
+		if (stacks[i])
+			destroy_stack(stacks[i], sizes[i]);
+		stacks[i] = NULL;
+	}
+
+	return errors;
+}
+
+static void* thread_func(void* arg)
+{
+	volatile char buf[1024];
+
+	memset((char*) buf, (int) (size_t) arg, sizeof(buf));
+
+	return arg;
+}
+
+static int thread_test(void)
+{
+	pthread_t threads[NUM_THREADS];
+	int i, j, ret, errors = 0;
+	void* res;
+
+	for(i=0; i<NUM_WAVES; i++) {
+		for(j=0; j<NUM_THREADS; j++) {
+			ret = pthread_create(threads+j, NULL, thread_func, (void*) (size_t) j);
+			if (ret) {
+				printf("Thread creation failed! error = %d\n", ret);
+				return errors + 1;
+			}
+		}
+
+		for(j=0; j<NUM_THREADS; j++) {
+			pthread_join(threads[j], &res);
+			if ((size_t) res != (size_t) j)
+				errors++;
+		}
+	}
+
+	return errors;
+}
+
+int main(int argc, char** argv)
+{
+	int errors;
+
+	errors = stack_test();
+	printf("Create/destroy %d stacks: %d errors\n", NUM_ROUNDS*NUM_STACKS, errors);
+
+	errors += thread_test();
+	printf("Create/join %d threads: %d errors\n", NUM_WAVES*NUM_THREADS, errors);
+
+	vma_dump();
+
+	return errors ? 1 : 0;
+}